@@ -0,0 +1,514 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+extern "C" {
+#include <vcap/decode.h>
+}
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Measures what each capture configuration costs: for every camera and every format/size/frame rate it offers, streams
+ * for a fixed time and reports achieved frame rate, drops, capture-to-user latency, CPU time spent dequeuing and
+ * decoding, and bandwidth. With -s a generated recording played back through Replay stands in for the cameras, so the
+ * frame source and decode paths can be benchmarked on machines without any.
+ *
+ * Usage: vcap-bench [-t seconds] [-f csv|json] [-o file] [-s] [device...]
+ */
+
+/*
+ * Frames captured before measurement starts, so driver start-up and exposure settling are not counted.
+ */
+static const unsigned int WARMUP_FRAMES = 5;
+
+static const std::uint32_t SYNTHETIC_CODES[] = { Vcap::FMT_GREY, Vcap::FMT_YUYV, Vcap::FMT_YUV420, Vcap::FMT_RGB24 };
+static const std::uint32_t SYNTHETIC_SIZES[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+static const std::uint16_t SYNTHETIC_RATES[] = { 30, 60 };
+
+/*
+ * Frames in the recording the synthetic source loops over; enough that consecutive frames differ, few enough to keep
+ * the temporary file small at 1080p.
+ */
+static const std::uint32_t SYNTHETIC_FRAMES = 8;
+
+/*
+ * One benchmarked configuration.
+ */
+struct Result {
+	std::string source;
+	std::string device;
+	std::string format;
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint16_t frameRate;
+
+	double seconds;
+	std::uint64_t frames;
+	std::uint64_t drops;
+	std::uint64_t errors;
+	std::uint64_t bytes;
+
+	Vcap::LatencyHistogram latency;
+
+	std::uint64_t dequeueCpu;	// ns
+	std::uint64_t decodeCpu;	// ns
+	bool decoded;
+
+	Result() : width(0), height(0), frameRate(0), seconds(0), frames(0), drops(0), errors(0), bytes(0), dequeueCpu(0),
+			decodeCpu(0), decoded(false) { }
+};
+
+static std::uint64_t clockTime(clockid_t clock) {
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static std::string codeString(std::uint32_t code) {
+	std::string str;
+
+	for (unsigned int i = 0; i < 4; i++)
+		str += (char)((code >> (8 * i)) & 0xFF);
+
+	return str;
+}
+
+/*
+ * Bytes in a frame of the synthetic source's formats.
+ */
+static std::size_t frameSize(std::uint32_t code, std::uint32_t width, std::uint32_t height) {
+	switch (code) {
+		case Vcap::FMT_GREY:
+			return width * height;
+		case Vcap::FMT_YUYV:
+			return 2 * width * height;
+		case Vcap::FMT_YUV420:
+			return width * height * 3 / 2;
+		default:
+			return 3 * width * height;
+	}
+}
+
+/*
+ * Accounts for one captured frame: sequence gaps are drops, and the latency runs from the capture timestamp to the
+ * moment the frame reached us.
+ */
+static void countFrame(Result& result, std::uint32_t sequence, std::uint32_t& lastSequence, std::size_t size,
+		std::uint64_t timestamp, std::uint64_t now) {
+	if (result.frames > 0 && sequence > lastSequence + 1)
+		result.drops += sequence - lastSequence - 1;
+
+	lastSequence = sequence;
+
+	result.frames++;
+	result.bytes += size;
+
+	if (now >= timestamp)
+		result.latency.record(now - timestamp);
+}
+
+/*
+ * Decodes a frame, charging the thread CPU time to the result. Formats Vcap cannot decode are reported as such.
+ */
+static void decodeFrame(Result& result, std::uint8_t* data, std::uint32_t code, std::uint32_t width,
+		std::uint32_t height, std::vector<std::uint8_t>& out) {
+	std::uint64_t cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+
+	if (-1 == vcap_decode(data, out.data(), code, width, height, false))
+		return;
+
+	result.decodeCpu += clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	result.decoded = true;
+}
+
+/*
+ * Streams one format/size/frame rate from a camera.
+ */
+static void benchCamera(Vcap::CameraPtr camera, std::uint32_t code, const Vcap::Size& size, std::uint16_t frameRate,
+		double seconds, Result& result) {
+	result.source = "camera";
+	result.device = camera->device();
+	result.format = codeString(code);
+	result.width = size.width();
+	result.height = size.height();
+	result.frameRate = frameRate;
+
+	camera->setFormat(Vcap::Format(code, size));
+
+	if (frameRate > 0)
+		camera->setFrameRate(frameRate);
+
+	std::vector<std::uint8_t> out(3 * size.width() * size.height());
+
+	camera->start();
+
+	try {
+		for (unsigned int i = 0; i < WARMUP_FRAMES; i++)
+			camera->dequeue();
+
+		std::uint64_t start = clockTime(CLOCK_MONOTONIC);
+		std::uint64_t end = start + (std::uint64_t)(seconds * 1e9);
+		std::uint32_t lastSequence = 0;
+
+		while (clockTime(CLOCK_MONOTONIC) < end) {
+			std::uint64_t cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+
+			Vcap::Frame frame;
+			Vcap::Status status = camera->tryDequeue(frame);
+
+			result.dequeueCpu += clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+			if (!status.ok()) {
+				if (ENODEV == status.error())
+					throw Vcap::DeviceLostError(status.message());
+
+				result.errors++;
+				continue;
+			}
+
+			countFrame(result, frame.sequence(), lastSequence, frame.size(), frame.timestamp(),
+					clockTime(CLOCK_MONOTONIC) / 1000);
+
+			//multi-planar frames cannot be handed to vcap_decode() as a single buffer
+			if (1 == frame.numPlanes())
+				decodeFrame(result, frame.data(), code, size.width(), size.height(), out);
+		}
+
+		result.seconds = (clockTime(CLOCK_MONOTONIC) - start) / 1e9;
+	} catch (Vcap::RuntimeError& e) {
+		camera->stop();
+		throw;
+	}
+
+	camera->stop();
+}
+
+/*
+ * Streams one format/size/frame rate from a short generated recording played back in a loop through Replay, so the
+ * library's frame source path (reading, pool hand-off) and the decode path can be measured without hardware. The
+ * benchmark keeps the fixed clock itself rather than relying on Replay's pacing, which restarts on every loop.
+ */
+static void benchSynthetic(std::uint32_t code, std::uint32_t width, std::uint32_t height, std::uint16_t frameRate,
+		double seconds, Result& result) {
+	result.source = "synthetic";
+	result.device = "replay";
+	result.format = codeString(code);
+	result.width = width;
+	result.height = height;
+	result.frameRate = frameRate;
+
+	std::size_t size = frameSize(code, width, height);
+	std::uint64_t interval = 1000000000 / frameRate;
+
+	const char* tmp = std::getenv("TMPDIR");
+	std::string path = std::string(tmp ? tmp : "/tmp") + "/vcap-bench-XXXXXX";
+
+	int fd = mkstemp(&path[0]);
+
+	if (-1 == fd)
+		throw Vcap::RuntimeError("Unable to create " + path + ": " + std::strerror(errno));
+
+	close(fd);
+
+	try {
+		Vcap::Recorder recorder(path, Vcap::Format(code, Vcap::Size(width, height)), frameRate);
+
+		std::vector<std::uint8_t> frame(size);
+
+		for (std::size_t i = 0; i < size; i++)
+			frame[i] = (std::uint8_t)(i * 7 + i / width);
+
+		for (std::uint32_t sequence = 0; sequence < SYNTHETIC_FRAMES; sequence++) {
+			//vary the frames so the decoder cannot benefit from identical input
+			std::memcpy(frame.data(), &sequence, sizeof(sequence));
+
+			recorder.write(frame.data(), size, sequence * interval / 1000, sequence);
+		}
+
+		recorder.close();
+
+		Vcap::Replay replay(path, false);
+		replay.setLoop(true);
+		replay.start();
+
+		Vcap::FramePool pool(2, size);
+		std::vector<std::uint8_t> out(3 * width * height);
+
+		std::uint64_t start = clockTime(CLOCK_MONOTONIC);
+		std::uint64_t deadline = start;
+		std::uint64_t end = start + (std::uint64_t)(seconds * 1e9);
+		std::uint32_t sequence = 0;
+		std::uint32_t lastSequence = 0;
+
+		while (deadline < end) {
+			deadline += interval;
+
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000000000;
+			ts.tv_nsec = deadline % 1000000000;
+
+			while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+
+			std::uint64_t cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+
+			Vcap::Frame frame = replay.grab(pool, false);
+
+			result.dequeueCpu += clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+			//recorded sequence numbers restart on every loop
+			countFrame(result, sequence++, lastSequence, frame.size(), deadline / 1000,
+					clockTime(CLOCK_MONOTONIC) / 1000);
+			decodeFrame(result, frame.data(), code, width, height, out);
+		}
+
+		result.seconds = (clockTime(CLOCK_MONOTONIC) - start) / 1e9;
+	} catch (Vcap::RuntimeError& e) {
+		unlink(path.c_str());
+		throw;
+	}
+
+	unlink(path.c_str());
+}
+
+static double perSecond(double value, double seconds) {
+	return seconds > 0 ? value / seconds : 0;
+}
+
+static double perFrame(std::uint64_t ns, std::uint64_t frames) {
+	return frames > 0 ? ns / 1000.0 / frames : 0;
+}
+
+static const char* CSV_HEADER = "source,device,format,width,height,target_fps,seconds,frames,fps,drops,errors,"
+		"latency_mean_us,latency_p50_us,latency_p99_us,latency_max_us,dequeue_cpu_us,decode_cpu_us,bytes_per_sec";
+
+static void writeCsv(std::ostream& out, const Result& r) {
+	out << r.source << "," << r.device << "," << r.format << "," << r.width << "," << r.height << "," << r.frameRate
+			<< "," << r.seconds << "," << r.frames << "," << perSecond(r.frames, r.seconds) << "," << r.drops << ","
+			<< r.errors << "," << r.latency.mean() << "," << r.latency.percentile(50) << ","
+			<< r.latency.percentile(99) << "," << r.latency.max() << "," << perFrame(r.dequeueCpu, r.frames) << ",";
+
+	if (r.decoded)
+		out << perFrame(r.decodeCpu, r.frames);
+
+	out << "," << (std::uint64_t)perSecond(r.bytes, r.seconds) << std::endl;
+}
+
+static void writeJson(std::ostream& out, const Result& r) {
+	out << "{\"source\":\"" << r.source << "\",\"device\":\"" << r.device << "\",\"format\":\"" << r.format
+			<< "\",\"width\":" << r.width << ",\"height\":" << r.height << ",\"target_fps\":" << r.frameRate
+			<< ",\"seconds\":" << r.seconds << ",\"frames\":" << r.frames << ",\"fps\":"
+			<< perSecond(r.frames, r.seconds) << ",\"drops\":" << r.drops << ",\"errors\":" << r.errors
+			<< ",\"latency_us\":{\"mean\":" << r.latency.mean() << ",\"p50\":" << r.latency.percentile(50)
+			<< ",\"p99\":" << r.latency.percentile(99) << ",\"max\":" << r.latency.max() << "}"
+			<< ",\"dequeue_cpu_us\":" << perFrame(r.dequeueCpu, r.frames) << ",\"decode_cpu_us\":";
+
+	if (r.decoded)
+		out << perFrame(r.decodeCpu, r.frames);
+	else
+		out << "null";
+
+	out << ",\"bytes_per_sec\":" << (std::uint64_t)perSecond(r.bytes, r.seconds) << "}";
+}
+
+/*
+ * Prints results as they complete, so a long run can be watched or interrupted.
+ */
+class Report {
+	public:
+		Report(std::ostream& out, bool json) : _out(out), _json(json), _count(0) {
+			if (_json)
+				_out << "[";
+			else
+				_out << CSV_HEADER << std::endl;
+		}
+
+		~Report() {
+			if (_json)
+				_out << "\n]" << std::endl;
+		}
+
+		void add(const Result& result) {
+			if (_json) {
+				_out << (_count > 0 ? ",\n" : "\n");
+				writeJson(_out, result);
+				_out.flush();
+			} else {
+				writeCsv(_out, result);
+			}
+
+			_count++;
+		}
+
+	private:
+		std::ostream& _out;
+		bool _json;
+		unsigned int _count;
+};
+
+static void usage(const char* name) {
+	std::cerr << "Usage: " << name << " [-t seconds] [-f csv|json] [-o file] [-s] [device...]" << std::endl;
+	std::cerr << "  -t  seconds to stream each configuration (default 5)" << std::endl;
+	std::cerr << "  -f  output format (default csv)" << std::endl;
+	std::cerr << "  -o  write results to a file instead of stdout" << std::endl;
+	std::cerr << "  -s  benchmark a generated recording played back through Replay instead of cameras" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	double seconds = 5;
+	bool json = false;
+	bool synthetic = false;
+	std::string path;
+
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "t:f:o:sh"))) {
+		switch (opt) {
+			case 't':
+				seconds = std::stod(optarg);
+				break;
+			case 'f':
+				json = std::string("json") == optarg;
+				break;
+			case 'o':
+				path = optarg;
+				break;
+			case 's':
+				synthetic = true;
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	std::ofstream file;
+
+	if (!path.empty()) {
+		file.open(path.c_str());
+
+		if (!file) {
+			std::cerr << "Unable to open " << path << std::endl;
+			return -1;
+		}
+	}
+
+	Report report(path.empty() ? std::cout : file, json);
+
+	if (synthetic) {
+		for (std::uint32_t code : SYNTHETIC_CODES) {
+			for (const std::uint32_t* size : SYNTHETIC_SIZES) {
+				for (std::uint16_t frameRate : SYNTHETIC_RATES) {
+					Result result;
+
+					try {
+						benchSynthetic(code, size[0], size[1], frameRate, seconds, result);
+					} catch (Vcap::RuntimeError& e) {
+						std::cerr << "synthetic " << codeString(code) << " " << size[0] << "x" << size[1] << "@"
+								<< frameRate << ": " << e.what() << std::endl;
+						continue;
+					}
+
+					report.add(result);
+				}
+			}
+		}
+
+		return 0;
+	}
+
+	std::vector<Vcap::CameraPtr> cameras;
+
+	try {
+		if (optind < argc) {
+			for (int i = optind; i < argc; i++)
+				cameras.push_back(Vcap::makeSmart<Vcap::Camera>(std::string(argv[i])));
+		} else {
+			cameras = Vcap::Camera::cameras();
+		}
+	} catch (Vcap::RuntimeError& e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	if (0 == cameras.size()) {
+		std::cerr << "No cameras found! Use -s to benchmark the synthetic source." << std::endl;
+		return -1;
+	}
+
+	for (Vcap::CameraPtr camera : cameras) {
+		try {
+			camera->open();
+
+			//memory-mapped streaming gives zero-copy access and driver capture timestamps
+			camera->setIoMode(Vcap::IO_MMAP);
+
+			Vcap::FormatList formats = camera->formatList();
+
+			for (const Vcap::FormatDesc& format : formats) {
+				const Vcap::Size* sizes = formats.sizes(format);
+
+				for (unsigned int i = 0; i < format.numSizes; i++) {
+					std::vector<std::uint16_t> frameRates = camera->frameRates(Vcap::Format(format.code, sizes[i]));
+
+					if (frameRates.empty())
+						frameRates.push_back(0);
+
+					for (std::uint16_t frameRate : frameRates) {
+						Result result;
+
+						try {
+							benchCamera(camera, format.code, sizes[i], frameRate, seconds, result);
+						} catch (Vcap::DeviceLostError& e) {
+							throw;
+						} catch (Vcap::RuntimeError& e) {
+							std::cerr << camera->device() << " " << codeString(format.code) << " "
+									<< sizes[i].width() << "x" << sizes[i].height() << "@" << frameRate << ": "
+									<< e.what() << std::endl;
+							continue;
+						}
+
+						report.add(result);
+					}
+				}
+			}
+
+			camera->close();
+		} catch (Vcap::RuntimeError& e) {
+			std::cerr << camera->device() << ": " << e.what() << std::endl;
+		}
+	}
+
+	return 0;
+}
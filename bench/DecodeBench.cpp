@@ -0,0 +1,400 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/Formats.hpp>
+
+#include "Decode.hpp"
+
+extern "C" {
+#include <vcap/decode.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+/*
+ * Measures vcap_decode() throughput, in megapixels per second, for every uncompressed format in Formats.hpp at
+ * several resolutions and for both RGB and BGR output. Multi-planar formats are given one synthetic buffer per plane
+ * and timed through the bindings' own plane decoder, as Camera does. Input frames are filled from a fixed-seed
+ * generator and each result is the median of several timed repetitions, so runs on the same machine can be compared
+ * across commits. Formats that cannot be decoded are reported on stderr and skipped.
+ *
+ * Compressed formats (JPEG, MPEG and the vendor-specific bitstreams) are not covered: they need real encoded frames,
+ * not synthetic data.
+ *
+ * Usage: vcap-decode-bench [-t seconds] [-n repetitions] [-s WxH]... [-F filter] [-f csv|json] [-o file]
+ */
+
+struct DecodeFormat {
+	const char* name;
+	std::uint32_t code;
+
+	/*
+	 * Number of separate planes; 0 for formats held in one buffer.
+	 */
+	unsigned int planes;
+};
+
+static const DecodeFormat FORMATS[] = {
+	{ "RGB332", Vcap::FMT_RGB332 },
+	{ "RGB444", Vcap::FMT_RGB444 },
+	{ "RGB555", Vcap::FMT_RGB555 },
+	{ "RGB565", Vcap::FMT_RGB565 },
+	{ "RGB555X", Vcap::FMT_RGB555X },
+	{ "RGB565X", Vcap::FMT_RGB565X },
+	{ "BGR666", Vcap::FMT_BGR666 },
+	{ "BGR24", Vcap::FMT_BGR24 },
+	{ "RGB24", Vcap::FMT_RGB24 },
+	{ "BGR32", Vcap::FMT_BGR32 },
+	{ "RGB32", Vcap::FMT_RGB32 },
+	{ "GREY", Vcap::FMT_GREY },
+	{ "Y4", Vcap::FMT_Y4 },
+	{ "Y6", Vcap::FMT_Y6 },
+	{ "Y10", Vcap::FMT_Y10 },
+	{ "Y12", Vcap::FMT_Y12 },
+	{ "Y16", Vcap::FMT_Y16 },
+	{ "PAL8", Vcap::FMT_PAL8 },
+	{ "UV8", Vcap::FMT_UV8 },
+	{ "YVU410", Vcap::FMT_YVU410 },
+	{ "YVU420", Vcap::FMT_YVU420 },
+	{ "YUYV", Vcap::FMT_YUYV },
+	{ "YYUV", Vcap::FMT_YYUV },
+	{ "YVYU", Vcap::FMT_YVYU },
+	{ "UYVY", Vcap::FMT_UYVY },
+	{ "VYUY", Vcap::FMT_VYUY },
+	{ "YUV422P", Vcap::FMT_YUV422P },
+	{ "YUV411P", Vcap::FMT_YUV411P },
+	{ "Y41P", Vcap::FMT_Y41P },
+	{ "YUV444", Vcap::FMT_YUV444 },
+	{ "YUV555", Vcap::FMT_YUV555 },
+	{ "YUV565", Vcap::FMT_YUV565 },
+	{ "YUV32", Vcap::FMT_YUV32 },
+	{ "YUV410", Vcap::FMT_YUV410 },
+	{ "YUV420", Vcap::FMT_YUV420 },
+	{ "HI240", Vcap::FMT_HI240 },
+	{ "HM12", Vcap::FMT_HM12 },
+	{ "M420", Vcap::FMT_M420 },
+	{ "NV12", Vcap::FMT_NV12 },
+	{ "NV21", Vcap::FMT_NV21 },
+	{ "NV16", Vcap::FMT_NV16 },
+	{ "NV61", Vcap::FMT_NV61 },
+	{ "NV24", Vcap::FMT_NV24 },
+	{ "NV42", Vcap::FMT_NV42 },
+	{ "NV12M", Vcap::FMT_NV12M, 2 },
+	{ "NV21M", Vcap::FMT_NV21M, 2 },
+	{ "NV16M", Vcap::FMT_NV16M, 2 },
+	{ "NV61M", Vcap::FMT_NV61M, 2 },
+	{ "NV12MT", Vcap::FMT_NV12MT, 2 },
+	{ "NV12MT_16X16", Vcap::FMT_NV12MT_16X16, 2 },
+	{ "YUV420M", Vcap::FMT_YUV420M, 3 },
+	{ "YVU420M", Vcap::FMT_YVU420M, 3 },
+	{ "SBGGR8", Vcap::FMT_SBGGR8 },
+	{ "SGBRG8", Vcap::FMT_SGBRG8 },
+	{ "SGRBG8", Vcap::FMT_SGRBG8 },
+	{ "SRGGB8", Vcap::FMT_SRGGB8 },
+	{ "SBGGR10", Vcap::FMT_SBGGR10 },
+	{ "SGBRG10", Vcap::FMT_SGBRG10 },
+	{ "SGRBG10", Vcap::FMT_SGRBG10 },
+	{ "SRGGB10", Vcap::FMT_SRGGB10 },
+	{ "SBGGR12", Vcap::FMT_SBGGR12 },
+	{ "SGBRG12", Vcap::FMT_SGBRG12 },
+	{ "SGRBG12", Vcap::FMT_SGRBG12 },
+	{ "SRGGB12", Vcap::FMT_SRGGB12 },
+	{ "SBGGR10ALAW8", Vcap::FMT_SBGGR10ALAW8 },
+	{ "SGBRG10ALAW8", Vcap::FMT_SGBRG10ALAW8 },
+	{ "SGRBG10ALAW8", Vcap::FMT_SGRBG10ALAW8 },
+	{ "SRGGB10ALAW8", Vcap::FMT_SRGGB10ALAW8 },
+	{ "SBGGR10DPCM8", Vcap::FMT_SBGGR10DPCM8 },
+	{ "SGBRG10DPCM8", Vcap::FMT_SGBRG10DPCM8 },
+	{ "SGRBG10DPCM8", Vcap::FMT_SGRBG10DPCM8 },
+	{ "SRGGB10DPCM8", Vcap::FMT_SRGGB10DPCM8 },
+	{ "SBGGR16", Vcap::FMT_SBGGR16 },
+	{ "SN9C20X_I420", Vcap::FMT_SN9C20X_I420 },
+	{ "SPCA501", Vcap::FMT_SPCA501 },
+	{ "SPCA505", Vcap::FMT_SPCA505 },
+	{ "SPCA508", Vcap::FMT_SPCA508 },
+	{ "CIT_YYVYUY", Vcap::FMT_CIT_YYVYUY },
+	{ "KONICA420", Vcap::FMT_KONICA420 },
+};
+
+static const std::uint32_t DEFAULT_SIZES[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+
+/*
+ * Input buffers are sized for the widest format (32 bits per pixel) plus slack for formats with line padding.
+ */
+static const std::size_t INPUT_BYTES_PER_PIXEL = 4;
+static const std::size_t INPUT_SLACK = 65536;
+
+struct Result {
+	std::string format;
+	std::uint32_t width;
+	std::uint32_t height;
+	bool bgr;
+
+	std::uint64_t frames;
+	double median;	// megapixels/s
+	double min;
+	double max;
+};
+
+/*
+ * Fills the input with a fixed pseudo-random sequence, so every run decodes the same data.
+ */
+static void fill(std::vector<std::uint8_t>& data) {
+	std::uint32_t state = 0x12345678;
+
+	for (std::size_t i = 0; i < data.size(); i++) {
+		state = state * 1664525 + 1013904223;
+		data[i] = (std::uint8_t)(state >> 24);
+	}
+}
+
+/*
+ * Lays the planes of a multi-planar format out back to back in the input buffer. Chroma planes are half width for
+ * the 4:2:0 three-plane formats and interleaved (full width) otherwise.
+ */
+static void layoutPlanes(const DecodeFormat& format, std::uint32_t width, std::uint32_t height,
+		std::vector<std::uint8_t>& in, Vcap::Plane* planes) {
+	std::uint8_t* data = in.data();
+
+	planes[0].data = data;
+	planes[0].stride = width;
+	planes[0].size = (std::size_t)width * height;
+
+	data += planes[0].size;
+
+	for (unsigned int i = 1; i < format.planes; i++) {
+		bool vertical = Vcap::FMT_NV16M != format.code && Vcap::FMT_NV61M != format.code;
+
+		planes[i].data = data;
+		planes[i].stride = 3 == format.planes ? (width + 1) / 2 : width;
+		planes[i].size = planes[i].stride * (vertical ? (height + 1) / 2 : height);
+
+		data += planes[i].size;
+	}
+}
+
+static bool decode(const DecodeFormat& format, const Vcap::Plane* planes, std::uint32_t width, std::uint32_t height,
+		bool bgr, std::vector<std::uint8_t>& in, std::vector<std::uint8_t>& out) {
+	if (format.planes > 0)
+		return Vcap::decodePlanes(planes, format.planes, format.code, width, height, out.data(), bgr);
+
+	return -1 != vcap_decode(in.data(), out.data(), format.code, width, height, bgr);
+}
+
+/*
+ * Times repeated decodes of one format, size and output order. Returns false if the format cannot be decoded.
+ */
+static bool bench(const DecodeFormat& format, std::uint32_t width, std::uint32_t height, bool bgr, double seconds,
+		unsigned int repetitions, std::vector<std::uint8_t>& in, std::vector<std::uint8_t>& out, Result& result) {
+	typedef std::chrono::steady_clock Clock;
+
+	Vcap::Plane planes[Vcap::MAX_PLANES];
+
+	if (format.planes > 0)
+		layoutPlanes(format, width, height, in, planes);
+
+	//warm up caches and fail early on unsupported formats
+	for (unsigned int i = 0; i < 2; i++) {
+		if (!decode(format, planes, width, height, bgr, in, out))
+			return false;
+	}
+
+	double pixels = (double)width * height;
+	std::vector<double> rates;
+
+	result.frames = 0;
+
+	for (unsigned int r = 0; r < repetitions; r++) {
+		Clock::time_point start = Clock::now();
+		Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+				std::chrono::duration<double>(seconds));
+		Clock::time_point now;
+
+		std::uint64_t frames = 0;
+
+		do {
+			decode(format, planes, width, height, bgr, in, out);
+			frames++;
+		} while ((now = Clock::now()) < end);
+
+		double elapsed = std::chrono::duration<double>(now - start).count();
+
+		rates.push_back(frames * pixels / elapsed / 1e6);
+		result.frames += frames;
+	}
+
+	std::sort(rates.begin(), rates.end());
+
+	result.format = format.name;
+	result.width = width;
+	result.height = height;
+	result.bgr = bgr;
+	result.median = rates[rates.size() / 2];
+	result.min = rates.front();
+	result.max = rates.back();
+
+	return true;
+}
+
+static void writeCsv(std::ostream& out, const Result& r) {
+	out << r.format << "," << r.width << "," << r.height << "," << (r.bgr ? "bgr" : "rgb") << "," << r.frames << ","
+			<< r.median << "," << r.min << "," << r.max << "," << (r.width * (double)r.height / r.median)
+			<< std::endl;
+}
+
+static void writeJson(std::ostream& out, const Result& r) {
+	out << "{\"format\":\"" << r.format << "\",\"width\":" << r.width << ",\"height\":" << r.height
+			<< ",\"output\":\"" << (r.bgr ? "bgr" : "rgb") << "\",\"frames\":" << r.frames << ",\"mpix_per_sec\":{"
+			<< "\"median\":" << r.median << ",\"min\":" << r.min << ",\"max\":" << r.max << "},\"us_per_frame\":"
+			<< (r.width * (double)r.height / r.median) << "}";
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage: " << name << " [-t seconds] [-n repetitions] [-s WxH]... [-F filter] [-f csv|json] [-o file]"
+			<< std::endl;
+	std::cerr << "  -t  seconds per repetition (default 0.2)" << std::endl;
+	std::cerr << "  -n  timed repetitions; the median is reported (default 5)" << std::endl;
+	std::cerr << "  -s  frame size, may be repeated (default 640x480, 1280x720, 1920x1080, 3840x2160)" << std::endl;
+	std::cerr << "  -F  only benchmark formats whose name contains filter" << std::endl;
+	std::cerr << "  -f  output format (default csv)" << std::endl;
+	std::cerr << "  -o  write results to a file instead of stdout" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	double seconds = 0.2;
+	unsigned int repetitions = 5;
+	bool json = false;
+	std::string filter;
+	std::string path;
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> sizes;
+
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "t:n:s:F:f:o:h"))) {
+		switch (opt) {
+			case 't':
+				seconds = std::stod(optarg);
+				break;
+			case 'n':
+				repetitions = std::max(1, std::stoi(optarg));
+				break;
+			case 's': {
+				unsigned int width, height;
+
+				if (2 != sscanf(optarg, "%ux%u", &width, &height) || 0 == width || 0 == height) {
+					usage(argv[0]);
+					return -1;
+				}
+
+				sizes.push_back(std::make_pair(width, height));
+				break;
+			}
+			case 'F':
+				filter = optarg;
+				break;
+			case 'f':
+				json = std::string("json") == optarg;
+				break;
+			case 'o':
+				path = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	if (sizes.empty()) {
+		for (const std::uint32_t* size : DEFAULT_SIZES)
+			sizes.push_back(std::make_pair(size[0], size[1]));
+	}
+
+	std::ofstream file;
+
+	if (!path.empty()) {
+		file.open(path.c_str());
+
+		if (!file) {
+			std::cerr << "Unable to open " << path << std::endl;
+			return -1;
+		}
+	}
+
+	std::ostream& out = path.empty() ? std::cout : file;
+
+	if (json)
+		out << "[";
+	else
+		out << "format,width,height,output,frames,mpix_per_sec_median,mpix_per_sec_min,mpix_per_sec_max,us_per_frame"
+				<< std::endl;
+
+	unsigned int count = 0;
+
+	for (const std::pair<std::uint32_t, std::uint32_t>& size : sizes) {
+		std::size_t pixels = (std::size_t)size.first * size.second;
+
+		std::vector<std::uint8_t> in(INPUT_BYTES_PER_PIXEL * pixels + INPUT_SLACK);
+		std::vector<std::uint8_t> rgb(3 * pixels);
+
+		fill(in);
+
+		for (const DecodeFormat& format : FORMATS) {
+			if (!filter.empty() && std::string(format.name).find(filter) == std::string::npos)
+				continue;
+
+			for (unsigned int bgr = 0; bgr < 2; bgr++) {
+				Result result;
+
+				if (!bench(format, size.first, size.second, bgr, seconds, repetitions, in, rgb, result)) {
+					if (!bgr)
+						std::cerr << format.name << " " << size.first << "x" << size.second << ": not supported"
+								<< std::endl;
+					break;
+				}
+
+				if (json) {
+					out << (count > 0 ? ",\n" : "\n");
+					writeJson(out, result);
+					out.flush();
+				} else {
+					writeCsv(out, result);
+				}
+
+				count++;
+			}
+		}
+	}
+
+	if (json)
+		out << "\n]" << std::endl;
+
+	return 0;
+}
@@ -25,7 +25,6 @@
 #include <vector>
 
 #include <stdio.h>
-#include <unistd.h>
 
 /*
  * Grabs raw data from a camera and saves it to the file 'image.raw'
@@ -62,8 +61,14 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 
-	//some cameras require time to initialize
-	sleep(3);
+	//some cameras require time to initialize, so wait for the stream to settle
+	try {
+		if (!camera->waitUntilReady())
+			std::cout << "Camera did not settle, continuing anyway" << std::endl;
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
 
 	std::uint8_t *buffer;
 	
@@ -88,7 +93,7 @@ int main(int argc, char* argv[]) {
 	fclose(file);
 	
 	//free buffer to prevent memory leak (in a real application)
-	delete buffer;
+	delete [] buffer;
 	
 	return 0;
 }
@@ -61,10 +61,10 @@ int main(int argc, char* argv[]) {
 		
 		std::cout << "Formats:" << std::endl;
 		
-		std::vector<Vcap::FormatInfoPtr> formats;
+		Vcap::FormatList formats;
 		
 		try {
-			formats = cameras[i]->formats();
+			formats = cameras[i]->formatList();
 		} catch (Vcap::RuntimeError& e) {
 			std::cout << e.what() << std::endl;
 			return -1;
@@ -73,22 +73,22 @@ int main(int argc, char* argv[]) {
 		/*
 		 * Iterate through formats.
 		 */
-		for (unsigned int j = 0; j < formats.size(); j++) {
-			std::cout << formats[j]->codeString() << " (" << formats[j]->description() << "):" << std::endl;
+		for (const Vcap::FormatDesc& format : formats) {
+			std::cout << format.codeString << " (" << format.description << "):" << std::endl;
 			
-			std::vector<Vcap::SizePtr> sizes = formats[j]->sizes();
+			const Vcap::Size* sizes = formats.sizes(format);
 			
 			/*
 			 * Iterate through frame sizes.
 			 */
-			for (unsigned int k = 0; k < sizes.size(); k++) {
+			for (unsigned int k = 0; k < format.numSizes; k++) {
 				
-				std::cout << "\t" << std::to_string(sizes[k]->width()) << "x" << std::to_string(sizes[k]->height());
+				std::cout << "\t" << std::to_string(sizes[k].width()) << "x" << std::to_string(sizes[k].height());
 				
 				std::vector<std::uint16_t> frameRates;
 				
 				try {
-					frameRates = cameras[i]->frameRates(Vcap::Format(formats[j]->code(), *sizes[k]));
+					frameRates = cameras[i]->frameRates(Vcap::Format(format.code, sizes[k]));
 				} catch (Vcap::RuntimeError& e) {
 					std::cout << e.what() << std::endl;
 					return -1;
@@ -116,10 +116,10 @@ int main(int argc, char* argv[]) {
 		
 		std::cout << "Controls:" << std::endl;
 		
-		std::vector<Vcap::ControlInfoPtr> controls;
+		Vcap::ControlList controls;
 		
 		try {
-			controls = cameras[i]->controls();
+			controls = cameras[i]->controlList();
 		} catch (Vcap::RuntimeError& e) {
 			std::cout << e.what() << std::endl;
 			return -1;
@@ -128,22 +128,22 @@ int main(int argc, char* argv[]) {
 		/*
 		 * Iterate through controls.
 		 */
-		for (unsigned int j = 0; j < controls.size(); j++) {
-			std::cout << controls[j]->name();
-			std::cout << " (min: " << std::to_string(controls[j]->min());
-			std::cout << ", max: " << std::to_string(controls[j]->max());
-			std::cout << ", step: " << std::to_string(controls[j]->step());
-			std::cout << ", default: " << std::to_string(controls[j]->defaultValue()) << ")";
+		for (const Vcap::ControlDesc& control : controls) {
+			std::cout << control.name;
+			std::cout << " (min: " << std::to_string(control.min);
+			std::cout << ", max: " << std::to_string(control.max);
+			std::cout << ", step: " << std::to_string(control.step);
+			std::cout << ", default: " << std::to_string(control.defaultValue) << ")";
 			
-			if (controls[j]->type() == Vcap::CTRL_TYPE_MENU) {
-				std::vector<Vcap::MenuItemPtr> menu = controls[j]->menu();
+			if (control.type == Vcap::CTRL_TYPE_MENU) {
+				const Vcap::MenuItemDesc* menu = controls.menu(control);
 				
 				std::cout << " (Menu: ";
 				
-				for (unsigned int k = 0; k < menu.size(); k++) {
-					std::cout << menu[k]->value() << ":" << menu[k]->name();
+				for (unsigned int k = 0; k < control.numMenuItems; k++) {
+					std::cout << menu[k].value << ":" << menu[k].name;
 					
-					if (k < menu.size() - 1)
+					if (k < control.numMenuItems - 1)
 						std::cout << ", ";
 				}
 				
@@ -25,7 +25,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -91,8 +90,14 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 
-	//some cameras require time to initialize
-	usleep(3000000);
+	//some cameras require time to initialize, so wait for the stream to settle
+	try {
+		if (!camera->waitUntilReady())
+			std::cout << "Camera did not settle, continuing anyway" << std::endl;
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
 
 	uint8_t* rgbBuffer;
 
@@ -141,7 +146,7 @@ int main(int argc, char* argv[]) {
     }
         
     free(pgmBuffer.data);
-	delete rgbBuffer;
+	delete [] rgbBuffer;
 	
 	return 0;
 }
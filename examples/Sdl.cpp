@@ -20,8 +20,6 @@
 
 #include <Vcap/Vcap.hpp>
 
-#include <unistd.h>
-
 #include <iostream>
 #include <string>
 #include <tuple>
@@ -64,6 +62,9 @@ int main(int argc, char* argv[]) {
 	
 	try {
 		camera->open();
+		
+		//library-managed buffers, so grabbing into the pool below does not allocate per frame
+		camera->setIoMode(Vcap::IO_MMAP);
 	} catch (Vcap::RuntimeError& e) {
 		std::cout << e.what() << std::endl;
 		return -1;
@@ -86,10 +87,26 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 	
-	//some cameras require time to initialize
-	sleep(3);
+	//some cameras require time to initialize, so wait for the stream to settle
+	try {
+		if (!camera->waitUntilReady())
+			std::cout << "Camera did not settle, continuing anyway" << std::endl;
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
 	
-	std::uint8_t* rgbBuffer;
+	//preallocate decode buffers so the capture loop does not allocate
+	Vcap::FramePool* pool;
+	
+	try {
+		pool = new Vcap::FramePool(2, format);
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+	
+	Vcap::Frame frame;
 	
 	//setup SDL
 	SdlContext sdl_ctx;
@@ -105,18 +122,20 @@ int main(int argc, char* argv[]) {
 		
 		//grab a frame and decode it
 		try {
-			camera->grab(&rgbBuffer, true);
+			frame = camera->grab(*pool, true);
 		} catch (Vcap::RuntimeError& e) {
 			std::cout << e.what() << std::endl;
 			return -1;
 		}
 		
-		sdlDisplay(&sdl_ctx, rgbBuffer);
+		sdlDisplay(&sdl_ctx, frame.data());
 		
-		//free buffer to prevent memory leak (in a real application)
-		delete [] rgbBuffer;
+		//return the buffer to the pool
+		frame.release();
 	}
 	
+	delete pool;
+	
 	sdlCleanup(&sdl_ctx);
 	
 	return 0;
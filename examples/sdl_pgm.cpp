@@ -1,15 +1,12 @@
 #include <Vcap/Vcap.hpp>
-#include <unistd.h>
 #include <stdint.h>
 #include <sys/stat.h>
 
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <string>
 #include <tuple>
 #include <vector>
-#include <iomanip>
 #include <chrono>
 
 #include <SDL.h>
@@ -21,30 +18,35 @@ typedef struct {
 	SDL_Surface *image;
 } SdlContext;
 
-typedef struct {
-	char*  data;
-	size_t size;
-} PGMBuffer;
-
 class FrameLogger {
 public:
     FrameLogger() 
-     : is_started(false)
+     : is_started(false), log(NULL), anchors(NULL)
     {}
 public:
-    bool          is_started;
-    std::string   directory;
-    std::ofstream timestamp_file;
-    int           imgcounter;
+    bool                   is_started;
+    std::string            directory;
+    Vcap::AsyncWriter*     log;
+    Vcap::TriggerRecorder* anchors;
+    Vcap::Format         format;
+    std::vector<uint8_t> grey;
 };
 
+/*
+ * Frames kept around each anchor
+ */
+static const double ANCHOR_PRE_SECONDS = 5.0;
+static const double ANCHOR_POST_SECONDS = 5.0;
+
 unsigned long ms_since_epoch();
+uint64_t us_monotonic();
 void anchor_position();
 void start_stop();
+std::string make_log_directory();
 int  sdlInit(SdlContext* ctx, int width, int height);
 int  sdlDisplay(SdlContext* ctx, uint8_t* image);
 void sdlCleanup(SdlContext* ctx);
-void rgb24ToPGM(uint8_t *input, PGMBuffer *buffer, int width, int height);
+void rgb24ToGrey(uint8_t *input, uint8_t *output, int width, int height);
 
 
 static FrameLogger frame_logger;
@@ -73,6 +75,9 @@ int main(int argc, char* argv[]) {
 	
 	try {
 		camera->open();
+		
+		//library-managed buffers, so grabbing into the pool below does not allocate per frame
+		camera->setIoMode(Vcap::IO_MMAP);
 	} catch (Vcap::RuntimeError& e) {
 		std::cout << e.what() << std::endl;
 		return -1;
@@ -95,8 +100,14 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 	
-	//some cameras require time to initialize
-	sleep(1);
+	//some cameras require time to initialize, so wait for the stream to settle
+	try {
+		if (!camera->waitUntilReady())
+			std::cout << "Camera did not settle, continuing anyway" << std::endl;
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
 	
 	//setup SDL
 	SdlContext sdl_ctx;
@@ -105,9 +116,35 @@ int main(int argc, char* argv[]) {
 	
 	SDL_Event event;
 
+	//preallocate decode buffers so the capture loop does not allocate
+	Vcap::FramePool* pool;
+	
+	try {
+		pool = new Vcap::FramePool(2, format);
+	} catch (Vcap::RuntimeError& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+	
+	Vcap::Frame frame;
 	uint8_t* rgbBuffer;
-    PGMBuffer pgmBuffer;
     bool event_enabled = true;
+
+    //frames are logged as greyscale
+    frame_logger.format = Vcap::Format(Vcap::FMT_GREY, format.size());
+    frame_logger.grey.resize(format.size().width() * format.size().height());
+
+    //the last few seconds are kept in memory so an anchor can save what led up to it
+    try {
+        uint16_t frameRate = camera->frameRate();
+        std::string directory = make_log_directory();
+
+        frame_logger.anchors = new Vcap::TriggerRecorder(directory + "/anchors", frame_logger.format,
+                frameRate ? frameRate : 30, ANCHOR_PRE_SECONDS, ANCHOR_POST_SECONDS);
+    } catch (Vcap::RuntimeError& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
 	
 	while (SDL_PollEvent(&event) >= 0) {
 		if (event.type == SDL_QUIT) {
@@ -136,28 +173,41 @@ int main(int argc, char* argv[]) {
 		
 		//grab a frame and decode it
 		try {
-			camera->grab(&rgbBuffer, true);
+			frame = camera->grab(*pool, true);
 		} catch (Vcap::RuntimeError& e) {
 			std::cout << e.what() << std::endl;
 			return -1;
 		}
 		
+		rgbBuffer = frame.data();
 		sdlDisplay(&sdl_ctx, rgbBuffer);
 
+        rgb24ToGrey(rgbBuffer, frame_logger.grey.data(), format.size().width(), format.size().height());
+
+        try {
+            frame_logger.anchors->write(frame_logger.grey.data(), frame_logger.grey.size(), frame.timestamp(),
+                    frame.sequence());
+        } catch (Vcap::RuntimeError& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+
         if(frame_logger.is_started) {
-            std::stringstream ss;
-            ss << "frame_" << std::setfill('0') << std::setw(8) << frame_logger.imgcounter++ << ".pgm";
-            std::string imgfname = ss.str();
-            frame_logger.timestamp_file << ms_since_epoch() << " F " << "\t" << imgfname << std::endl;
-            rgb24ToPGM(rgbBuffer, &pgmBuffer, format.size().width(), format.size().height());
-            std::ofstream imgf(frame_logger.directory + "/" + imgfname);
-            imgf.write(pgmBuffer.data, pgmBuffer.size);
+            //queued for a background writer; dropped rather than stalling capture if the disk falls behind
+            try {
+                frame_logger.log->write(frame_logger.grey.data(), frame_logger.grey.size(), frame.timestamp(),
+                        frame.sequence());
+            } catch (Vcap::RuntimeError& e) {
+                std::cout << e.what() << std::endl;
+                return -1;
+            }
         }
 	}
 	
-    free(pgmBuffer.data);
-    //free buffer to prevent memory leak (in a real application)
-    delete [] rgbBuffer;
+    delete frame_logger.log;
+    delete frame_logger.anchors;
+    frame.release();
+    delete pool;
 	sdlCleanup(&sdl_ctx);
 	
 	return 0;
@@ -169,12 +219,33 @@ unsigned long ms_since_epoch()
                                 (std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+/*
+ * Same clock as the frame timestamps
+ */
+uint64_t us_monotonic()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds> 
+                                (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Saves the frames around the anchor, and marks it in the full log if one is running
+ */
 void anchor_position()
 {
-    if(frame_logger.is_started) {
-        frame_logger.timestamp_file << ms_since_epoch() << " A " << std::endl;
-        std::cout<<"Anchoring..."<<std::endl;
+    uint64_t now = us_monotonic();
+
+    try {
+        frame_logger.anchors->trigger(now);
+
+        if(frame_logger.is_started)
+            frame_logger.log->mark(now);
+    } catch (Vcap::RuntimeError& e) {
+        std::cout << e.what() << std::endl;
+        return;
     }
+
+    std::cout<<"Anchoring..."<<std::endl;
 }
 
 void start_stop()
@@ -182,25 +253,50 @@ void start_stop()
     if (frame_logger.is_started) {
         frame_logger.is_started = false;
         std::cout<<"Stopping..."<<std::endl;
+
+        try {
+            frame_logger.log->close();
+        } catch (Vcap::RuntimeError& e) {
+            std::cout << e.what() << std::endl;
+        }
+
+        std::cout<<"dropped "<<frame_logger.log->stats().dropped<<" frames"<<std::endl;
+        delete frame_logger.log;
+        frame_logger.log = NULL;
     } else {
-        frame_logger.imgcounter = 0;
-        std::stringstream ss;
-        struct stat st = {0};
-        if (stat("capturelogs", &st) == -1) {
-            mkdir("capturelogs", 0700);
+        frame_logger.directory = make_log_directory();
+
+        //frames and anchors go to frames_NNNNNN.vlog segments, which Vcap::Replay reads back
+        std::cout<<"opening: "<<frame_logger.directory << "/frames"<<std::endl;
+
+        try {
+            frame_logger.log = new Vcap::AsyncWriter(frame_logger.directory + "/frames", frame_logger.format);
+        } catch (Vcap::RuntimeError& e) {
+            std::cout << e.what() << std::endl;
+            return;
         }
-        ss << "capturelogs" << "/" << (int)(ms_since_epoch()/1000);
-        frame_logger.directory = ss.str();
-        mkdir(frame_logger.directory.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
 
-        std::cout<<"opening: "<<frame_logger.directory << "/timestamps.txt"<<std::endl;
-        frame_logger.timestamp_file.close();
-        frame_logger.timestamp_file.open(frame_logger.directory + "/timestamps.txt");
         frame_logger.is_started = true;
         std::cout<<"Starting..."<<std::endl;
     }
 }
 
+/*
+ * Creates capturelogs/<seconds since the epoch>
+ */
+std::string make_log_directory()
+{
+    std::stringstream ss;
+    struct stat st = {0};
+    if (stat("capturelogs", &st) == -1) {
+        mkdir("capturelogs", 0700);
+    }
+    ss << "capturelogs" << "/" << (int)(ms_since_epoch()/1000);
+    mkdir(ss.str().c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+    return ss.str();
+}
+
 /*
  * Initializes the display contexgt
  */
@@ -261,20 +357,15 @@ int sdlDisplay(SdlContext* ctx, uint8_t* image) {
 	return 0;
 }
 
-void rgb24ToPGM(uint8_t *input, PGMBuffer *buffer, int width, int height) {
-
-	int size = width * height + 256;
-	buffer->data = (char*)malloc(size);
-	
-    int offset = sprintf((char*)buffer->data, "P5\n%d %d\n255\n", width, height);
+/*
+ * Converts RGB24 to 8-bit luma (BT.709)
+ */
+void rgb24ToGrey(uint8_t *input, uint8_t *output, int width, int height) {
     for(int i = 0; i < height; ++i) {
         for(int j = 0; j < width; j++) {
             uint8_t* in = input + i*width*3 + j * 3;
-            //float val = 0.3*in[0] + 0.59*in[1] + 0.11*in[2];
             float val = 0.2126*in[0] + 0.7152*in[1] + 0.0722*in[2];
-            //float val = (1.0*in[0] + 1.0*in[1] + 1.0*in[2])/3.0;
-            buffer->data[offset++] = (uint8_t)val;
+            *output++ = (uint8_t)val;
         }
     }
-    buffer->size = offset;
 }
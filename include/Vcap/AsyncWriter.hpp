@@ -0,0 +1,204 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_ASYNC_WRITER_HPP
+#define _VCAP_ASYNC_WRITER_HPP
+
+/**
+ * \file
+ * Frame logging off the capture thread, with large aligned writes through io_uring or a writer thread.
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/FrameLog.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Vcap {
+	class AsyncWriter;
+	struct AsyncWriterStats;
+	
+	/**
+	 * \brief What AsyncWriter::write() does when every buffer is waiting for the disk.
+	 */
+	typedef enum {
+		OVERFLOW_DROP,		// the frame is dropped and counted, so capture never waits
+		OVERFLOW_BLOCK		// the caller waits for a buffer to be written
+	} OverflowPolicy;
+}
+
+/**
+ * \brief Counters of an AsyncWriter.
+ */
+struct Vcap::AsyncWriterStats {
+	std::uint64_t frames;		///< Frames accepted.
+	std::uint64_t dropped;		///< Frames dropped because the disk fell behind.
+	std::uint64_t stalls;		///< Times write() waited for a buffer (OVERFLOW_BLOCK).
+	std::uint64_t written;		///< Bytes written to disk.
+	std::size_t queued;		///< Buffers waiting to be written.
+	std::size_t maxQueued;		///< Most buffers ever waiting to be written.
+};
+
+/**
+ * \brief Writes frames to the same segment files as FrameLog, without blocking the capture thread on the disk.
+ *
+ * write() copies each frame into a large staging buffer. Full buffers are written by a background thread, at
+ * block-aligned offsets with O_DIRECT where the file system allows it, so the page cache does not fill up with frames
+ * nobody will read. With liburing, several buffers are in flight at once through io_uring; otherwise they are written
+ * one at a time with pwrite(). When every buffer is waiting for the disk, frames are dropped or the caller waits,
+ * depending on the overflow policy.
+ *
+ * The producer side (write(), mark(), flush(), close()) must be used from one thread at a time. Use one writer per
+ * stream.
+ */
+class Vcap::AsyncWriter {
+	public:
+		static const std::size_t DEFAULT_BUFFER_SIZE = 16 * 1024 * 1024;
+		static const std::size_t DEFAULT_BUFFER_COUNT = 8;
+
+		/**
+		 * \brief Allocates the staging buffers and starts the writer. Buffers are enlarged as needed to hold a frame of
+		 * the given format.
+		 */
+		AsyncWriter(const std::string& prefix, const Format& format,
+				std::size_t segmentSize = FrameLog::DEFAULT_SEGMENT_SIZE, std::uint16_t frameRate = 0,
+				OverflowPolicy policy = OVERFLOW_DROP, std::size_t bufferSize = DEFAULT_BUFFER_SIZE,
+				std::size_t bufferCount = DEFAULT_BUFFER_COUNT) throw (RuntimeError);
+		~AsyncWriter();
+
+		/**
+		 * \brief Queues a raw frame with its capture timestamp and sequence number. Returns false if it was dropped.
+		 * Throws if an earlier write to disk failed.
+		 */
+		bool write(const Frame& frame) throw (RuntimeError);
+
+		/**
+		 * \brief Queues a raw frame from a buffer. The timestamp is in microseconds (CLOCK_MONOTONIC).
+		 */
+		bool write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp, std::uint32_t sequence)
+				throw (RuntimeError);
+
+		/**
+		 * \brief Queues an application-defined marker (e.g. a user event) at the given timestamp.
+		 */
+		bool mark(std::uint64_t timestamp, std::uint32_t id = 0) throw (RuntimeError);
+
+		/**
+		 * \brief Waits until everything queued so far is on disk.
+		 */
+		void flush() throw (RuntimeError);
+
+		/**
+		 * \brief Writes what is queued, completes the last segment and stops the writer. Further writes fail.
+		 */
+		void close() throw (RuntimeError);
+
+		/**
+		 * \brief Returns the path of the segment with the given number.
+		 */
+		std::string segmentPath(std::size_t segment) const;
+
+		/**
+		 * \brief True if the writer uses io_uring (otherwise a thread with pwrite()).
+		 */
+		bool uring() const;
+
+		AsyncWriterStats stats();
+
+	private:
+		struct Buffer;
+
+		AsyncWriter(const AsyncWriter&);
+		AsyncWriter& operator = (const AsyncWriter&);
+
+		bool append(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence, const Plane* parts,
+				unsigned int numParts) throw (RuntimeError);
+
+		Buffer* acquire();
+		void seal();
+		void check() throw (RuntimeError);
+
+		void run();
+		void runThread();
+		bool runUring();
+
+		bool writeBuffer(Buffer* buffer, std::size_t done);
+		void completed(Buffer* buffer);
+		void openSegment(std::size_t segment);
+		void closeSegment();
+		void fail(int error);
+
+		std::string _prefix;
+		std::size_t _segmentSize;
+		OverflowPolicy _policy;
+
+		std::uint32_t _code;
+		std::uint32_t _width;
+		std::uint32_t _height;
+		std::uint16_t _frameRate;
+
+		std::uint8_t* _memory;
+		std::size_t _memorySize;
+		std::size_t _bufferSize;
+		std::vector<Buffer> _buffers;
+
+		//producer
+		Buffer* _current;
+		std::size_t _segment;
+		std::uint64_t _segmentOffset;
+		bool _closed;
+
+		//shared with the writer thread
+		std::mutex _mutex;
+		std::condition_variable _queueReady;
+		std::condition_variable _bufferFree;
+		std::deque<Buffer*> _queue;
+		std::vector<Buffer*> _free;
+		std::size_t _inFlight;
+		bool _stopping;
+
+		std::atomic<int> _error;
+		std::atomic<bool> _uring;
+
+		std::atomic<std::uint64_t> _frames;
+		std::atomic<std::uint64_t> _dropped;
+		std::atomic<std::uint64_t> _stalls;
+		std::atomic<std::uint64_t> _written;
+		std::size_t _maxQueued;
+
+		//writer thread
+		int _fd;
+		bool _direct;
+		std::size_t _openSegment;
+		std::uint64_t _dataEnd;
+		std::vector<FrameIndexEntry> _index;
+
+		std::thread _thread;
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_CAPABILITY_CACHE_HPP
+#define _VCAP_CAPABILITY_CACHE_HPP
+
+/**
+ * \file
+ * Device capability trees and a persistent on-disk cache for them.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Everything a device supports: formats, frame sizes, frame rates per size, and controls.
+ */
+class Vcap::Capabilities {
+	friend class Camera;
+	friend class CapabilityCache;
+
+	public:
+		/**
+		 * \brief Returns the identity of the device the capabilities were probed from.
+		 */
+		const DeviceInfo& deviceInfo() const;
+
+		const FormatList& formats() const;
+		const ControlList& controls() const;
+
+		/**
+		 * \brief Returns the number of frame rates for a frame size, where sizeIndex is
+		 * FormatDesc::firstSize plus the size's position within the format.
+		 */
+		std::size_t numFrameRates(std::size_t sizeIndex) const;
+
+		/**
+		 * \brief Returns the first of the frame size's numFrameRates() frame rates.
+		 */
+		const std::uint16_t* frameRates(std::size_t sizeIndex) const;
+
+	private:
+		DeviceInfo _deviceInfo;
+
+		FormatList _formats;
+		ControlList _controls;
+
+		std::vector<std::uint16_t> _frameRates;
+		std::vector<std::size_t> _frameRateOffsets;
+};
+
+/**
+ * \brief Stores device capabilities in compact binary files so they can be reused across process restarts. Entries
+ * are keyed by driver, card, bus info, driver version and firmware revision, and are checksummed.
+ */
+class Vcap::CapabilityCache {
+	public:
+		/**
+		 * \brief Creates a cache that keeps one file per device in the given directory. The directory is created on
+		 * the first store if it does not exist; its parent must.
+		 */
+		CapabilityCache(const std::string& directory);
+
+		/**
+		 * \brief Returns the cached capabilities for an open camera, probing and storing them on a miss. Storing is
+		 * best-effort: if the entry cannot be written, the probed capabilities are still returned.
+		 */
+		Capabilities capabilities(Camera& camera) throw (RuntimeError);
+
+		/**
+		 * \brief Loads the cached capabilities for a device. Returns false if there is no valid entry.
+		 */
+		bool load(const DeviceInfo& info, Capabilities& capabilities);
+
+		/**
+		 * \brief Writes capabilities to the cache, atomically replacing any previous entry.
+		 */
+		void store(const Capabilities& capabilities) throw (RuntimeError);
+
+		/**
+		 * \brief Removes the entry for a device.
+		 */
+		void invalidate(const DeviceInfo& info);
+
+	private:
+		std::string path(const DeviceInfo& info) const;
+
+		std::string _directory;
+};
+
+#endif
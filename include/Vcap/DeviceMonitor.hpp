@@ -0,0 +1,93 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_DEVICE_MONITOR_HPP
+#define _VCAP_DEVICE_MONITOR_HPP
+
+/**
+ * \file
+ * Hotplug notifications for video device nodes.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <string>
+#include <vector>
+
+namespace Vcap {
+	class DeviceMonitor;
+
+	struct DeviceEvent;
+
+	/**
+	 * \brief The kind of change reported by a DeviceMonitor.
+	 */
+	typedef enum {
+		DEVICE_ADDED,
+		DEVICE_REMOVED,
+		DEVICE_OVERFLOW //!< Events were lost; re-enumerate the directory. The device name is empty.
+	} DeviceEventType;
+}
+
+/**
+ * \brief A video device node appearing or disappearing.
+ */
+struct Vcap::DeviceEvent {
+	DeviceEventType type;
+	std::string device;
+};
+
+/**
+ * \brief Watches a device directory for video nodes being added or removed (e.g. USB cameras being plugged in or
+ * unplugged), so applications can react without polling.
+ */
+class Vcap::DeviceMonitor {
+	public:
+		/**
+		 * \brief Starts watching the given directory.
+		 */
+		DeviceMonitor(const std::string& directory = "/dev") throw (RuntimeError);
+		virtual ~DeviceMonitor();
+
+		/**
+		 * \brief Returns a descriptor that becomes readable when events are pending, for use with poll/select/epoll.
+		 */
+		int fd() const;
+
+		/**
+		 * \brief Waits up to timeout milliseconds (-1 waits forever) for events. Returns true if events are pending.
+		 */
+		bool wait(int timeout) throw (RuntimeError);
+
+		/**
+		 * \brief Returns the pending events without blocking; empty if there are none. If the kernel queue overflowed a
+		 * DEVICE_OVERFLOW event is reported in place of the lost ones.
+		 */
+		std::vector<DeviceEvent> events() throw (RuntimeError);
+
+	private:
+		DeviceMonitor(const DeviceMonitor&);
+		DeviceMonitor& operator = (const DeviceMonitor&);
+
+		std::string _directory;
+		int _fd;
+};
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_EXPOSURE_HPP
+#define _VCAP_EXPOSURE_HPP
+
+/**
+ * \file
+ * Software auto-exposure and auto-gain for cameras whose own are poor or missing.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstdint>
+#include <mutex>
+
+namespace Vcap {
+	class ExposureController;
+
+	struct LumaStats;
+
+	/**
+	 * \brief Number of metering zones along each side of the image.
+	 */
+	const unsigned int EXPOSURE_ZONES = 4;
+}
+
+/**
+ * \brief Luma statistics of a frame, gathered from a regular sub-sampling of its pixels.
+ */
+struct Vcap::LumaStats {
+	std::uint32_t histogram[256];
+
+	/**
+	 * \brief Sum and number of samples per metering zone, row-major.
+	 */
+	std::uint64_t zoneSum[EXPOSURE_ZONES * EXPOSURE_ZONES];
+	std::uint32_t zoneSamples[EXPOSURE_ZONES * EXPOSURE_ZONES];
+
+	std::uint32_t samples;
+};
+
+/**
+ * \brief Drives a camera's exposure and gain controls towards a target brightness. Once attached with
+ * Camera::setExposureController(), it is fed luma statistics gathered while each frame is decoded. Multi-planar formats
+ * are metered inside the decode itself; other formats take a second, subsampled read of the raw (or decoded) frame.
+ * Control writes are rate-limited and exposure and gain are written together.
+ */
+class Vcap::ExposureController {
+	friend class Camera;
+
+	public:
+		/**
+		 * \brief Takes over the camera's exposure (and gain, if present), switching off the driver's automatic
+		 * exposure and gain. The camera must be open.
+		 */
+		ExposureController(Camera& camera) throw (RuntimeError);
+
+		/**
+		 * \brief Returns the target mean luma (0-255).
+		 */
+		std::uint8_t target();
+
+		/**
+		 * \brief Sets the target mean luma (0-255). Defaults to 118.
+		 */
+		void setTarget(std::uint8_t target);
+
+		/**
+		 * \brief Sets how far the measured brightness may stray from the target before controls are adjusted.
+		 * Defaults to 8.
+		 */
+		void setTolerance(std::uint8_t tolerance);
+
+		/**
+		 * \brief Sets the minimum time between control writes, in milliseconds. Defaults to 100.
+		 */
+		void setInterval(unsigned int interval);
+
+		/**
+		 * \brief Sets the metering weight of a zone; zones weighted 0 are ignored. All zones default to 1.
+		 */
+		void setZoneWeight(unsigned int row, unsigned int column, float weight);
+
+		/**
+		 * \brief Returns the weighted mean luma of the most recent frame.
+		 */
+		float brightness();
+
+		/**
+		 * \brief Adjusts exposure and gain from a frame's statistics. Called by the camera for every decoded frame,
+		 * but may also be fed statistics gathered by the application.
+		 */
+		void update(const LumaStats& stats) throw (RuntimeError);
+
+	private:
+		ExposureController(const ExposureController&);
+		ExposureController& operator = (const ExposureController&);
+
+		LumaStats* beginFrame();
+
+		Camera& _camera;
+
+		std::mutex _mutex;
+
+		std::uint8_t _target;
+		std::uint8_t _tolerance;
+		unsigned int _interval;
+		float _weights[EXPOSURE_ZONES * EXPOSURE_ZONES];
+
+		ControlId _exposureId;
+		std::int32_t _exposure;
+		std::int32_t _exposureMin;
+		std::int32_t _exposureMax;
+
+		bool _hasGain;
+		std::int32_t _gain;
+		std::int32_t _gainMin;
+		std::int32_t _gainMax;
+
+		float _brightness;
+		std::uint64_t _lastWrite;
+
+		LumaStats _stats;
+};
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_FRAME_LOG_HPP
+#define _VCAP_FRAME_LOG_HPP
+
+/**
+ * \file
+ * Memory-mapped, append-only logging of raw frames into size-rotated segment files, and random access to them.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Vcap {
+	struct FrameIndexEntry;
+	struct FrameView;
+	class FrameLog;
+	class FrameLogReader;
+}
+
+/**
+ * \brief An entry of the index at the end of each frame log segment.
+ */
+struct Vcap::FrameIndexEntry {
+	std::uint64_t timestamp;	///< Capture timestamp in microseconds (CLOCK_MONOTONIC).
+	std::uint64_t offset;		///< Offset of the frame's record in the segment.
+	std::uint32_t sequence;		///< Driver sequence number.
+	std::uint32_t size;		///< Size of the frame in bytes.
+};
+
+/**
+ * \brief A frame in a memory-mapped frame log; valid as long as the FrameLogReader.
+ */
+struct Vcap::FrameView {
+	const std::uint8_t* data;	///< Raw frame (planes back to back).
+	std::size_t size;		///< Size of the frame in bytes.
+	std::uint64_t timestamp;	///< Capture timestamp in microseconds (CLOCK_MONOTONIC).
+	std::uint32_t sequence;		///< Driver sequence number.
+};
+
+/**
+ * \brief Appends raw frames to preallocated, memory-mapped segment files named <prefix>_000000.vlog,
+ * <prefix>_000001.vlog, etc. A segment is closed and a new one started whenever the next record would not fit.
+ *
+ * Segments use the Recorder file layout, so Replay plays them back. A closed segment is truncated to its contents and
+ * ends with an index of its frames (FrameIndexEntry, sorted by timestamp). A segment left open by a crashed process
+ * has no index; its records are followed by zeroes.
+ *
+ * Writing a frame is a copy into the mapping, with no system call, so it is cheap enough for the capture thread. A
+ * frame log is not thread-safe.
+ */
+class Vcap::FrameLog {
+	public:
+		static const std::size_t DEFAULT_SEGMENT_SIZE = (std::size_t)1 << 30;
+
+		/**
+		 * \brief Creates the first segment. Existing segments with the same prefix are replaced as they are reached.
+		 */
+		FrameLog(const std::string& prefix, const Format& format, std::size_t segmentSize = DEFAULT_SEGMENT_SIZE,
+				std::uint16_t frameRate = 0) throw (RuntimeError);
+		~FrameLog();
+
+		/**
+		 * \brief Logs a raw frame with its capture timestamp and sequence number.
+		 */
+		void write(const Frame& frame) throw (RuntimeError);
+
+		/**
+		 * \brief Logs a raw frame from a buffer. The timestamp is in microseconds (CLOCK_MONOTONIC).
+		 */
+		void write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp, std::uint32_t sequence)
+				throw (RuntimeError);
+
+		/**
+		 * \brief Logs an application-defined marker (e.g. a user event) at the given timestamp.
+		 */
+		void mark(std::uint64_t timestamp, std::uint32_t id = 0) throw (RuntimeError);
+
+		/**
+		 * \brief Completes the current segment. Further writes fail.
+		 */
+		void close() throw (RuntimeError);
+
+		/**
+		 * \brief Returns the path of the segment with the given number.
+		 */
+		std::string segmentPath(std::size_t segment) const;
+
+		/**
+		 * \brief Returns the number of segments created so far.
+		 */
+		std::size_t segments() const;
+
+		std::uint64_t frames() const;
+		std::uint64_t bytes() const;
+
+	private:
+		FrameLog(const FrameLog&);
+		FrameLog& operator = (const FrameLog&);
+
+		void openSegment() throw (RuntimeError);
+		void closeSegment() throw (RuntimeError);
+
+		std::uint8_t* reserve(std::size_t recordSize) throw (RuntimeError);
+		void append(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence, const Plane* parts,
+				unsigned int numParts) throw (RuntimeError);
+
+		std::string _prefix;
+		std::size_t _segmentSize;
+
+		std::uint32_t _code;
+		std::uint32_t _width;
+		std::uint32_t _height;
+		std::uint16_t _frameRate;
+
+		int _fd;
+		std::uint8_t* _map;
+		std::size_t _offset;
+		std::size_t _flushed;
+
+		std::size_t _segments;
+		std::vector<FrameIndexEntry> _index;
+
+		std::uint64_t _frames;
+		std::uint64_t _bytes;
+};
+
+/**
+ * \brief Random access to the frames of a frame log (from FrameLog or AsyncWriter), a single segment, or a recording.
+ *
+ * Segments are memory-mapped and their indexes used in place, so opening a long log reads little more than the
+ * segment headers, and seek() is a binary search. Segments without an index (e.g. from a process that crashed, or a
+ * Recorder file) are indexed by scanning their records. Frames are returned as views into the mapping, without
+ * copying.
+ *
+ * Mappings are set up for random access (scrubbing); next() reads ahead for sequential playback.
+ */
+class Vcap::FrameLogReader {
+	public:
+		/**
+		 * \brief Opens a single file, or if there is no file at the path, the segments <path>_000000.vlog,
+		 * <path>_000001.vlog, etc. of a frame log.
+		 */
+		FrameLogReader(const std::string& path) throw (RuntimeError);
+		~FrameLogReader();
+
+		/**
+		 * \brief Returns the format from the first segment's header.
+		 */
+		Format format() const;
+		std::uint16_t frameRate() const;
+
+		/**
+		 * \brief Returns the number of frames.
+		 */
+		std::size_t size() const;
+		std::size_t segments() const;
+
+		/**
+		 * \brief Returns the view of the frame with the given number (in timestamp order).
+		 */
+		FrameView frame(std::size_t index) const throw (RuntimeError);
+
+		/**
+		 * \brief Returns the number of the first frame captured at or after the timestamp, or size() if there is none.
+		 */
+		std::size_t seek(std::uint64_t timestamp) const;
+
+		/**
+		 * \brief Converts a capture timestamp to microseconds since the epoch, using the clocks recorded when the first
+		 * segment was created.
+		 */
+		std::uint64_t wallClock(std::uint64_t timestamp) const;
+
+		/**
+		 * \brief Asks the kernel to start reading the given frames.
+		 */
+		void prefetch(std::size_t index, std::size_t count) const;
+
+		/**
+		 * \brief Sets the frame returned by the next call to next().
+		 */
+		void setPosition(std::size_t index);
+		std::size_t position() const;
+
+		/**
+		 * \brief Returns the frame at the position and advances it, reading ahead. Returns false at the end.
+		 */
+		bool next(FrameView& frame) throw (RuntimeError);
+
+	private:
+		struct Segment;
+
+		FrameLogReader(const FrameLogReader&);
+		FrameLogReader& operator = (const FrameLogReader&);
+
+		void openSegment(const std::string& path) throw (RuntimeError);
+		void buildIndex(Segment& segment) throw (RuntimeError);
+
+		std::size_t segmentOf(std::size_t index) const;
+		const FrameIndexEntry& entry(std::size_t index) const;
+
+		std::vector<Segment> _segments;
+		std::vector<std::size_t> _starts;
+		std::size_t _size;
+
+		std::uint32_t _code;
+		std::uint32_t _width;
+		std::uint32_t _height;
+		std::uint16_t _frameRate;
+
+		std::uint64_t _created;
+		std::uint64_t _createdMonotonic;
+
+		std::size_t _position;
+		std::size_t _prefetched;
+};
+
+#endif
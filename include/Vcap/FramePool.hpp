@@ -0,0 +1,239 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_FRAME_POOL_HPP
+#define _VCAP_FRAME_POOL_HPP
+
+/**
+ * \file
+ * Reference-counted frame handles and a preallocated frame buffer pool.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace Vcap {
+	class RuntimeError;
+	class Format;
+	class Frame;
+	class FrameOwner;
+	class FramePool;
+	class Replay;
+	class SlotArray;
+	class Stream;
+
+	struct Plane;
+	struct FrameSlot;
+
+	/**
+	 * \brief Maximum number of planes in a multi-planar frame.
+	 */
+	const unsigned int MAX_PLANES = 8;
+}
+
+/**
+ * \brief Describes one plane of a frame.
+ */
+struct Vcap::Plane {
+	std::uint8_t* data;
+	std::size_t size;
+	std::size_t stride;
+};
+
+/**
+ * \brief Buffer shared by every Frame handle that refers to it.
+ */
+struct Vcap::FrameSlot {
+	FrameOwner* owner;
+	std::atomic<unsigned int> refs;
+
+	std::uint32_t index;
+	int fd;
+	std::uint8_t* data;
+	std::size_t capacity;
+	std::size_t size;
+	std::size_t stride;
+
+	unsigned int numPlanes;
+	Plane planes[MAX_PLANES];
+	std::size_t planeCapacity[MAX_PLANES];
+
+	std::uint32_t sequence;
+	std::uint64_t timestamp;
+};
+
+/**
+ * \brief Receives frame buffers back once their last Frame handle is released.
+ */
+class Vcap::FrameOwner {
+	friend class Frame;
+	friend class SlotArray;
+
+	public:
+		virtual ~FrameOwner() { }
+
+	protected:
+		virtual void recycle(FrameSlot* slot) = 0;
+};
+
+/**
+ * \brief Reference-counted handle to a captured frame. The underlying buffer is returned to its owner when the last
+ * handle is released or destroyed.
+ */
+class Vcap::Frame {
+	friend class Camera;
+	friend class FramePool;
+	friend class Replay;
+	friend class Stream;
+
+	public:
+		Frame();
+		Frame(const Frame& frame);
+		Frame(Frame&& frame) noexcept;
+		~Frame();
+
+		Frame& operator = (const Frame& frame);
+		Frame& operator = (Frame&& frame) noexcept;
+
+		/**
+		 * \brief Returns true if the handle refers to a buffer; false otherwise.
+		 */
+		bool valid() const;
+
+		/**
+		 * \brief Returns the frame data (the first plane for multi-planar frames).
+		 */
+		std::uint8_t* data() const;
+
+		/**
+		 * \brief Returns the number of valid bytes in the frame (in the first plane for multi-planar frames).
+		 */
+		std::size_t size() const;
+
+		/**
+		 * \brief Returns the number of planes; 1 unless the frame was captured in a multi-planar format.
+		 */
+		unsigned int numPlanes() const;
+
+		/**
+		 * \brief Returns the data, size and line stride of the given plane.
+		 */
+		Plane plane(unsigned int index) const;
+
+		/**
+		 * \brief Returns the size of the underlying buffer.
+		 */
+		std::size_t capacity() const;
+
+		/**
+		 * \brief Returns the index of the underlying buffer within its pool or stream.
+		 */
+		std::uint32_t index() const;
+
+		/**
+		 * \brief Returns the DMABUF file descriptor exported for the underlying buffer, or -1 if it was not exported.
+		 */
+		int fd() const;
+
+		/**
+		 * \brief Returns the frame sequence number.
+		 */
+		std::uint32_t sequence() const;
+
+		/**
+		 * \brief Returns the capture time in microseconds (CLOCK_MONOTONIC).
+		 */
+		std::uint64_t timestamp() const;
+
+		/**
+		 * \brief Drops this handle's reference to the underlying buffer.
+		 */
+		void release();
+
+	private:
+		Frame(FrameSlot* slot);
+
+		FrameSlot* _slot;
+};
+
+/**
+ * \brief Preallocates a fixed number of aligned frame buffers and recycles them as Frame handles are released.
+ *
+ * Frames may outlive the pool: its buffers are freed once the last of them is released.
+ */
+class Vcap::FramePool : public FrameOwner {
+	public:
+		/**
+		 * \brief Allocates count buffers of frameSize bytes, optionally backed by huge pages.
+		 */
+		FramePool(std::size_t count, std::size_t frameSize, bool hugePages = false);
+
+		/**
+		 * \brief Allocates count buffers large enough to hold a decoded (RGB24) or raw frame of the given format.
+		 */
+		FramePool(std::size_t count, const Format& format, bool hugePages = false);
+
+		virtual ~FramePool();
+
+		/**
+		 * \brief Returns a free buffer, or an invalid Frame if every buffer is in use.
+		 */
+		Frame acquire();
+
+		/**
+		 * \brief Returns the number of buffers in the pool.
+		 */
+		std::size_t count() const;
+
+		/**
+		 * \brief Returns the size of each buffer.
+		 */
+		std::size_t frameSize() const;
+
+		/**
+		 * \brief Returns the number of buffers not currently in use.
+		 */
+		std::size_t available();
+
+	protected:
+		void recycle(FrameSlot* slot);
+
+	private:
+		FramePool(const FramePool&);
+		FramePool& operator = (const FramePool&);
+
+		void allocate(std::size_t count, std::size_t frameSize, bool hugePages);
+
+		std::size_t _count;
+		std::size_t _frameSize;
+
+		std::uint8_t* _memory;
+		std::size_t _memorySize;
+
+		SlotArray* _slots;
+
+		std::mutex _mutex;
+		std::vector<FrameSlot*> _free;
+};
+
+#endif
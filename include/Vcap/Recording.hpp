@@ -0,0 +1,206 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_RECORDING_HPP
+#define _VCAP_RECORDING_HPP
+
+/**
+ * \file
+ * Recording of raw camera streams and deterministic replay.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Vcap {
+	class Recorder;
+	class Replay;
+}
+
+/**
+ * \brief Writes raw frames and their metadata (format, capture timestamps, sequence numbers and control changes) to a
+ * recording file that Replay plays back. Multi-planar frames are stored with their planes back to back.
+ */
+class Vcap::Recorder {
+	public:
+		/**
+		 * \brief Creates a recording of frames in the given format, replacing any existing file.
+		 */
+		Recorder(const std::string& path, const Format& format, std::uint16_t frameRate = 0) throw (RuntimeError);
+		~Recorder();
+
+		/**
+		 * \brief Records a raw frame with its capture timestamp and sequence number.
+		 */
+		void write(const Frame& frame) throw (RuntimeError);
+
+		/**
+		 * \brief Records a raw frame from a buffer (e.g. from Camera::grab()). The timestamp is in microseconds
+		 * (CLOCK_MONOTONIC).
+		 */
+		void write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp, std::uint32_t sequence)
+				throw (RuntimeError);
+
+		/**
+		 * \brief Records a control change, applied by Replay before the frames that follow it.
+		 */
+		void writeControl(ControlId id, std::int32_t value, std::uint64_t timestamp) throw (RuntimeError);
+
+		/**
+		 * \brief Records a format change; the frames that follow are in the new format.
+		 */
+		void writeFormat(const Format& format, std::uint16_t frameRate = 0) throw (RuntimeError);
+
+		/**
+		 * \brief Records every control change on the camera, including those made outside this process, by watching
+		 * its controls (see Camera::watchControls()). The camera must outlive the recorder.
+		 */
+		void recordControls(Camera& camera) throw (RuntimeError);
+
+		/**
+		 * \brief Flushes and closes the recording. Called by the destructor.
+		 */
+		void close() throw (RuntimeError);
+
+		/**
+		 * \brief Returns the number of frames recorded.
+		 */
+		std::uint64_t frames();
+
+		/**
+		 * \brief Returns the number of frame bytes recorded.
+		 */
+		std::uint64_t bytes();
+
+	private:
+		struct ControlSink;
+
+		Recorder(const Recorder&);
+		Recorder& operator = (const Recorder&);
+
+		bool writeRecord(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence, const Plane* parts,
+				unsigned int numParts);
+
+		std::string _path;
+		std::FILE* _file;
+
+		std::mutex _mutex;
+
+		Camera* _camera;
+		std::size_t _callback;
+		std::shared_ptr<ControlSink> _controls;
+
+		std::uint64_t _frames;
+		std::uint64_t _bytes;
+};
+
+/**
+ * \brief Plays back a recording (or a FrameLog segment) as a frame source, either at the original frame timing or as
+ * fast as possible.
+ * Frames keep their recorded timestamps and sequence numbers, so runs over the same recording are repeatable.
+ */
+class Vcap::Replay : public FrameSource {
+	public:
+		Replay(const std::string& path, bool realTime = true) throw (RuntimeError);
+		virtual ~Replay();
+
+		Format format() throw (RuntimeError);
+
+		/**
+		 * \brief Returns the frame rate the recording was made at, or 0 if it is unknown.
+		 */
+		std::uint16_t frameRate();
+
+		/**
+		 * \brief Starts playback from the beginning of the recording.
+		 */
+		void start() throw (RuntimeError);
+		void stop() throw (RuntimeError);
+		bool capturing();
+
+		/**
+		 * \brief Returns the next frame. Throws once the end of the recording has been reached, unless looping.
+		 */
+		std::size_t grab(std::uint8_t** buffer, bool decode = false, bool bgr = false) throw (RuntimeError);
+		Frame grab(FramePool& pool, bool decode = false, bool bgr = false) throw (RuntimeError);
+
+		/**
+		 * \brief Returns true once every frame has been played back.
+		 */
+		bool finished();
+
+		/**
+		 * \brief Selects playback at the recorded frame timing (the default) or as fast as possible.
+		 */
+		void setRealTime(bool realTime);
+
+		/**
+		 * \brief Restarts from the beginning when the end of the recording is reached.
+		 */
+		void setLoop(bool loop);
+
+		/**
+		 * \brief Sets a function called with each recorded control change as playback passes it.
+		 */
+		void setControlCallback(const ControlCallback& callback);
+
+	private:
+		Replay(const Replay&);
+		Replay& operator = (const Replay&);
+
+		void rewind() throw (RuntimeError);
+		bool nextFrame(std::uint32_t& size, std::uint64_t& timestamp, std::uint32_t& sequence) throw (RuntimeError);
+		void readPayload(std::uint8_t* data, std::size_t size) throw (RuntimeError);
+		void skip(std::size_t size) throw (RuntimeError);
+		void pace(std::uint64_t timestamp);
+
+		std::string _path;
+		std::FILE* _file;
+		long _dataEnd;
+
+		//bytes between the end of the current frame's payload and the next record
+		std::uint32_t _padding;
+
+		std::uint32_t _code;
+		std::uint32_t _width;
+		std::uint32_t _height;
+		std::uint16_t _frameRate;
+
+		bool _realTime;
+		bool _loop;
+		bool _capturing;
+		bool _finished;
+
+		std::uint64_t _firstTimestamp;
+		std::uint64_t _startTime;
+		bool _paced;
+
+		ControlCallback _callback;
+
+		std::vector<std::uint8_t> _scratch;
+};
+
+#endif
@@ -26,87 +26,189 @@
  * A basic smart pointer implementation.
  */
 
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 namespace Vcap {
 	template <typename T>
 	class SmartPtr;
+	
+	/**
+	 * \brief Constructs an object and its reference count in a single allocation.
+	 */
+	template <typename T, typename... Args>
+	SmartPtr<T> makeSmart(Args&&... args);
 }
 
 /**
- * \brief Basic smart pointer implementation.
+ * \brief Basic smart pointer implementation. The reference count is atomic, so copies of the same pointer may be
+ * created and destroyed concurrently from different threads; a single SmartPtr instance must not be assigned from
+ * several threads at once.
  */
 template<typename T>
 class Vcap::SmartPtr {
+	template <typename U, typename... Args>
+	friend SmartPtr<U> makeSmart(Args&&... args);
+	
 	public:
 		SmartPtr();
 		SmartPtr(T* value);
 		~SmartPtr();
 		
 		SmartPtr(const SmartPtr<T>& sp);
+		SmartPtr(SmartPtr<T>&& sp) noexcept;
 		SmartPtr<T>& operator = (const SmartPtr<T>& sp);
+		SmartPtr<T>& operator = (SmartPtr<T>&& sp) noexcept;
 	
-		T& operator * ();
-		T* operator -> ();
+		T& operator * () const;
+		T* operator -> () const;
+		
+		/**
+		 * \brief Returns the managed object (may be NULL).
+		 */
+		T* get() const;
 		
 	private:
-		unsigned int *_refs;
+		struct Block {
+			std::atomic<unsigned int> refs;
+			bool inlined;
+		};
+		
+		struct InlineBlock : Block {
+			typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+		};
+		
+		void release();
+		
+		Block* _block;
 		T* _value;
 };
 
 template <typename T>
-Vcap::SmartPtr<T>::SmartPtr() : _value(NULL) {
-	_refs = new unsigned int;
-	*_refs = 1;
+Vcap::SmartPtr<T>::SmartPtr() : _block(NULL), _value(NULL) {
 }
 
 template <typename T>
-Vcap::SmartPtr<T>::SmartPtr(T* value) : _value(value) {
-	_refs = new unsigned int;
-	*_refs = 1;
+Vcap::SmartPtr<T>::SmartPtr(T* value) : _block(NULL), _value(value) {
+	if (_value) {
+		//the object is owned from here on, even if the block cannot be allocated
+		try {
+			_block = new Block;
+		} catch (...) {
+			delete _value;
+			throw;
+		}
+		
+		_block->refs.store(1, std::memory_order_relaxed);
+		_block->inlined = false;
+	}
 }
 
 template <typename T>
 Vcap::SmartPtr<T>::~SmartPtr() {
-	if (--(*_refs) == 0) {
-		delete _refs;
-		
-		if (_value)
-			delete _value;
-	}
+	release();
+}
+
+template <typename T>
+Vcap::SmartPtr<T>::SmartPtr(const SmartPtr<T>& sp) : _block(sp._block), _value(sp._value) {
+	if (_block)
+		_block->refs.fetch_add(1, std::memory_order_relaxed);
 }
 
 template <typename T>
-Vcap::SmartPtr<T>::SmartPtr(const SmartPtr<T>& sp) : _value(sp._value) {
-	_refs = sp._refs;
-	(*_refs)++;	
+Vcap::SmartPtr<T>::SmartPtr(SmartPtr<T>&& sp) noexcept : _block(sp._block), _value(sp._value) {
+	sp._block = NULL;
+	sp._value = NULL;
 }
 
 template <typename T>
 Vcap::SmartPtr<T>& Vcap::SmartPtr<T>::operator = (const SmartPtr<T>& sp) {
-	if (this != &sp) {
-		if(--(*_refs) == 0) {
-			delete _refs;
-			
-			if (_value)
-				delete _value;
-		}
+	if (_block != sp._block) {
+		if (sp._block)
+			sp._block->refs.fetch_add(1, std::memory_order_relaxed);
+		
+		release();
+	
+		_value = sp._value;
+		_block = sp._block;
+	}
 	
+	return *this;
+}
+
+template <typename T>
+Vcap::SmartPtr<T>& Vcap::SmartPtr<T>::operator = (SmartPtr<T>&& sp) noexcept {
+	if (this != &sp) {
+		release();
+		
 		_value = sp._value;
-		_refs = sp._refs;
+		_block = sp._block;
 		
-		(*_refs)++;
+		sp._block = NULL;
+		sp._value = NULL;
 	}
 	
 	return *this;
 }
 
 template <typename T>	
-T& Vcap::SmartPtr<T>::operator * () {
+T& Vcap::SmartPtr<T>::operator * () const {
 	return *_value;
 }
 
 template <typename T>
-T* Vcap::SmartPtr<T>::operator -> () {
+T* Vcap::SmartPtr<T>::operator -> () const {
 	return _value;
 }
 
+template <typename T>
+T* Vcap::SmartPtr<T>::get() const {
+	return _value;
+}
+
+template <typename T>
+void Vcap::SmartPtr<T>::release() {
+	if (_block && _block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		if (_block->inlined) {
+			_value->~T();
+			delete static_cast<InlineBlock*>(_block);
+		} else {
+			delete _value;
+			delete _block;
+		}
+	}
+	
+	_block = NULL;
+	_value = NULL;
+}
+
+template <typename T, typename... Args>
+Vcap::SmartPtr<T> Vcap::makeSmart(Args&&... args) {
+	typedef typename SmartPtr<T>::InlineBlock InlineBlock;
+	
+	InlineBlock* block = new InlineBlock;
+	
+	T* value;
+	
+	try {
+		value = new (&block->storage) T(std::forward<Args>(args)...);
+	} catch (...) {
+		delete block;
+		throw;
+	}
+	
+	block->refs.store(1, std::memory_order_relaxed);
+	block->inlined = true;
+	
+	SmartPtr<T> sp;
+	
+	sp._block = block;
+	sp._value = value;
+	
+	return sp;
+}
+
 #endif
@@ -0,0 +1,129 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_STATS_HPP
+#define _VCAP_STATS_HPP
+
+/**
+ * \file
+ * Capture latency histograms and counters.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Vcap {
+	class LatencyHistogram;
+	class StatsRecorder;
+
+	struct CaptureStats;
+}
+
+/**
+ * \brief Log-linear (HDR-style) histogram of latencies in microseconds. Values are kept to within 1/16 of their
+ * magnitude, from 1 us to about 19 hours.
+ */
+class Vcap::LatencyHistogram {
+	friend class StatsRecorder;
+
+	public:
+		/**
+		 * \brief Number of buckets.
+		 */
+		static const unsigned int BUCKETS = 528;
+
+		LatencyHistogram();
+
+		/**
+		 * \brief Adds a latency.
+		 */
+		void record(std::uint64_t value);
+
+		/**
+		 * \brief Returns the number of recorded latencies.
+		 */
+		std::uint64_t count() const;
+
+		std::uint64_t min() const;
+		std::uint64_t max() const;
+		std::uint64_t mean() const;
+
+		/**
+		 * \brief Returns the latency below which the given percentage (0-100) of recorded latencies fall.
+		 */
+		std::uint64_t percentile(double percent) const;
+
+		/**
+		 * \brief Returns the number of latencies recorded in a bucket, for exporting the full distribution.
+		 */
+		std::uint64_t bucketCount(unsigned int bucket) const;
+
+		/**
+		 * \brief Returns the largest latency that falls into a bucket.
+		 */
+		static std::uint64_t bucketLimit(unsigned int bucket);
+
+	private:
+		static unsigned int bucketIndex(std::uint64_t value);
+
+		std::uint64_t _counts[BUCKETS];
+
+		std::uint64_t _count;
+		std::uint64_t _sum;
+		std::uint64_t _min;
+		std::uint64_t _max;
+};
+
+/**
+ * \brief Snapshot of a camera's capture statistics.
+ */
+struct Vcap::CaptureStats {
+	/**
+	 * \brief Time spent waiting for the driver to deliver a frame.
+	 */
+	LatencyHistogram wait;
+
+	/**
+	 * \brief Time spent copying raw frames into application buffers.
+	 */
+	LatencyHistogram copy;
+
+	/**
+	 * \brief Time spent decoding.
+	 */
+	LatencyHistogram decode;
+
+	/**
+	 * \brief Time spent in the grab call as a whole.
+	 */
+	LatencyHistogram total;
+
+	std::uint64_t frames;
+	std::uint64_t bytes;
+
+	/**
+	 * \brief Frames the driver captured but that never reached the application (gaps in the frame sequence).
+	 */
+	std::uint64_t drops;
+
+	std::uint64_t errors;
+};
+
+#endif
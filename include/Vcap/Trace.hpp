@@ -0,0 +1,73 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_TRACE_HPP
+#define _VCAP_TRACE_HPP
+
+/**
+ * \file
+ * In-process capture trace buffer, exportable as Chrome trace JSON.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace Vcap {
+	class Trace;
+}
+
+/**
+ * \brief Records dequeue, decode, re-queue and control write events into a ring buffer that can be dumped as Chrome
+ * trace JSON (chrome://tracing, Perfetto) when a latency spike needs explaining. Only available when the library is
+ * built with VCAP_TRACING, which also adds SDT probes for perf and bpftrace; otherwise every call is a no-op.
+ */
+class Vcap::Trace {
+	public:
+		/**
+		 * \brief Starts recording, keeping the most recent capacity events. Returns false if the library was built
+		 * without tracing.
+		 */
+		static bool start(std::size_t capacity = 65536);
+
+		/**
+		 * \brief Stops recording. Buffered events are kept until the next start().
+		 */
+		static void stop();
+
+		/**
+		 * \brief Returns true while events are being recorded.
+		 */
+		static bool active();
+
+		/**
+		 * \brief Writes the buffered events as Chrome trace JSON.
+		 */
+		static void dump(std::ostream& out);
+
+		/**
+		 * \brief Writes the buffered events as Chrome trace JSON to a file.
+		 */
+		static void dump(const std::string& path) throw (RuntimeError);
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_TRIGGER_RECORDER_HPP
+#define _VCAP_TRIGGER_RECORDER_HPP
+
+/**
+ * \file
+ * Recording of the frames around trigger events from an in-memory ring of recent frames.
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/FrameLog.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Vcap {
+	class TriggerRecorder;
+}
+
+/**
+ * \brief Keeps the last few seconds of raw frames in preallocated memory and, when triggered, saves the frames from
+ * before the trigger to after it to a frame log.
+ *
+ * Every frame is copied into a ring of fixed-size slots; nothing is allocated per frame. trigger() starts an event
+ * covering the frames from preSeconds before the trigger timestamp to postSeconds after it (a trigger during an event
+ * extends it). A background thread writes the event's frames, and a marker for each trigger, to a FrameLog with the
+ * given prefix, so FrameLogReader and Replay read them back. Frames outside events never reach the disk.
+ *
+ * The ring holds an extra second of frames so the writer can fall behind briefly. If it falls further behind, new
+ * frames are dropped rather than overwriting frames not yet saved. write() and trigger() must be used from one thread
+ * at a time. Use one recorder per stream.
+ */
+class Vcap::TriggerRecorder {
+	public:
+		/**
+		 * \brief Allocates the ring for the given window at the given frame rate, with slots of frameSize bytes. If
+		 * frameSize is 0 the slots hold a tightly packed frame of the given format; pass the driver's image size
+		 * instead if it pads lines, or for compressed formats whose frames can exceed 32 bits per pixel.
+		 */
+		TriggerRecorder(const std::string& prefix, const Format& format, std::uint16_t frameRate, double preSeconds,
+				double postSeconds, std::size_t segmentSize = FrameLog::DEFAULT_SEGMENT_SIZE,
+				std::size_t frameSize = 0) throw (RuntimeError);
+		~TriggerRecorder();
+
+		/**
+		 * \brief Adds a raw frame to the ring. Returns false if it was dropped because the ring is full of frames
+		 * waiting to be saved. Throws if saving an earlier event failed.
+		 */
+		bool write(const Frame& frame) throw (RuntimeError);
+
+		/**
+		 * \brief Adds a raw frame from a buffer. The timestamp is in microseconds (CLOCK_MONOTONIC).
+		 */
+		bool write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp, std::uint32_t sequence)
+				throw (RuntimeError);
+
+		/**
+		 * \brief Saves the frames from preSeconds before the timestamp to postSeconds after it, and a marker with the
+		 * given id at the timestamp.
+		 */
+		void trigger(std::uint64_t timestamp, std::uint32_t id = 0) throw (RuntimeError);
+
+		/**
+		 * \brief True while an event's frames are being saved.
+		 */
+		bool recording();
+
+		/**
+		 * \brief Saves the rest of the current event (up to the last frame written), completes the frame log and stops
+		 * the writer. Further writes fail.
+		 */
+		void close() throw (RuntimeError);
+
+		/**
+		 * \brief Returns the number of frames the ring holds.
+		 */
+		std::size_t capacity() const;
+
+		std::uint64_t frames();
+		std::uint64_t dropped();
+		std::uint64_t saved();
+		std::uint64_t events();
+
+	private:
+		struct Slot {
+			std::uint64_t timestamp;
+			std::uint32_t sequence;
+			std::size_t size;
+			std::uint8_t* data;
+		};
+
+		struct Marker {
+			std::uint64_t timestamp;
+			std::uint32_t id;
+		};
+
+		TriggerRecorder(const TriggerRecorder&);
+		TriggerRecorder& operator = (const TriggerRecorder&);
+
+		bool append(const Plane* parts, unsigned int numParts, std::uint64_t timestamp, std::uint32_t sequence)
+				throw (RuntimeError);
+		void check() throw (RuntimeError);
+
+		void run();
+
+		std::string _prefix;
+		Format _format;
+		std::uint16_t _frameRate;
+		std::size_t _segmentSize;
+
+		std::uint64_t _pre;
+		std::uint64_t _post;
+
+		std::uint8_t* _memory;
+		std::size_t _memorySize;
+		std::size_t _slotSize;
+		std::vector<Slot> _slots;
+
+		std::mutex _mutex;
+		std::condition_variable _ready;
+
+		//frames are numbered from 0 in the order written; frame n is in slot n % capacity
+		std::uint64_t _written;
+		std::uint64_t _next;
+		bool _active;
+		std::uint64_t _end;
+		std::vector<Marker> _markers;
+
+		bool _stopping;
+		bool _closed;
+		std::string _error;
+
+		std::uint64_t _dropped;
+		std::uint64_t _saved;
+		std::uint64_t _events;
+
+		FrameLog* _log;
+		std::thread _thread;
+};
+
+#endif
@@ -28,6 +28,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <functional>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -38,19 +39,62 @@ extern "C" {
 
 #include <Vcap/Controls.hpp>
 #include <Vcap/Formats.hpp>
+#include <Vcap/FramePool.hpp>
 #include <Vcap/SmartPtr.hpp>
+#include <Vcap/Stats.hpp>
 
 namespace Vcap {
 	/*
 	 * Forward declarations
 	 */
 	class RuntimeError;
+	class DeviceLostError;
+	class Status;
 	class Size;
 	class Format;
 	class FormatInfo;
 	class MenuItem;
 	class ControlInfo;
+	class FormatList;
+	class ControlList;
+	class FrameSource;
 	class Camera;
+	class Capabilities;
+	class CapabilityCache;
+	class ExposureController;
+	class StatsRecorder;
+	
+	struct DeviceInfo;
+	struct FormatDesc;
+	struct MenuItemDesc;
+	struct ControlDesc;
+	struct ControlValue;
+	struct FormatRequirements;
+	class Stream;
+	class ControlCache;
+	
+	/**
+	 * \brief Streaming I/O modes.
+	 */
+	typedef enum {
+		IO_DEFAULT,		// memory-mapped buffers managed by Vcap
+		IO_MMAP,		// memory-mapped buffers managed by this library (DMABUF export, multi-planar formats)
+		IO_USERPTR		// application-provided buffers filled in place by the driver
+	} IoMode;
+	
+	/**
+	 * \brief What the application does with captured frames, for automatic format selection.
+	 */
+	typedef enum {
+		OUTPUT_RGB,		// frames are decoded to RGB24/BGR24
+		OUTPUT_GRAY,	// only luma is consumed
+		OUTPUT_RAW		// frames are consumed undecoded
+	} OutputType;
+	
+	/**
+	 * \brief Bandwidth a USB 2.0 camera can sustain (high-bandwidth isochronous transfers), in bytes per second.
+	 */
+	const std::uint32_t USB2_BANDWIDTH = 24576000;
 	
 	/**
 	 * \brief Size smart pointer.
@@ -81,6 +125,11 @@ namespace Vcap {
 	 * \brief Camera smart pointer.
 	 */
 	typedef SmartPtr<Camera> CameraPtr;
+	
+	/**
+	 * \brief Called with a control and its new value whenever a watched control changes.
+	 */
+	typedef std::function<void (ControlId id, std::int32_t value)> ControlCallback;
 }
 
 /**
@@ -91,6 +140,44 @@ class Vcap::RuntimeError : public std::runtime_error {
 		RuntimeError(const std::string& msg) : std::runtime_error(msg) { }
 };
 
+/**
+ * \brief Raised when the device disappears (e.g. a USB camera is unplugged) while in use.
+ */
+class Vcap::DeviceLostError : public RuntimeError {
+	public:
+		DeviceLostError(const std::string& msg) : RuntimeError(msg) { }
+};
+
+/**
+ * \brief Outcome of a non-throwing call: an errno value, 0 on success, and a static description of what failed. Never
+ * allocates, so failures on the capture path cost no more than the check.
+ */
+class Vcap::Status {
+	public:
+		Status() noexcept : _error(0), _message("Success") { }
+		Status(int error, const char* message) noexcept : _error(error), _message(message) { }
+		
+		/**
+		 * \brief Returns true if the call succeeded.
+		 */
+		bool ok() const noexcept { return 0 == _error; }
+		
+		/**
+		 * \brief Returns the errno value describing the failure (ENODEV if the device was lost, ETIMEDOUT if no frame
+		 * arrived in time), or 0 on success.
+		 */
+		int error() const noexcept { return _error; }
+		
+		/**
+		 * \brief Returns a static description of what failed.
+		 */
+		const char* message() const noexcept { return _message; }
+		
+	private:
+		int _error;
+		const char* _message;
+};
+
 /**
  * \brief Encapsulates a frame size.
  */
@@ -98,6 +185,9 @@ class Vcap::Size {
 	friend class Format;
 	friend class FormatInfo;
 	
+	template <typename T, typename... Args>
+	friend SmartPtr<T> makeSmart(Args&&... args);
+	
 	public:
 		Size(std::uint32_t width, std::uint32_t height);
 	
@@ -132,6 +222,9 @@ class Vcap::Format {
 class Vcap::FormatInfo {
 	friend class Camera;
 	
+	template <typename T, typename... Args>
+	friend SmartPtr<T> makeSmart(Args&&... args);
+	
 	public:
 		virtual ~FormatInfo();
 	
@@ -152,6 +245,9 @@ class Vcap::FormatInfo {
  */
 class Vcap::MenuItem {
 	friend class ControlInfo;
+	
+	template <typename T, typename... Args>
+	friend SmartPtr<T> makeSmart(Args&&... args);
 
 	public:
 		virtual ~MenuItem();
@@ -170,6 +266,9 @@ class Vcap::MenuItem {
  */
 class Vcap::ControlInfo {
 	friend class Camera;
+	
+	template <typename T, typename... Args>
+	friend SmartPtr<T> makeSmart(Args&&... args);
 
 	public:
 		virtual ~ControlInfo();
@@ -192,12 +291,203 @@ class Vcap::ControlInfo {
 		vcap_control_info_t* _control;
 };
 
+/**
+ * \brief Identifies a capture device as reported by VIDIOC_QUERYCAP.
+ */
+struct Vcap::DeviceInfo {
+	std::string device;
+	std::string driver;
+	std::string card;
+	std::string busInfo;
+	std::uint32_t version;
+	std::uint32_t capabilities;
+	
+	/**
+	 * \brief Firmware revision (USB bcdDevice) when the kernel exposes one; empty otherwise.
+	 */
+	std::string firmware;
+};
+
+/**
+ * \brief Plain description of a pixel format. Its frame sizes are stored in the owning FormatList.
+ */
+struct Vcap::FormatDesc {
+	std::uint32_t code;
+	char codeString[5];
+	char description[32];
+	
+	std::size_t firstSize;
+	std::size_t numSizes;
+};
+
+/**
+ * \brief Every format supported by a device, with all frame sizes kept in a single contiguous array.
+ */
+class Vcap::FormatList {
+	friend class Camera;
+	friend class CapabilityCache;
+	
+	public:
+		std::size_t size() const;
+		bool empty() const;
+		
+		const FormatDesc& operator [] (std::size_t index) const;
+		
+		const FormatDesc* begin() const;
+		const FormatDesc* end() const;
+		
+		/**
+		 * \brief Returns the first of the format's numSizes frame sizes.
+		 */
+		const Size* sizes(const FormatDesc& format) const;
+		
+	private:
+		std::vector<FormatDesc> _formats;
+		std::vector<Size> _sizes;
+};
+
+/**
+ * \brief Plain description of a control menu item.
+ */
+struct Vcap::MenuItemDesc {
+	char name[32];
+	std::uint32_t value;
+};
+
+/**
+ * \brief Plain description of a camera control. Its menu items are stored in the owning ControlList.
+ */
+struct Vcap::ControlDesc {
+	ControlId id;
+	ControlType type;
+	char name[32];
+	
+	std::int32_t min;
+	std::int32_t max;
+	std::int32_t step;
+	std::int32_t defaultValue;
+	
+	std::size_t firstMenuItem;
+	std::size_t numMenuItems;
+};
+
+/**
+ * \brief Every control supported by a device, with all menu items kept in a single contiguous array.
+ */
+class Vcap::ControlList {
+	friend class Camera;
+	friend class CapabilityCache;
+	
+	public:
+		std::size_t size() const;
+		bool empty() const;
+		
+		const ControlDesc& operator [] (std::size_t index) const;
+		
+		const ControlDesc* begin() const;
+		const ControlDesc* end() const;
+		
+		/**
+		 * \brief Returns the first of the control's numMenuItems menu items.
+		 */
+		const MenuItemDesc* menu(const ControlDesc& control) const;
+		
+	private:
+		std::vector<ControlDesc> _controls;
+		std::vector<MenuItemDesc> _menuItems;
+};
+
+/**
+ * \brief A control and its value, for reading or writing several controls at once.
+ */
+struct Vcap::ControlValue {
+	ControlId id;
+	std::int32_t value;
+};
+
+/**
+ * \brief What the application needs from a camera, for cost-aware automatic format selection.
+ */
+struct Vcap::FormatRequirements {
+	FormatRequirements(std::uint32_t width = 0, std::uint32_t height = 0, std::uint16_t minFrameRate = 0,
+			OutputType output = OUTPUT_RGB) :
+		width(width), height(height), minFrameRate(minFrameRate), output(output), maxBandwidth(USB2_BANDWIDTH) { }
+	
+	/**
+	 * \brief Target frame size; 0 accepts any size.
+	 */
+	std::uint32_t width;
+	std::uint32_t height;
+	
+	/**
+	 * \brief Lowest acceptable frame rate; 0 accepts any rate.
+	 */
+	std::uint16_t minFrameRate;
+	
+	OutputType output;
+	
+	/**
+	 * \brief Bus bandwidth available to the camera, in bytes per second; 0 for no limit.
+	 */
+	std::uint32_t maxBandwidth;
+};
+
+/**
+ * \brief A stream of frames: a live camera or a recording being replayed. Code written against this interface can be
+ * benchmarked and profiled with recorded input.
+ */
+class Vcap::FrameSource {
+	public:
+		virtual ~FrameSource() { }
+		
+		/**
+		 * \brief Returns the format of the frames delivered by grab().
+		 */
+		virtual Format format() throw (RuntimeError) = 0;
+		
+		/**
+		 * \brief Starts delivering frames.
+		 */
+		virtual void start() throw (RuntimeError) = 0;
+		
+		/**
+		 * \brief Stops delivering frames.
+		 */
+		virtual void stop() throw (RuntimeError) = 0;
+		
+		/**
+		 * \brief Returns true if frames are being delivered; false otherwise.
+		 */
+		virtual bool capturing() = 0;
+		
+		/**
+		 * \brief Allocates a buffer, grabs the next frame (optionally decodes it), and stores it in the buffer.
+		 */
+		virtual std::size_t grab(std::uint8_t** buffer, bool decode = false, bool bgr = false) throw (RuntimeError) = 0;
+		
+		/**
+		 * \brief Grabs the next frame (optionally decodes it) into a buffer taken from the pool.
+		 */
+		virtual Frame grab(FramePool& pool, bool decode = false, bool bgr = false) throw (RuntimeError) = 0;
+};
+
 /**
  * \brief Encapsulates an image capture device.
  */
-class Vcap::Camera {
+class Vcap::Camera : public FrameSource {
+	template <typename T, typename... Args>
+	friend SmartPtr<T> makeSmart(Args&&... args);
+	
 	public:
 		static std::vector<CameraPtr> cameras() throw (RuntimeError);
+		
+		/**
+		 * \brief Probes every video node in a directory concurrently and returns the capture-capable ones, skipping
+		 * metadata and output nodes. Devices that have not answered within timeout milliseconds are left out. Open a
+		 * returned device with Camera(info.device).
+		 */
+		static std::vector<DeviceInfo> discover(unsigned int timeout = 1000, const std::string& directory = "/dev")
+				throw (RuntimeError);
 	
 		Camera(const std::string& device);
 		virtual ~Camera();
@@ -217,6 +507,16 @@ class Vcap::Camera {
 		 */
 		std::string info();
 		
+		/**
+		 * \brief Returns the driver, card, bus and firmware identification of the open device.
+		 */
+		DeviceInfo deviceInfo() throw (RuntimeError);
+		
+		/**
+		 * \brief Probes the full format, frame size, frame rate and control tree of the open device.
+		 */
+		Capabilities capabilities() throw (RuntimeError);
+		
 		/**
 		 * \brief Opens the underlying device.
 		 */
@@ -237,6 +537,11 @@ class Vcap::Camera {
 		 */
 		std::vector<FormatInfoPtr> formats() throw (RuntimeError);
 		
+		/**
+		 * \brief Returns all formats supported by this device as plain values, using a handful of allocations.
+		 */
+		FormatList formatList() throw (RuntimeError);
+		
 		/**
 		 * \brief Returns the current format.
 		 */
@@ -252,6 +557,19 @@ class Vcap::Camera {
 		 */
 		void autoSetFormat() throw (RuntimeError);
 		
+		/**
+		 * \brief Sets the cheapest format, frame size and frame rate that meets the requirements, scoring every
+		 * combination by decode cost and bus bandwidth. Sizes smaller than the target are only chosen if nothing
+		 * larger is viable. Returns the format that was set.
+		 */
+		Format autoSetFormat(const FormatRequirements& requirements) throw (RuntimeError);
+		
+		/**
+		 * \brief As above, choosing from previously probed (e.g. cached) capabilities.
+		 */
+		Format autoSetFormat(const FormatRequirements& requirements, const Capabilities& capabilities)
+				throw (RuntimeError);
+		
 		/**
 		 * \brief Returns all supported frame rates for a given format and frame size.
 		 */
@@ -273,7 +591,12 @@ class Vcap::Camera {
 		std::vector<ControlInfoPtr> controls() throw (RuntimeError);
 		
 		/**
-		 * \brief Returns the current value for the specified control.
+		 * \brief Returns all supported controls as plain values, using a handful of allocations.
+		 */
+		ControlList controlList() throw (RuntimeError);
+		
+		/**
+		 * \brief Returns the current value for the specified control. Served from memory while controls are watched.
 		 */
 		std::int32_t controlValue(const ControlId& id) throw (RuntimeError);
 		
@@ -282,13 +605,102 @@ class Vcap::Camera {
 		 */
 		void setControlValue(const ControlId& id, const std::int32_t& value) throw (RuntimeError);
 		
+		/**
+		 * \brief Reads the current value of every listed control in a single request where the driver supports
+		 * extended controls, falling back to one request per control otherwise.
+		 */
+		void controlValues(std::vector<ControlValue>& values) throw (RuntimeError);
+		
+		/**
+		 * \brief Sets every listed control in a single request, so the driver applies them together. Drivers without
+		 * extended control support are set one control at a time.
+		 */
+		void setControlValues(const std::vector<ControlValue>& values) throw (RuntimeError);
+		
+		/**
+		 * \brief Subscribes to the driver's control change events and keeps a cached copy of every control's value,
+		 * so controlValue() no longer touches the device. Controls the driver cannot report changes for are still
+		 * read from the device. Watching stops when the camera is closed.
+		 */
+		void watchControls() throw (RuntimeError);
+		
+		/**
+		 * \brief Stops watching controls.
+		 */
+		void unwatchControls();
+		
+		/**
+		 * \brief Returns true if controls are being watched.
+		 */
+		bool watchingControls();
+		
+		/**
+		 * \brief Registers a callback for changes to watched controls, including changes made by this process.
+		 * Callbacks run on an internal thread. Returns a handle for removeControlCallback().
+		 */
+		std::size_t addControlCallback(const ControlCallback& callback);
+		
+		/**
+		 * \brief Unregisters a control change callback.
+		 */
+		void removeControlCallback(std::size_t handle);
+		
+		/**
+		 * \brief Attaches a software auto-exposure controller, which is then fed luma statistics from every decoded
+		 * frame. Pass NULL to detach it. The controller is not owned by the camera.
+		 */
+		void setExposureController(ExposureController* controller);
+		
+		/**
+		 * \brief Returns a snapshot of per-stage capture latencies and frame, byte, drop and error counts, collected
+		 * since the camera was created or the statistics were last reset.
+		 */
+		CaptureStats stats();
+		
+		/**
+		 * \brief Clears the capture statistics.
+		 */
+		void resetStats();
+		
+		/**
+		 * \brief Returns the streaming I/O mode.
+		 */
+		IoMode ioMode();
+		
+		/**
+		 * \brief Sets the streaming I/O mode. Must be called before start().
+		 */
+		void setIoMode(IoMode mode) throw (RuntimeError);
+		
+		/**
+		 * \brief Returns the number of driver buffers requested in IO_MMAP mode.
+		 */
+		std::size_t bufferCount();
+		
+		/**
+		 * \brief Sets the number of driver buffers requested in IO_MMAP mode. Must be called before start().
+		 */
+		void setBufferCount(std::size_t count) throw (RuntimeError);
+		
+		/**
+		 * \brief Registers an application buffer for IO_USERPTR streaming. The buffer must be page-aligned, at least
+		 * as large as the current format's image size, and remain valid until the camera is stopped.
+		 */
+		void addUserBuffer(std::uint8_t* data, std::size_t length) throw (RuntimeError);
+		
+		/**
+		 * \brief Unregisters all application buffers.
+		 */
+		void clearUserBuffers() throw (RuntimeError);
+		
 		/**
 		 * \brief Starts streaming.
 		 */
 		void start() throw (RuntimeError);
 		
 		/**
-		 * \brief Stops streaming.
+		 * \brief Stops streaming. The data of frames returned by dequeue() is invalid afterwards (their buffers are
+		 * unmapped), though the Frame handles themselves may still be released safely.
 		 */
 		void stop() throw (RuntimeError);
 		
@@ -297,15 +709,102 @@ class Vcap::Camera {
 		 */
 		bool capturing();
 		
+		/**
+		 * \brief Non-throwing start().
+		 */
+		Status tryStart() noexcept;
+		
+		/**
+		 * \brief Non-throwing stop().
+		 */
+		Status tryStop() noexcept;
+		
+		/**
+		 * \brief Non-throwing grab() into a pool buffer. On success frame refers to the captured frame; on failure it
+		 * is left untouched. Transient errors (EAGAIN, EIO, ETIMEDOUT) can simply be retried.
+		 */
+		Status tryGrab(FramePool& pool, Frame& frame, bool decode = false, bool bgr = false) noexcept;
+		
+		/**
+		 * \brief Non-throwing dequeue().
+		 */
+		Status tryDequeue(Frame& frame) noexcept;
+		
+		/**
+		 * \brief Non-throwing controlValue().
+		 */
+		Status tryControlValue(const ControlId& id, std::int32_t& value) noexcept;
+		
+		/**
+		 * \brief Non-throwing setControlValue().
+		 */
+		Status trySetControlValue(const ControlId& id, std::int32_t value) noexcept;
+		
+		/**
+		 * \brief Grabs and discards frames until the stream has settled, replacing a fixed warm-up delay after start().
+		 * The stream is settled once frames carry a payload and their brightness (or, for compressed formats, their
+		 * size) has stopped changing, or once a non-zero number of frames has been discarded. Returns false if the
+		 * stream did not settle within timeout milliseconds.
+		 */
+		bool waitUntilReady(unsigned int timeout = 3000, unsigned int frames = 0) throw (RuntimeError);
+		
 		/**
 		 * \brief Allocates a buffer, grabs an image from the camera (optionally decodes it), and stores it in the buffer.
 		 */
 		std::size_t grab(std::uint8_t** buffer, bool decode = false, bool bgr = false) throw (RuntimeError);
 		
+		/**
+		 * \brief Grabs an image from the camera (optionally decodes it) into a buffer taken from the pool. Only the
+		 * library-managed I/O modes grab without allocating; in IO_DEFAULT, Vcap still allocates (and this copies out
+		 * of) a buffer for every frame.
+		 */
+		Frame grab(FramePool& pool, bool decode = false, bool bgr = false) throw (RuntimeError);
+		
+		/**
+		 * \brief Returns the next filled driver buffer without copying it (IO_MMAP and IO_USERPTR modes). The buffer
+		 * is handed back to the driver once every handle to it is released.
+		 */
+		Frame dequeue() throw (RuntimeError);
+		
+		/**
+		 * \brief Exports a dequeued frame's buffer as a DMABUF file descriptor (IO_MMAP mode only) and registers
+		 * importers that each hold a reference to it. The buffer is not re-queued until every importer has called
+		 * releaseExported() and every local handle has been released. The descriptor is owned by the camera and
+		 * stays valid until stop(); pass it to other processes over a UNIX socket.
+		 */
+		int exportFrame(const Frame& frame, unsigned int importers = 1) throw (RuntimeError);
+		
+		/**
+		 * \brief Drops one importer reference from an exported buffer (see Frame::index()).
+		 */
+		void releaseExported(std::uint32_t index) throw (RuntimeError);
+		
 	private:
 		Camera(vcap_camera_t* camera);
+		
+		std::size_t grabBuffer(std::uint8_t** buffer, bool decode, bool bgr, std::uint64_t start);
+		Status grabFrame(FramePool& pool, Frame& frame, bool decode, bool bgr, std::uint64_t start) noexcept;
 	
 		vcap_camera_t* _camera;
+		
+		std::uint32_t _sequence;
+		
+		//format of the IO_DEFAULT stream, read once rather than on every decoded grab
+		vcap_format_t _captureFormat;
+		
+		Stream* _stream;
+		ControlCache* _controlCache;
+		ExposureController* _exposure;
+		StatsRecorder* _stats;
 };
 
+#include <Vcap/AsyncWriter.hpp>
+#include <Vcap/CapabilityCache.hpp>
+#include <Vcap/DeviceMonitor.hpp>
+#include <Vcap/Exposure.hpp>
+#include <Vcap/FrameLog.hpp>
+#include <Vcap/Recording.hpp>
+#include <Vcap/Trace.hpp>
+#include <Vcap/TriggerRecorder.hpp>
+
 #endif
@@ -0,0 +1,1467 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * LD_PRELOAD shim that emulates V4L2 capture devices, so the capture path, the examples and the benchmarks can run on
+ * machines without cameras:
+ *
+ *	LD_PRELOAD=./libvcap-mock.so ./vcap-bench /dev/video0
+ *
+ * Opening a configured device path returns a timerfd in place of a device node. The timer fires at the frame rate,
+ * so poll() and select() on the descriptor behave as they would on a real device, and ioctl(), mmap() and read() on it
+ * are answered here. Both the libc entry points and libv4l2's are intercepted.
+ *
+ * Configuration is read from the environment when the library is loaded:
+ *
+ *	VCAP_MOCK_DEVICES	device paths to emulate (default "/dev/video0"), comma-separated
+ *	VCAP_MOCK_FORMATS	formats and frame sizes, e.g. "YUYV:640x480,1280x720;GREY:640x480"
+ *	VCAP_MOCK_FPS		frame rates offered for every size (default "30,15")
+ *	VCAP_MOCK_JITTER	maximum frame timing jitter in microseconds (default 0)
+ *	VCAP_MOCK_DROPS		probability (0-1) that a frame is dropped by the "driver" (default 0)
+ *	VCAP_MOCK_PATTERN	bars, moving, gradient or flat (default moving)
+ *
+ * Supported formats are YUYV, UYVY, GREY, RGB3, BGR3, YU12 and NV12, single-planar only, with MMAP, USERPTR and
+ * read() I/O. Brightness, contrast, gain and exposure controls are emulated and applied to the pattern.
+ *
+ * Devices are not listed in /dev, so code that enumerates device nodes by scanning the directory will not see them;
+ * libvcap's probe of /dev/videoN is answered through stat().
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/timerfd.h>
+#include <linux/videodev2.h>
+
+namespace {
+	/*
+	 * Limits on driver buffers, as a real driver would impose.
+	 */
+	const std::uint32_t MIN_BUFFERS = 2;
+	const std::uint32_t MAX_BUFFERS = 32;
+
+	/*
+	 * Major number of V4L2 device nodes, reported by stat().
+	 */
+	const unsigned int VIDEO_MAJOR = 81;
+
+	enum Pattern {
+		PATTERN_BARS,
+		PATTERN_MOVING,
+		PATTERN_GRADIENT,
+		PATTERN_FLAT
+	};
+
+	struct MockSize {
+		std::uint32_t width;
+		std::uint32_t height;
+	};
+
+	struct MockFormat {
+		std::uint32_t code;
+		std::vector<MockSize> sizes;
+	};
+
+	struct MockControl {
+		std::uint32_t id;
+		const char* name;
+		std::int32_t min;
+		std::int32_t max;
+		std::int32_t defaultValue;
+	};
+
+	const MockControl CONTROLS[] = {
+		{ V4L2_CID_BRIGHTNESS, "Brightness", 0, 255, 128 },
+		{ V4L2_CID_CONTRAST, "Contrast", 0, 255, 128 },
+		{ V4L2_CID_GAIN, "Gain", 0, 255, 64 },
+		{ V4L2_CID_EXPOSURE_ABSOLUTE, "Exposure (Absolute)", 1, 10000, 300 }
+	};
+
+	const std::size_t NUM_CONTROLS = sizeof(CONTROLS) / sizeof(CONTROLS[0]);
+
+	struct Config {
+		std::vector<std::string> devices;
+		std::vector<MockFormat> formats;
+		std::vector<std::uint16_t> frameRates;
+		std::uint64_t jitter;	// ns
+		double drops;
+		Pattern pattern;
+	};
+
+	struct MockBuffer {
+		std::uint8_t* data;
+		std::size_t length;
+		std::size_t offset;
+
+		bool queued;
+		std::uint32_t bytesused;
+		std::uint32_t sequence;
+		struct timeval timestamp;
+	};
+
+	/*
+	 * Emulated device. The descriptor handed to the application is a timerfd armed for the next frame.
+	 */
+	struct MockDevice {
+		int fd;
+		unsigned int index;
+
+		std::mutex mutex;
+
+		std::uint32_t code;
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint16_t frameRate;
+
+		std::uint32_t memoryType;
+		std::vector<MockBuffer> buffers;
+		std::deque<std::uint32_t> queue;
+
+		int memfd;
+		std::uint8_t* mapping;
+		std::size_t mappingSize;
+
+		bool streaming;
+		bool reading;
+		std::uint32_t sequence;
+		std::uint64_t deadline;	// ns, CLOCK_MONOTONIC
+		std::uint64_t captured;	// ns, time the pending frame was "captured"
+
+		std::int32_t controls[NUM_CONTROLS];
+
+		std::uint64_t random;
+	};
+
+	typedef int (*OpenFunc)(const char*, int, ...);
+	typedef int (*OpenatFunc)(int, const char*, int, ...);
+	typedef int (*CloseFunc)(int);
+	typedef int (*IoctlFunc)(int, unsigned long, ...);
+	typedef void* (*MmapFunc)(void*, std::size_t, int, int, int, off_t);
+	typedef void* (*Mmap64Func)(void*, std::size_t, int, int, int, off64_t);
+	typedef int (*MunmapFunc)(void*, std::size_t);
+	typedef ssize_t (*ReadFunc)(int, void*, std::size_t);
+	typedef int (*StatFunc)(const char*, struct stat*);
+	typedef int (*Stat64Func)(const char*, struct stat64*);
+	typedef int (*XstatFunc)(int, const char*, struct stat*);
+	typedef int (*Xstat64Func)(int, const char*, struct stat64*);
+	typedef int (*AccessFunc)(const char*, int);
+
+	Config config;
+
+	std::mutex devicesMutex;
+	std::map<int, std::shared_ptr<MockDevice>> devices;
+
+	template <typename T>
+	T next(const char* name) {
+		return (T)dlsym(RTLD_NEXT, name);
+	}
+
+	std::vector<std::string> split(const std::string& str, char separator) {
+		std::vector<std::string> parts;
+		std::string::size_type start = 0;
+
+		while (start <= str.size()) {
+			std::string::size_type end = str.find(separator, start);
+
+			if (std::string::npos == end)
+				end = str.size();
+
+			if (end > start)
+				parts.push_back(str.substr(start, end - start));
+
+			start = end + 1;
+		}
+
+		return parts;
+	}
+
+	std::string env(const char* name, const char* defaultValue) {
+		const char* value = std::getenv(name);
+
+		return value && *value ? value : defaultValue;
+	}
+
+	std::uint32_t fourcc(const std::string& str) {
+		char code[4] = { ' ', ' ', ' ', ' ' };
+
+		std::memcpy(code, str.data(), std::min<std::size_t>(4, str.size()));
+
+		return v4l2_fourcc(code[0], code[1], code[2], code[3]);
+	}
+
+	bool supported(std::uint32_t code) {
+		switch (code) {
+			case V4L2_PIX_FMT_YUYV:
+			case V4L2_PIX_FMT_UYVY:
+			case V4L2_PIX_FMT_GREY:
+			case V4L2_PIX_FMT_RGB24:
+			case V4L2_PIX_FMT_BGR24:
+			case V4L2_PIX_FMT_YUV420:
+			case V4L2_PIX_FMT_NV12:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	const char* description(std::uint32_t code) {
+		switch (code) {
+			case V4L2_PIX_FMT_YUYV:
+				return "YUYV 4:2:2";
+			case V4L2_PIX_FMT_UYVY:
+				return "UYVY 4:2:2";
+			case V4L2_PIX_FMT_GREY:
+				return "8-bit Greyscale";
+			case V4L2_PIX_FMT_RGB24:
+				return "24-bit RGB 8-8-8";
+			case V4L2_PIX_FMT_BGR24:
+				return "24-bit BGR 8-8-8";
+			case V4L2_PIX_FMT_YUV420:
+				return "Planar YUV 4:2:0";
+			default:
+				return "Y/CbCr 4:2:0";
+		}
+	}
+
+	std::uint32_t bytesPerLine(std::uint32_t code, std::uint32_t width) {
+		switch (code) {
+			case V4L2_PIX_FMT_YUYV:
+			case V4L2_PIX_FMT_UYVY:
+				return 2 * width;
+			case V4L2_PIX_FMT_RGB24:
+			case V4L2_PIX_FMT_BGR24:
+				return 3 * width;
+			default:
+				return width;
+		}
+	}
+
+	std::uint32_t imageSize(std::uint32_t code, std::uint32_t width, std::uint32_t height) {
+		if (V4L2_PIX_FMT_YUV420 == code || V4L2_PIX_FMT_NV12 == code)
+			return width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2);
+
+		return bytesPerLine(code, width) * height;
+	}
+
+	/*
+	 * Parses the environment. Unsupported formats and malformed sizes are ignored.
+	 */
+	void configure() {
+		config.devices = split(env("VCAP_MOCK_DEVICES", "/dev/video0"), ',');
+
+		std::string formats = env("VCAP_MOCK_FORMATS",
+				"YUYV:640x480,1280x720,1920x1080;GREY:640x480;RGB3:640x480;YU12:640x480,1280x720;NV12:1280x720");
+
+		for (const std::string& spec : split(formats, ';')) {
+			std::string::size_type colon = spec.find(':');
+
+			if (std::string::npos == colon)
+				continue;
+
+			MockFormat format;
+			format.code = fourcc(spec.substr(0, colon));
+
+			if (!supported(format.code))
+				continue;
+
+			for (const std::string& size : split(spec.substr(colon + 1), ',')) {
+				MockSize mockSize;
+
+				if (2 == std::sscanf(size.c_str(), "%ux%u", &mockSize.width, &mockSize.height) &&
+						mockSize.width >= 2 && mockSize.height >= 2)
+					format.sizes.push_back(mockSize);
+			}
+
+			if (!format.sizes.empty())
+				config.formats.push_back(format);
+		}
+
+		for (const std::string& rate : split(env("VCAP_MOCK_FPS", "30,15"), ',')) {
+			int frameRate = std::atoi(rate.c_str());
+
+			if (frameRate > 0 && frameRate <= 1000)
+				config.frameRates.push_back((std::uint16_t)frameRate);
+		}
+
+		if (config.formats.empty()) {
+			MockFormat format = { V4L2_PIX_FMT_YUYV, { { 640, 480 } } };
+			config.formats.push_back(format);
+		}
+
+		if (config.frameRates.empty())
+			config.frameRates.push_back(30);
+
+		config.jitter = (std::uint64_t)std::atoll(env("VCAP_MOCK_JITTER", "0").c_str()) * 1000;
+		config.drops = std::atof(env("VCAP_MOCK_DROPS", "0").c_str());
+
+		std::string pattern = env("VCAP_MOCK_PATTERN", "moving");
+
+		if ("bars" == pattern)
+			config.pattern = PATTERN_BARS;
+		else if ("gradient" == pattern)
+			config.pattern = PATTERN_GRADIENT;
+		else if ("flat" == pattern)
+			config.pattern = PATTERN_FLAT;
+		else
+			config.pattern = PATTERN_MOVING;
+	}
+
+	struct Init {
+		Init() {
+			configure();
+		}
+	} init;
+
+	int deviceIndex(const char* path) {
+		if (!path)
+			return -1;
+
+		for (std::size_t i = 0; i < config.devices.size(); i++) {
+			if (config.devices[i] == path)
+				return (int)i;
+		}
+
+		return -1;
+	}
+
+	std::shared_ptr<MockDevice> findDevice(int fd) {
+		std::lock_guard<std::mutex> lock(devicesMutex);
+
+		std::map<int, std::shared_ptr<MockDevice>>::iterator it = devices.find(fd);
+
+		return devices.end() == it ? std::shared_ptr<MockDevice>() : it->second;
+	}
+
+	std::uint64_t now() {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return (std::uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+
+	/*
+	 * xorshift64, seeded per device so runs are repeatable.
+	 */
+	double uniform(MockDevice& device) {
+		device.random ^= device.random << 13;
+		device.random ^= device.random >> 7;
+		device.random ^= device.random << 17;
+
+		return (device.random >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/*
+	 * Arms the timer for the next frame that will be delivered, skipping frames the "driver" drops.
+	 */
+	void armTimer(MockDevice& device) {
+		std::uint64_t interval = 1000000000 / device.frameRate;
+		std::uint64_t current = now();
+
+		//frames that came and went while the application was not dequeuing are lost, as with a real driver
+		while (device.deadline + interval < current) {
+			device.deadline += interval;
+			device.sequence++;
+		}
+
+		do {
+			device.deadline += interval;
+			device.sequence++;
+		} while (config.drops > 0 && uniform(device) < config.drops);
+
+		std::uint64_t fire = device.deadline;
+
+		if (config.jitter > 0)
+			fire += (std::uint64_t)(uniform(device) * config.jitter);
+
+		device.captured = fire;
+
+		struct itimerspec spec;
+		std::memset(&spec, 0, sizeof(spec));
+		spec.it_value.tv_sec = fire / 1000000000;
+		spec.it_value.tv_nsec = fire % 1000000000;
+
+		timerfd_settime(device.fd, TFD_TIMER_ABSTIME, &spec, NULL);
+	}
+
+	void startTimer(MockDevice& device) {
+		device.sequence = (std::uint32_t)-1;
+		device.deadline = now();
+
+		armTimer(device);
+	}
+
+	/*
+	 * Fires the timer immediately rather than disarming it, so a thread blocked waiting for a frame wakes up and sees
+	 * that streaming has stopped. Re-arming the timer clears the expiration.
+	 */
+	void stopTimer(MockDevice& device) {
+		struct itimerspec spec;
+		std::memset(&spec, 0, sizeof(spec));
+		spec.it_value.tv_nsec = 1;
+
+		timerfd_settime(device.fd, 0, &spec, NULL);
+	}
+
+	/*
+	 * Waits for the pending frame, as a blocking or non-blocking read of the descriptor would.
+	 */
+	bool waitFrame(int fd) {
+		static ReadFunc realRead = next<ReadFunc>("read");
+
+		std::uint64_t expirations;
+
+		return sizeof(expirations) == realRead(fd, &expirations, sizeof(expirations));
+	}
+
+	std::uint8_t clamp(int value) {
+		return (std::uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+	}
+
+	std::int32_t controlValue(const MockDevice& device, std::uint32_t id) {
+		for (std::size_t i = 0; i < NUM_CONTROLS; i++) {
+			if (CONTROLS[i].id == id)
+				return device.controls[i];
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Renders the pattern into a frame buffer. Every pattern varies only across the width, so one row per plane is
+	 * computed and copied down the frame.
+	 */
+	void render(const MockDevice& device, std::uint8_t* data) {
+		static const std::uint8_t BARS[8][3] = {
+			{ 235, 235, 235 }, { 235, 235, 16 }, { 16, 235, 235 }, { 16, 235, 16 },
+			{ 235, 16, 235 }, { 235, 16, 16 }, { 16, 16, 235 }, { 16, 16, 16 }
+		};
+
+		std::uint32_t width = device.width;
+		std::uint32_t height = device.height;
+
+		//exposure and gain scale the image, brightness offsets it and contrast stretches it about mid-grey
+		double scale = controlValue(device, V4L2_CID_EXPOSURE_ABSOLUTE) / 300.0 *
+				controlValue(device, V4L2_CID_GAIN) / 64.0;
+		double contrast = controlValue(device, V4L2_CID_CONTRAST) / 128.0;
+		int brightness = controlValue(device, V4L2_CID_BRIGHTNESS) - 128;
+
+		std::uint32_t shift = PATTERN_MOVING == config.pattern ? device.sequence * 4 : 0;
+
+		std::vector<std::uint8_t> y(width), u(width), v(width), rgb(3 * width);
+
+		for (std::uint32_t x = 0; x < width; x++) {
+			std::uint8_t pixel[3];
+
+			if (PATTERN_GRADIENT == config.pattern) {
+				pixel[0] = pixel[1] = pixel[2] = (std::uint8_t)(x * 255 / (width - 1));
+			} else if (PATTERN_FLAT == config.pattern) {
+				pixel[0] = pixel[1] = pixel[2] = 128;
+			} else {
+				std::memcpy(pixel, BARS[((x + shift) % width) * 8 / width], 3);
+			}
+
+			for (unsigned int c = 0; c < 3; c++)
+				rgb[3 * x + c] = clamp((int)(((pixel[c] - 128) * contrast + 128) * scale) + brightness);
+
+			int r = rgb[3 * x], g = rgb[3 * x + 1], b = rgb[3 * x + 2];
+
+			y[x] = clamp((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+			u[x] = clamp((-38 * r - 74 * g + 112 * b + 128) / 256 + 128);
+			v[x] = clamp((112 * r - 94 * g - 18 * b + 128) / 256 + 128);
+		}
+
+		std::uint32_t chromaWidth = (width + 1) / 2;
+		std::uint32_t chromaHeight = (height + 1) / 2;
+
+		std::vector<std::uint8_t> row;
+
+		switch (device.code) {
+			case V4L2_PIX_FMT_YUYV:
+			case V4L2_PIX_FMT_UYVY: {
+				bool yuyv = V4L2_PIX_FMT_YUYV == device.code;
+
+				row.resize(2 * width);
+
+				for (std::uint32_t x = 0; x + 1 < width; x += 2) {
+					row[2 * x + (yuyv ? 0 : 1)] = y[x];
+					row[2 * x + (yuyv ? 1 : 0)] = u[x];
+					row[2 * x + (yuyv ? 2 : 3)] = y[x + 1];
+					row[2 * x + (yuyv ? 3 : 2)] = v[x];
+				}
+
+				break;
+			}
+			case V4L2_PIX_FMT_GREY:
+				row = y;
+				break;
+			case V4L2_PIX_FMT_RGB24:
+				row = rgb;
+				break;
+			case V4L2_PIX_FMT_BGR24:
+				row.resize(3 * width);
+
+				for (std::uint32_t x = 0; x < width; x++) {
+					row[3 * x] = rgb[3 * x + 2];
+					row[3 * x + 1] = rgb[3 * x + 1];
+					row[3 * x + 2] = rgb[3 * x];
+				}
+
+				break;
+			default: {
+				//4:2:0 formats: the luma plane, then planar (YU12) or interleaved (NV12) chroma
+				for (std::uint32_t j = 0; j < height; j++)
+					std::memcpy(data + j * width, y.data(), width);
+
+				std::uint8_t* chroma = data + width * height;
+
+				if (V4L2_PIX_FMT_YUV420 == device.code) {
+					for (std::uint32_t x = 0; x < chromaWidth; x++) {
+						u[x] = u[2 * x];
+						v[x] = v[2 * x];
+					}
+
+					for (std::uint32_t j = 0; j < chromaHeight; j++) {
+						std::memcpy(chroma + j * chromaWidth, u.data(), chromaWidth);
+						std::memcpy(chroma + (chromaHeight + j) * chromaWidth, v.data(), chromaWidth);
+					}
+				} else {
+					row.resize(2 * chromaWidth);
+
+					for (std::uint32_t x = 0; x < chromaWidth; x++) {
+						row[2 * x] = u[2 * x];
+						row[2 * x + 1] = v[2 * x];
+					}
+
+					for (std::uint32_t j = 0; j < chromaHeight; j++)
+						std::memcpy(chroma + j * row.size(), row.data(), row.size());
+				}
+
+				return;
+			}
+		}
+
+		for (std::uint32_t j = 0; j < height; j++)
+			std::memcpy(data + j * row.size(), row.data(), row.size());
+	}
+
+	void setTimestamp(struct timeval& tv, std::uint64_t ns) {
+		tv.tv_sec = ns / 1000000000;
+		tv.tv_usec = (ns % 1000000000) / 1000;
+	}
+
+	void freeBuffers(MockDevice& device) {
+		if (device.mapping)
+			munmap(device.mapping, device.mappingSize);
+
+		if (-1 != device.memfd)
+			close(device.memfd);
+
+		device.mapping = NULL;
+		device.mappingSize = 0;
+		device.memfd = -1;
+		device.buffers.clear();
+		device.queue.clear();
+	}
+
+	int fail(int error) {
+		errno = error;
+		return -1;
+	}
+
+	void chooseFormat(std::uint32_t& code, std::uint32_t& width, std::uint32_t& height) {
+		const MockFormat* format = &config.formats[0];
+
+		for (const MockFormat& candidate : config.formats) {
+			if (candidate.code == code)
+				format = &candidate;
+		}
+
+		//nearest size by area, as drivers adjust unsupported sizes
+		const MockSize* best = &format->sizes[0];
+		std::int64_t bestDistance = -1;
+
+		for (const MockSize& size : format->sizes) {
+			std::int64_t distance = std::llabs((std::int64_t)size.width * size.height - (std::int64_t)width * height);
+
+			if (-1 == bestDistance || distance < bestDistance) {
+				best = &size;
+				bestDistance = distance;
+			}
+		}
+
+		code = format->code;
+		width = best->width;
+		height = best->height;
+	}
+
+	void fillPixFormat(const MockDevice& device, struct v4l2_pix_format& pix) {
+		std::memset(&pix, 0, sizeof(pix));
+		pix.width = device.width;
+		pix.height = device.height;
+		pix.pixelformat = device.code;
+		pix.field = V4L2_FIELD_NONE;
+		pix.bytesperline = bytesPerLine(device.code, device.width);
+		pix.sizeimage = imageSize(device.code, device.width, device.height);
+		pix.colorspace = V4L2_COLORSPACE_SRGB;
+	}
+
+	void fillBuffer(const MockDevice& device, std::uint32_t index, struct v4l2_buffer& buf) {
+		const MockBuffer& buffer = device.buffers[index];
+
+		buf.index = index;
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = device.memoryType;
+		buf.bytesused = buffer.bytesused;
+		buf.field = V4L2_FIELD_NONE;
+		buf.sequence = buffer.sequence;
+		buf.timestamp = buffer.timestamp;
+		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC | (buffer.queued ? V4L2_BUF_FLAG_QUEUED : 0);
+
+		if (V4L2_MEMORY_MMAP == device.memoryType) {
+			buf.m.offset = (std::uint32_t)buffer.offset;
+			buf.length = (std::uint32_t)buffer.length;
+			buf.flags |= V4L2_BUF_FLAG_MAPPED;
+		} else {
+			buf.m.userptr = (unsigned long)buffer.data;
+			buf.length = (std::uint32_t)buffer.length;
+		}
+	}
+
+	int requestBuffers(MockDevice& device, struct v4l2_requestbuffers* req) {
+		if (V4L2_BUF_TYPE_VIDEO_CAPTURE != req->type)
+			return fail(EINVAL);
+
+		if (V4L2_MEMORY_MMAP != req->memory && V4L2_MEMORY_USERPTR != req->memory)
+			return fail(EINVAL);
+
+		if (device.streaming || device.reading)
+			return fail(EBUSY);
+
+		freeBuffers(device);
+
+		if (0 == req->count)
+			return 0;
+
+		std::uint32_t count = std::max(MIN_BUFFERS, std::min(MAX_BUFFERS, req->count));
+		std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+		std::size_t length = (imageSize(device.code, device.width, device.height) + page - 1) / page * page;
+
+		device.memoryType = req->memory;
+
+		if (V4L2_MEMORY_MMAP == req->memory) {
+			device.mappingSize = count * length;
+			device.memfd = memfd_create("vcap-mock", MFD_CLOEXEC);
+
+			if (-1 == device.memfd || -1 == ftruncate(device.memfd, device.mappingSize)) {
+				freeBuffers(device);
+				return fail(ENOMEM);
+			}
+
+			void* memory = mmap(NULL, device.mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, device.memfd, 0);
+
+			if (MAP_FAILED == memory) {
+				freeBuffers(device);
+				return fail(ENOMEM);
+			}
+
+			device.mapping = (std::uint8_t*)memory;
+		}
+
+		device.buffers.resize(count);
+
+		for (std::uint32_t i = 0; i < count; i++) {
+			MockBuffer& buffer = device.buffers[i];
+			std::memset(&buffer, 0, sizeof(buffer));
+
+			if (V4L2_MEMORY_MMAP == req->memory) {
+				buffer.offset = i * length;
+				buffer.length = length;
+				buffer.data = device.mapping + buffer.offset;
+			}
+		}
+
+		req->count = count;
+
+		return 0;
+	}
+
+	int queueBuffer(MockDevice& device, struct v4l2_buffer* buf) {
+		if (buf->index >= device.buffers.size() || buf->memory != device.memoryType)
+			return fail(EINVAL);
+
+		MockBuffer& buffer = device.buffers[buf->index];
+
+		if (buffer.queued)
+			return fail(EINVAL);
+
+		if (V4L2_MEMORY_USERPTR == device.memoryType) {
+			if (!buf->m.userptr || buf->length < imageSize(device.code, device.width, device.height))
+				return fail(EINVAL);
+
+			buffer.data = (std::uint8_t*)buf->m.userptr;
+			buffer.length = buf->length;
+		}
+
+		buffer.queued = true;
+		device.queue.push_back(buf->index);
+
+		fillBuffer(device, buf->index, *buf);
+
+		return 0;
+	}
+
+	/*
+	 * Completes the pending frame into the oldest queued buffer. The device lock is not held while waiting, so other
+	 * threads can keep re-queueing buffers.
+	 */
+	int dequeueBuffer(std::shared_ptr<MockDevice> device, std::unique_lock<std::mutex>& lock,
+			struct v4l2_buffer* buf) {
+		if (!device->streaming)
+			return fail(EINVAL);
+
+		if (device->queue.empty())
+			return fail(EAGAIN);
+
+		lock.unlock();
+
+		bool ready = waitFrame(device->fd);
+		int error = errno;
+
+		lock.lock();
+
+		if (!ready)
+			return fail(error);
+
+		if (!device->streaming || device->queue.empty())
+			return fail(EINVAL);
+
+		std::uint32_t index = device->queue.front();
+		device->queue.pop_front();
+
+		MockBuffer& buffer = device->buffers[index];
+
+		render(*device, buffer.data);
+
+		buffer.queued = false;
+		buffer.bytesused = imageSize(device->code, device->width, device->height);
+		buffer.sequence = device->sequence;
+		setTimestamp(buffer.timestamp, device->captured);
+
+		armTimer(*device);
+
+		std::memset(buf, 0, sizeof(*buf));
+		fillBuffer(*device, index, *buf);
+
+		return 0;
+	}
+
+	int queryControl(struct v4l2_queryctrl* ctrl) {
+		std::uint32_t id = ctrl->id;
+		const MockControl* control = NULL;
+
+		if (id & V4L2_CTRL_FLAG_NEXT_CTRL) {
+			id &= ~(V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND);
+
+			for (std::size_t i = 0; i < NUM_CONTROLS; i++) {
+				if (CONTROLS[i].id > id && (!control || CONTROLS[i].id < control->id))
+					control = &CONTROLS[i];
+			}
+		} else {
+			for (std::size_t i = 0; i < NUM_CONTROLS; i++) {
+				if (CONTROLS[i].id == id)
+					control = &CONTROLS[i];
+			}
+		}
+
+		if (!control)
+			return fail(EINVAL);
+
+		std::memset(ctrl, 0, sizeof(*ctrl));
+		ctrl->id = control->id;
+		ctrl->type = V4L2_CTRL_TYPE_INTEGER;
+		std::strncpy((char*)ctrl->name, control->name, sizeof(ctrl->name) - 1);
+		ctrl->minimum = control->min;
+		ctrl->maximum = control->max;
+		ctrl->step = 1;
+		ctrl->default_value = control->defaultValue;
+
+		return 0;
+	}
+
+	std::int32_t* findControl(MockDevice& device, std::uint32_t id, const MockControl** control) {
+		for (std::size_t i = 0; i < NUM_CONTROLS; i++) {
+			if (CONTROLS[i].id == id) {
+				*control = &CONTROLS[i];
+				return &device.controls[i];
+			}
+		}
+
+		return NULL;
+	}
+
+	int setControl(MockDevice& device, std::uint32_t id, std::int32_t value) {
+		const MockControl* control;
+		std::int32_t* current = findControl(device, id, &control);
+
+		if (!current)
+			return fail(EINVAL);
+
+		*current = std::max(control->min, std::min(control->max, value));
+
+		return 0;
+	}
+
+	int extControls(MockDevice& device, struct v4l2_ext_controls* ext, bool set) {
+		for (std::uint32_t i = 0; i < ext->count; i++) {
+			const MockControl* control;
+			std::int32_t* current = findControl(device, ext->controls[i].id, &control);
+
+			if (!current) {
+				ext->error_idx = i;
+				return fail(EINVAL);
+			}
+
+			if (set)
+				*current = std::max(control->min, std::min(control->max, ext->controls[i].value));
+			else
+				ext->controls[i].value = *current;
+		}
+
+		return 0;
+	}
+
+	const MockFormat* findFormat(std::uint32_t code) {
+		for (const MockFormat& format : config.formats) {
+			if (format.code == code)
+				return &format;
+		}
+
+		return NULL;
+	}
+
+	std::uint16_t nearestRate(std::uint32_t numerator, std::uint32_t denominator) {
+		double wanted = numerator ? (double)denominator / numerator : config.frameRates[0];
+		std::uint16_t best = config.frameRates[0];
+
+		for (std::uint16_t rate : config.frameRates) {
+			if (std::abs(rate - wanted) < std::abs(best - wanted))
+				best = rate;
+		}
+
+		return best;
+	}
+
+	int mockIoctl(int fd, unsigned long request, void* arg) {
+		std::shared_ptr<MockDevice> device = findDevice(fd);
+		std::unique_lock<std::mutex> lock(device->mutex);
+
+		switch (request) {
+			case VIDIOC_QUERYCAP: {
+				struct v4l2_capability* cap = (struct v4l2_capability*)arg;
+				std::memset(cap, 0, sizeof(*cap));
+
+				std::strncpy((char*)cap->driver, "vcap-mock", sizeof(cap->driver) - 1);
+				std::strncpy((char*)cap->card, "Vcap Mock Camera", sizeof(cap->card) - 1);
+				std::snprintf((char*)cap->bus_info, sizeof(cap->bus_info), "mock:%u", device->index);
+
+				cap->version = (1 << 16);
+				cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING | V4L2_CAP_READWRITE;
+				cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+
+				return 0;
+			}
+			case VIDIOC_ENUMINPUT: {
+				struct v4l2_input* input = (struct v4l2_input*)arg;
+
+				if (0 != input->index)
+					return fail(EINVAL);
+
+				std::memset(input, 0, sizeof(*input));
+				std::strncpy((char*)input->name, "Camera", sizeof(input->name) - 1);
+				input->type = V4L2_INPUT_TYPE_CAMERA;
+
+				return 0;
+			}
+			case VIDIOC_G_INPUT:
+				*(int*)arg = 0;
+				return 0;
+			case VIDIOC_S_INPUT:
+				return 0 == *(int*)arg ? 0 : fail(EINVAL);
+			case VIDIOC_ENUM_FMT: {
+				struct v4l2_fmtdesc* desc = (struct v4l2_fmtdesc*)arg;
+
+				if (V4L2_BUF_TYPE_VIDEO_CAPTURE != desc->type || desc->index >= config.formats.size())
+					return fail(EINVAL);
+
+				std::uint32_t index = desc->index;
+
+				std::memset(desc, 0, sizeof(*desc));
+				desc->index = index;
+				desc->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+				desc->pixelformat = config.formats[index].code;
+				std::strncpy((char*)desc->description, description(desc->pixelformat), sizeof(desc->description) - 1);
+
+				return 0;
+			}
+			case VIDIOC_ENUM_FRAMESIZES: {
+				struct v4l2_frmsizeenum* size = (struct v4l2_frmsizeenum*)arg;
+				const MockFormat* format = findFormat(size->pixel_format);
+
+				if (!format || size->index >= format->sizes.size())
+					return fail(EINVAL);
+
+				size->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+				size->discrete.width = format->sizes[size->index].width;
+				size->discrete.height = format->sizes[size->index].height;
+
+				return 0;
+			}
+			case VIDIOC_ENUM_FRAMEINTERVALS: {
+				struct v4l2_frmivalenum* interval = (struct v4l2_frmivalenum*)arg;
+				const MockFormat* format = findFormat(interval->pixel_format);
+
+				if (!format || interval->index >= config.frameRates.size())
+					return fail(EINVAL);
+
+				bool found = false;
+
+				for (const MockSize& size : format->sizes)
+					found = found || (size.width == interval->width && size.height == interval->height);
+
+				if (!found)
+					return fail(EINVAL);
+
+				interval->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+				interval->discrete.numerator = 1;
+				interval->discrete.denominator = config.frameRates[interval->index];
+
+				return 0;
+			}
+			case VIDIOC_G_FMT: {
+				struct v4l2_format* fmt = (struct v4l2_format*)arg;
+
+				if (V4L2_BUF_TYPE_VIDEO_CAPTURE != fmt->type)
+					return fail(EINVAL);
+
+				fillPixFormat(*device, fmt->fmt.pix);
+
+				return 0;
+			}
+			case VIDIOC_S_FMT:
+			case VIDIOC_TRY_FMT: {
+				struct v4l2_format* fmt = (struct v4l2_format*)arg;
+
+				if (V4L2_BUF_TYPE_VIDEO_CAPTURE != fmt->type)
+					return fail(EINVAL);
+
+				std::uint32_t code = fmt->fmt.pix.pixelformat;
+				std::uint32_t width = fmt->fmt.pix.width;
+				std::uint32_t height = fmt->fmt.pix.height;
+
+				chooseFormat(code, width, height);
+
+				MockDevice adjusted;
+				adjusted.code = code;
+				adjusted.width = width;
+				adjusted.height = height;
+
+				if (VIDIOC_S_FMT == request) {
+					if (!device->buffers.empty() || device->reading)
+						return fail(EBUSY);
+
+					device->code = code;
+					device->width = width;
+					device->height = height;
+				}
+
+				fillPixFormat(adjusted, fmt->fmt.pix);
+
+				return 0;
+			}
+			case VIDIOC_G_PARM:
+			case VIDIOC_S_PARM: {
+				struct v4l2_streamparm* parm = (struct v4l2_streamparm*)arg;
+
+				if (V4L2_BUF_TYPE_VIDEO_CAPTURE != parm->type)
+					return fail(EINVAL);
+
+				if (VIDIOC_S_PARM == request) {
+					if (device->streaming)
+						return fail(EBUSY);
+
+					device->frameRate = nearestRate(parm->parm.capture.timeperframe.numerator,
+							parm->parm.capture.timeperframe.denominator);
+				}
+
+				std::memset(&parm->parm, 0, sizeof(parm->parm));
+				parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+				parm->parm.capture.timeperframe.numerator = 1;
+				parm->parm.capture.timeperframe.denominator = device->frameRate;
+				parm->parm.capture.readbuffers = MIN_BUFFERS;
+
+				return 0;
+			}
+			case VIDIOC_REQBUFS:
+				return requestBuffers(*device, (struct v4l2_requestbuffers*)arg);
+			case VIDIOC_QUERYBUF: {
+				struct v4l2_buffer* buf = (struct v4l2_buffer*)arg;
+
+				if (V4L2_BUF_TYPE_VIDEO_CAPTURE != buf->type || buf->index >= device->buffers.size())
+					return fail(EINVAL);
+
+				fillBuffer(*device, buf->index, *buf);
+
+				return 0;
+			}
+			case VIDIOC_QBUF:
+				return queueBuffer(*device, (struct v4l2_buffer*)arg);
+			case VIDIOC_DQBUF:
+				return dequeueBuffer(device, lock, (struct v4l2_buffer*)arg);
+			case VIDIOC_STREAMON:
+				if (device->buffers.empty() || device->reading)
+					return fail(EINVAL);
+
+				if (!device->streaming) {
+					device->streaming = true;
+					startTimer(*device);
+				}
+
+				return 0;
+			case VIDIOC_STREAMOFF:
+				device->streaming = false;
+				stopTimer(*device);
+
+				//every buffer returns to the application
+				for (MockBuffer& buffer : device->buffers)
+					buffer.queued = false;
+
+				device->queue.clear();
+
+				return 0;
+			case VIDIOC_QUERYCTRL:
+				return queryControl((struct v4l2_queryctrl*)arg);
+			case VIDIOC_G_CTRL: {
+				struct v4l2_control* ctrl = (struct v4l2_control*)arg;
+				const MockControl* control;
+				std::int32_t* value = findControl(*device, ctrl->id, &control);
+
+				if (!value)
+					return fail(EINVAL);
+
+				ctrl->value = *value;
+
+				return 0;
+			}
+			case VIDIOC_S_CTRL: {
+				struct v4l2_control* ctrl = (struct v4l2_control*)arg;
+
+				return setControl(*device, ctrl->id, ctrl->value);
+			}
+			case VIDIOC_G_EXT_CTRLS:
+			case VIDIOC_S_EXT_CTRLS:
+			case VIDIOC_TRY_EXT_CTRLS:
+				return extControls(*device, (struct v4l2_ext_controls*)arg, VIDIOC_S_EXT_CTRLS == request);
+			default:
+				return fail(ENOTTY);
+		}
+	}
+
+	/*
+	 * read() I/O: the first read starts capture and each read returns one frame.
+	 */
+	ssize_t mockRead(int fd, void* data, std::size_t count) {
+		std::shared_ptr<MockDevice> device = findDevice(fd);
+		std::unique_lock<std::mutex> lock(device->mutex);
+
+		if (device->streaming || !device->buffers.empty())
+			return fail(EBUSY);
+
+		if (!device->reading) {
+			device->reading = true;
+			startTimer(*device);
+		}
+
+		lock.unlock();
+
+		bool ready = waitFrame(fd);
+		int error = errno;
+
+		lock.lock();
+
+		if (!ready)
+			return fail(error);
+
+		std::size_t size = imageSize(device->code, device->width, device->height);
+		std::vector<std::uint8_t> frame(size);
+
+		render(*device, frame.data());
+		armTimer(*device);
+
+		count = std::min(count, size);
+		std::memcpy(data, frame.data(), count);
+
+		return (ssize_t)count;
+	}
+
+	int mockOpen(int index, int flags) {
+		int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | ((flags & O_NONBLOCK) ? TFD_NONBLOCK : 0));
+
+		if (-1 == fd)
+			return -1;
+
+		std::shared_ptr<MockDevice> device = std::make_shared<MockDevice>();
+
+		device->fd = fd;
+		device->index = (unsigned int)index;
+		device->code = config.formats[0].code;
+		device->width = config.formats[0].sizes[0].width;
+		device->height = config.formats[0].sizes[0].height;
+		device->frameRate = config.frameRates[0];
+		device->memoryType = V4L2_MEMORY_MMAP;
+		device->memfd = -1;
+		device->mapping = NULL;
+		device->mappingSize = 0;
+		device->streaming = false;
+		device->reading = false;
+		device->sequence = 0;
+		device->deadline = 0;
+		device->captured = 0;
+		device->random = 0x9E3779B97F4A7C15ull + index;
+
+		for (std::size_t i = 0; i < NUM_CONTROLS; i++)
+			device->controls[i] = CONTROLS[i].defaultValue;
+
+		std::lock_guard<std::mutex> lock(devicesMutex);
+
+		devices[fd] = device;
+
+		return fd;
+	}
+
+	void mockClose(int fd) {
+		std::shared_ptr<MockDevice> device;
+
+		{
+			std::lock_guard<std::mutex> lock(devicesMutex);
+
+			std::map<int, std::shared_ptr<MockDevice>>::iterator it = devices.find(fd);
+
+			if (devices.end() == it)
+				return;
+
+			device = it->second;
+			devices.erase(it);
+		}
+
+		std::lock_guard<std::mutex> lock(device->mutex);
+
+		device->streaming = false;
+		freeBuffers(*device);
+	}
+
+	void* mockMmap(void* addr, std::size_t length, int prot, int flags, int fd, off64_t offset) {
+		static Mmap64Func realMmap = next<Mmap64Func>("mmap64");
+
+		std::shared_ptr<MockDevice> device = findDevice(fd);
+		std::lock_guard<std::mutex> lock(device->mutex);
+
+		if (-1 == device->memfd || offset < 0 || (std::size_t)offset + length > device->mappingSize) {
+			errno = EINVAL;
+			return MAP_FAILED;
+		}
+
+		return realMmap(addr, length, prot, flags, device->memfd, offset);
+	}
+
+	bool needsMode(int flags) {
+		return (flags & O_CREAT) || O_TMPFILE == (flags & O_TMPFILE);
+	}
+
+	void fakeStat(int index, struct stat* buf) {
+		std::memset(buf, 0, sizeof(*buf));
+		buf->st_mode = S_IFCHR | 0660;
+		buf->st_rdev = makedev(VIDEO_MAJOR, index);
+	}
+
+	void fakeStat64(int index, struct stat64* buf) {
+		std::memset(buf, 0, sizeof(*buf));
+		buf->st_mode = S_IFCHR | 0660;
+		buf->st_rdev = makedev(VIDEO_MAJOR, index);
+	}
+}
+
+/*
+ * Intercepted entry points
+ */
+extern "C" {
+
+int open(const char* path, int flags, ...) {
+	static OpenFunc realOpen = next<OpenFunc>("open");
+
+	int index = deviceIndex(path);
+
+	if (-1 != index)
+		return mockOpen(index, flags);
+
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = needsMode(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+
+	return realOpen(path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...) {
+	static OpenFunc realOpen = next<OpenFunc>("open64");
+
+	int index = deviceIndex(path);
+
+	if (-1 != index)
+		return mockOpen(index, flags);
+
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = needsMode(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+
+	return realOpen(path, flags, mode);
+}
+
+int openat(int dirfd, const char* path, int flags, ...) {
+	static OpenatFunc realOpenat = next<OpenatFunc>("openat");
+
+	int index = deviceIndex(path);
+
+	if (-1 != index)
+		return mockOpen(index, flags);
+
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = needsMode(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+
+	return realOpenat(dirfd, path, flags, mode);
+}
+
+int close(int fd) {
+	static CloseFunc realClose = next<CloseFunc>("close");
+
+	mockClose(fd);
+
+	return realClose(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+	static IoctlFunc realIoctl = next<IoctlFunc>("ioctl");
+
+	va_list args;
+	va_start(args, request);
+	void* arg = va_arg(args, void*);
+	va_end(args);
+
+	if (findDevice(fd))
+		return mockIoctl(fd, request, arg);
+
+	return realIoctl(fd, request, arg);
+}
+
+ssize_t read(int fd, void* data, std::size_t count) {
+	static ReadFunc realRead = next<ReadFunc>("read");
+
+	if (findDevice(fd))
+		return mockRead(fd, data, count);
+
+	return realRead(fd, data, count);
+}
+
+void* mmap(void* addr, std::size_t length, int prot, int flags, int fd, off_t offset) {
+	static MmapFunc realMmap = next<MmapFunc>("mmap");
+
+	if (-1 != fd && findDevice(fd))
+		return mockMmap(addr, length, prot, flags, fd, offset);
+
+	return realMmap(addr, length, prot, flags, fd, offset);
+}
+
+void* mmap64(void* addr, std::size_t length, int prot, int flags, int fd, off64_t offset) {
+	static Mmap64Func realMmap = next<Mmap64Func>("mmap64");
+
+	if (-1 != fd && findDevice(fd))
+		return mockMmap(addr, length, prot, flags, fd, offset);
+
+	return realMmap(addr, length, prot, flags, fd, offset);
+}
+
+int stat(const char* path, struct stat* buf) {
+	static StatFunc realStat = next<StatFunc>("stat");
+
+	int index = deviceIndex(path);
+
+	if (-1 == index)
+		return realStat(path, buf);
+
+	fakeStat(index, buf);
+
+	return 0;
+}
+
+int stat64(const char* path, struct stat64* buf) {
+	static Stat64Func realStat = next<Stat64Func>("stat64");
+
+	int index = deviceIndex(path);
+
+	if (-1 == index)
+		return realStat(path, buf);
+
+	fakeStat64(index, buf);
+
+	return 0;
+}
+
+/*
+ * Binaries built against glibc before 2.33 call these instead of stat().
+ */
+int __xstat(int version, const char* path, struct stat* buf) {
+	static XstatFunc realStat = next<XstatFunc>("__xstat");
+
+	int index = deviceIndex(path);
+
+	if (-1 == index)
+		return realStat(version, path, buf);
+
+	fakeStat(index, buf);
+
+	return 0;
+}
+
+int __xstat64(int version, const char* path, struct stat64* buf) {
+	static Xstat64Func realStat = next<Xstat64Func>("__xstat64");
+
+	int index = deviceIndex(path);
+
+	if (-1 == index)
+		return realStat(version, path, buf);
+
+	fakeStat64(index, buf);
+
+	return 0;
+}
+
+int access(const char* path, int mode) {
+	static AccessFunc realAccess = next<AccessFunc>("access");
+
+	if (-1 != deviceIndex(path))
+		return 0;
+
+	return realAccess(path, mode);
+}
+
+/*
+ * libv4l2 entry points, used by libvcap when it is built against libv4l2. libv4l2 issues its own system calls
+ * directly, so they have to be intercepted here rather than in libc.
+ */
+int v4l2_open(const char* path, int flags, ...) {
+	static OpenFunc realOpen = next<OpenFunc>("v4l2_open");
+
+	int index = deviceIndex(path);
+
+	if (-1 != index)
+		return mockOpen(index, flags);
+
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = needsMode(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+
+	return realOpen ? realOpen(path, flags, mode) : fail(ENOSYS);
+}
+
+int v4l2_close(int fd) {
+	static CloseFunc realClose = next<CloseFunc>("v4l2_close");
+
+	if (findDevice(fd))
+		return close(fd);
+
+	return realClose ? realClose(fd) : fail(ENOSYS);
+}
+
+int v4l2_ioctl(int fd, unsigned long request, ...) {
+	static IoctlFunc realIoctl = next<IoctlFunc>("v4l2_ioctl");
+
+	va_list args;
+	va_start(args, request);
+	void* arg = va_arg(args, void*);
+	va_end(args);
+
+	if (findDevice(fd))
+		return mockIoctl(fd, request, arg);
+
+	return realIoctl ? realIoctl(fd, request, arg) : fail(ENOSYS);
+}
+
+ssize_t v4l2_read(int fd, void* data, std::size_t count) {
+	static ReadFunc realRead = next<ReadFunc>("v4l2_read");
+
+	if (findDevice(fd))
+		return mockRead(fd, data, count);
+
+	return realRead ? realRead(fd, data, count) : fail(ENOSYS);
+}
+
+void* v4l2_mmap(void* addr, std::size_t length, int prot, int flags, int fd, off64_t offset) {
+	static Mmap64Func realMmap = next<Mmap64Func>("v4l2_mmap");
+
+	if (-1 != fd && findDevice(fd))
+		return mockMmap(addr, length, prot, flags, fd, offset);
+
+	if (!realMmap) {
+		errno = ENOSYS;
+		return MAP_FAILED;
+	}
+
+	return realMmap(addr, length, prot, flags, fd, offset);
+}
+
+int v4l2_munmap(void* addr, std::size_t length) {
+	return munmap(addr, length);
+}
+
+}
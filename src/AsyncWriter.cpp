@@ -0,0 +1,727 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/AsyncWriter.hpp>
+
+#include "FrameSize.hpp"
+#include "RecordFormat.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef VCAP_HAVE_URING
+#include <liburing.h>
+#endif
+
+/*
+ * Writes are multiples of this and start at multiples of it, as O_DIRECT requires.
+ */
+static const std::size_t BLOCK_SIZE = 4096;
+
+/*
+ * Room kept at the end of each buffer for the padding record that rounds it up to a block.
+ */
+static const std::size_t BUFFER_SLACK = 2 * BLOCK_SIZE;
+
+/*
+ * Most buffers submitted to io_uring at once.
+ */
+static const unsigned int URING_DEPTH = 8;
+
+static const std::size_t NO_SEGMENT = (std::size_t)-1;
+
+static std::size_t alignUp(std::size_t value, std::size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * A staging buffer: whole records destined for one block-aligned write at the given offset of a segment.
+ */
+struct Vcap::AsyncWriter::Buffer {
+	std::uint8_t* data;
+	std::size_t used;
+
+	std::size_t segment;
+	std::uint64_t offset;
+
+	std::vector<FrameIndexEntry> index;
+};
+
+/*
+ * Async writer class definition
+ */
+Vcap::AsyncWriter::AsyncWriter(const std::string& prefix, const Format& format, std::size_t segmentSize,
+		std::uint16_t frameRate, OverflowPolicy policy, std::size_t bufferSize, std::size_t bufferCount)
+		throw (RuntimeError) : _prefix(prefix), _segmentSize(segmentSize), _policy(policy), _frameRate(frameRate),
+		_current(NULL), _segment(0), _segmentOffset(0), _closed(false), _inFlight(0), _stopping(false), _error(0),
+		_uring(false), _frames(0), _dropped(0), _stalls(0), _written(0), _maxQueued(0), _fd(-1), _direct(false),
+		_openSegment(NO_SEGMENT), _dataEnd(0) {
+	if (bufferCount < 2)
+		throw RuntimeError("Async writer requires at least two buffers");
+
+	Format fmt = format;
+
+	_code = fmt.code();
+	_width = fmt.size().width();
+	_height = fmt.size().height();
+
+	std::size_t frameSize = frameBytes(_code, _width, _height);
+
+	_bufferSize = alignUp(std::max(bufferSize, sizeof(RecordingHeader) + sizeof(RecordHeader) + frameSize +
+			BUFFER_SLACK), BLOCK_SIZE);
+
+	_memorySize = bufferCount * _bufferSize;
+	_memory = (std::uint8_t*)mmap(NULL, _memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+			MAP_POPULATE, -1, 0);
+
+	if (MAP_FAILED == _memory)
+		throw RuntimeError(std::string("Unable to allocate writer buffers: ") + std::strerror(errno));
+
+	_buffers.resize(bufferCount);
+	_free.reserve(bufferCount);
+
+	for (std::size_t i = 0; i < bufferCount; i++) {
+		_buffers[i].data = _memory + i * _bufferSize;
+		_buffers[i].used = 0;
+		_buffers[i].segment = 0;
+		_buffers[i].offset = 0;
+		_buffers[i].index.reserve(64);
+
+		_free.push_back(&_buffers[i]);
+	}
+
+	try {
+		_thread = std::thread(&AsyncWriter::run, this);
+	} catch (std::system_error& e) {
+		munmap(_memory, _memorySize);
+		throw RuntimeError(std::string("Unable to start writer thread: ") + e.what());
+	}
+}
+
+Vcap::AsyncWriter::~AsyncWriter() {
+	try {
+		close();
+	} catch (RuntimeError& e) {
+		//nothing more can be done from a destructor
+	}
+
+	munmap(_memory, _memorySize);
+}
+
+bool Vcap::AsyncWriter::write(const Frame& frame) throw (RuntimeError) {
+	Plane parts[MAX_PLANES];
+	unsigned int numParts = frame.numPlanes();
+
+	for (unsigned int i = 0; i < numParts; i++)
+		parts[i] = frame.plane(i);
+
+	return append(RECORD_FRAME, frame.timestamp(), frame.sequence(), parts, numParts);
+}
+
+bool Vcap::AsyncWriter::write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp,
+		std::uint32_t sequence) throw (RuntimeError) {
+	Plane part;
+	part.data = (std::uint8_t*)data;
+	part.size = size;
+	part.stride = 0;
+
+	return append(RECORD_FRAME, timestamp, sequence, &part, 1);
+}
+
+bool Vcap::AsyncWriter::mark(std::uint64_t timestamp, std::uint32_t id) throw (RuntimeError) {
+	MarkerRecord marker;
+	marker.id = id;
+	marker.reserved = 0;
+
+	Plane part;
+	part.data = (std::uint8_t*)&marker;
+	part.size = sizeof(marker);
+	part.stride = 0;
+
+	return append(RECORD_MARKER, timestamp, 0, &part, 1);
+}
+
+void Vcap::AsyncWriter::flush() throw (RuntimeError) {
+	check();
+	seal();
+
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		_bufferFree.wait(lock, [this] { return _queue.empty() && 0 == _inFlight; });
+	}
+
+	check();
+}
+
+void Vcap::AsyncWriter::close() throw (RuntimeError) {
+	if (_closed)
+		return;
+
+	seal();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_stopping = true;
+	}
+
+	_queueReady.notify_one();
+	_thread.join();
+
+	_closed = true;
+
+	int error = _error.load();
+
+	if (error)
+		throw RuntimeError("Unable to write " + _prefix + ": " + std::strerror(error));
+}
+
+std::string Vcap::AsyncWriter::segmentPath(std::size_t segment) const {
+	return logSegmentPath(_prefix, segment);
+}
+
+bool Vcap::AsyncWriter::uring() const {
+	return _uring.load();
+}
+
+Vcap::AsyncWriterStats Vcap::AsyncWriter::stats() {
+	AsyncWriterStats stats;
+
+	stats.frames = _frames.load(std::memory_order_relaxed);
+	stats.dropped = _dropped.load(std::memory_order_relaxed);
+	stats.stalls = _stalls.load(std::memory_order_relaxed);
+	stats.written = _written.load(std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	stats.queued = _queue.size() + _inFlight;
+	stats.maxQueued = _maxQueued;
+
+	return stats;
+}
+
+/*
+ * Copies a record into the current buffer, handing the buffer to the writer when the record does not fit. Returns
+ * false if the record was dropped for lack of a free buffer.
+ */
+bool Vcap::AsyncWriter::append(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence,
+		const Plane* parts, unsigned int numParts) throw (RuntimeError) {
+	check();
+
+	std::size_t size = 0;
+
+	for (unsigned int i = 0; i < numParts; i++)
+		size += parts[i].size;
+
+	std::size_t recordSize = alignUp(sizeof(RecordHeader) + size, RECORD_ALIGNMENT);
+
+	if (sizeof(RecordingHeader) + recordSize + BUFFER_SLACK > _bufferSize)
+		throw RuntimeError("Frame is too large for writer " + _prefix);
+
+	if (_current && _current->used + recordSize + BUFFER_SLACK > _bufferSize)
+		seal();
+
+	if (!_current) {
+		_current = acquire();
+
+		if (!_current) {
+			if (RECORD_FRAME == type)
+				_dropped.fetch_add(1, std::memory_order_relaxed);
+
+			return false;
+		}
+	}
+
+	std::uint8_t* record = _current->data + _current->used;
+
+	RecordHeader header;
+	header.type = type;
+	header.recordSize = (std::uint32_t)recordSize;
+	header.timestamp = timestamp;
+	header.sequence = sequence;
+	header.size = (std::uint32_t)size;
+
+	std::memcpy(record, &header, sizeof(header));
+
+	std::uint8_t* out = record + sizeof(header);
+
+	for (unsigned int i = 0; i < numParts; i++) {
+		std::memcpy(out, parts[i].data, parts[i].size);
+		out += parts[i].size;
+	}
+
+	std::memset(out, 0, recordSize - sizeof(header) - size);
+
+	if (RECORD_FRAME == type) {
+		FrameIndexEntry entry;
+		entry.timestamp = timestamp;
+		entry.offset = _current->offset + _current->used;
+		entry.sequence = sequence;
+		entry.size = (std::uint32_t)size;
+
+		_current->index.push_back(entry);
+
+		_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	_current->used += recordSize;
+
+	return true;
+}
+
+/*
+ * Takes a free buffer and places it after the last one, starting a new segment (and writing its header) when the
+ * current one is full. Returns NULL if no buffer is free and frames are being dropped.
+ */
+Vcap::AsyncWriter::Buffer* Vcap::AsyncWriter::acquire() {
+	Buffer* buffer;
+
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		if (_free.empty()) {
+			if (OVERFLOW_DROP == _policy)
+				return NULL;
+
+			_stalls.fetch_add(1, std::memory_order_relaxed);
+			_bufferFree.wait(lock, [this] { return !_free.empty(); });
+		}
+
+		buffer = _free.back();
+		_free.pop_back();
+	}
+
+	buffer->used = 0;
+	buffer->index.clear();
+
+	if (_segmentOffset > 0 && _segmentOffset + _bufferSize > _segmentSize) {
+		_segment++;
+		_segmentOffset = 0;
+	}
+
+	buffer->segment = _segment;
+	buffer->offset = _segmentOffset;
+
+	if (0 == _segmentOffset) {
+		RecordingHeader header;
+		initRecordingHeader(header, _code, _width, _height, _frameRate);
+
+		std::memcpy(buffer->data, &header, sizeof(header));
+		buffer->used = sizeof(header);
+	}
+
+	return buffer;
+}
+
+/*
+ * Pads the current buffer to a whole number of blocks and queues it for writing.
+ */
+void Vcap::AsyncWriter::seal() {
+	if (!_current)
+		return;
+
+	Buffer* buffer = _current;
+	_current = NULL;
+
+	if (0 != buffer->used % BLOCK_SIZE) {
+		std::size_t end = alignUp(buffer->used + sizeof(RecordHeader), BLOCK_SIZE);
+
+		RecordHeader header;
+		header.type = RECORD_PADDING;
+		header.recordSize = (std::uint32_t)(end - buffer->used);
+		header.timestamp = 0;
+		header.sequence = 0;
+		header.size = 0;
+
+		std::memcpy(buffer->data + buffer->used, &header, sizeof(header));
+		std::memset(buffer->data + buffer->used + sizeof(header), 0, header.recordSize - sizeof(header));
+
+		buffer->used = end;
+	}
+
+	_segmentOffset += buffer->used;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_queue.push_back(buffer);
+		_maxQueued = std::max(_maxQueued, _queue.size() + _inFlight);
+	}
+
+	_queueReady.notify_one();
+}
+
+void Vcap::AsyncWriter::check() throw (RuntimeError) {
+	if (_closed)
+		throw RuntimeError("Writer " + _prefix + " is closed");
+
+	int error = _error.load();
+
+	if (error)
+		throw RuntimeError("Unable to write " + _prefix + ": " + std::strerror(error));
+}
+
+/*
+ * Writer thread. After an error, buffers are still taken off the queue (and discarded) so the producer never waits
+ * forever.
+ */
+void Vcap::AsyncWriter::run() {
+#ifdef VCAP_HAVE_URING
+	runUring();
+#endif
+
+	runThread();
+	closeSegment();
+}
+
+/*
+ * Writes buffers one at a time with pwrite().
+ */
+void Vcap::AsyncWriter::runThread() {
+	while (true) {
+		Buffer* buffer;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			_queueReady.wait(lock, [this] { return !_queue.empty() || _stopping; });
+
+			if (_queue.empty())
+				break;
+
+			buffer = _queue.front();
+			_queue.pop_front();
+			_inFlight++;
+		}
+
+		if (0 == _error.load() && buffer->segment != _openSegment)
+			openSegment(buffer->segment);
+
+		if (0 == _error.load())
+			writeBuffer(buffer, 0);
+
+		completed(buffer);
+	}
+}
+
+/*
+ * Keeps up to URING_DEPTH buffers in flight through io_uring. A new segment is opened only once the writes to the
+ * previous one have completed. Returns early (leaving the rest to runThread()) if io_uring is unavailable or fails.
+ */
+bool Vcap::AsyncWriter::runUring() {
+#ifdef VCAP_HAVE_URING
+	struct io_uring ring;
+
+	unsigned int depth = (unsigned int)std::min(_buffers.size(), (std::size_t)URING_DEPTH);
+
+	//e.g. an older kernel, or io_uring disabled by policy
+	if (io_uring_queue_init(depth, &ring, 0) < 0)
+		return false;
+
+	_uring = true;
+
+	//buffers the kernel holds, so they can be handed back if the ring breaks
+	Buffer* inFlight[URING_DEPTH];
+	unsigned int pending = 0;
+	bool ok = true;
+
+	auto removeInFlight = [&inFlight, &pending](Buffer* buffer) {
+		for (unsigned int i = 0; i < pending; i++) {
+			if (inFlight[i] == buffer) {
+				inFlight[i] = inFlight[--pending];
+				break;
+			}
+		}
+	};
+
+	while (ok) {
+		Buffer* batch[URING_DEPTH];
+		unsigned int count = 0;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			if (0 == pending)
+				_queueReady.wait(lock, [this] { return !_queue.empty() || _stopping; });
+
+			if (0 == pending && _queue.empty())
+				break;
+
+			while (!_queue.empty() && pending + count < depth) {
+				Buffer* buffer = _queue.front();
+				std::size_t segment = count ? batch[0]->segment : _openSegment;
+
+				if (buffer->segment != segment && (pending || count))
+					break;
+
+				batch[count++] = buffer;
+				_queue.pop_front();
+				_inFlight++;
+			}
+		}
+
+		if (count && 0 == _error.load() && batch[0]->segment != _openSegment)
+			openSegment(batch[0]->segment);
+
+		unsigned int submitted = 0;
+
+		for (unsigned int i = 0; i < count; i++) {
+			if (0 != _error.load()) {
+				completed(batch[i]);
+				continue;
+			}
+
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+
+			io_uring_prep_write(sqe, _fd, batch[i]->data, (unsigned int)batch[i]->used, batch[i]->offset);
+			io_uring_sqe_set_data(sqe, batch[i]);
+
+			batch[submitted++] = batch[i];
+		}
+
+		if (submitted) {
+			int result = io_uring_submit(&ring);
+
+			if (result < 0) {
+				fail(-result);
+
+				for (unsigned int i = 0; i < submitted; i++)
+					completed(batch[i]);
+
+				ok = false;
+			} else {
+				for (unsigned int i = 0; i < submitted; i++)
+					inFlight[pending++] = batch[i];
+			}
+		}
+
+		while (ok && pending) {
+			struct io_uring_cqe* cqe;
+
+			int result = io_uring_wait_cqe(&ring, &cqe);
+
+			if (-EINTR == result)
+				continue;
+
+			if (result < 0) {
+				fail(-result);
+				ok = false;
+				break;
+			}
+
+			Buffer* buffer = (Buffer*)io_uring_cqe_get_data(cqe);
+			int written = cqe->res;
+
+			io_uring_cqe_seen(&ring, cqe);
+			removeInFlight(buffer);
+
+			if (written > 0)
+				_written.fetch_add(written, std::memory_order_relaxed);
+
+			//a short write, or O_DIRECT refused: finish synchronously
+			if (written < 0 && -EINVAL != written)
+				fail(-written);
+			else if (written < 0 || (std::size_t)written < buffer->used)
+				writeBuffer(buffer, written < 0 ? 0 : written);
+
+			completed(buffer);
+
+			//keep the ring full while the queue has work
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (!_queue.empty())
+				break;
+		}
+	}
+
+	if (pending) {
+		//cancel whatever the kernel still holds and reap it, so nothing is touching the buffers once they are free
+		for (unsigned int i = 0; i < pending; i++) {
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+
+			if (!sqe)
+				break;
+
+			io_uring_prep_cancel(sqe, inFlight[i], 0);
+			io_uring_sqe_set_data(sqe, NULL);
+		}
+
+		io_uring_submit(&ring);
+
+		while (pending) {
+			struct io_uring_cqe* cqe;
+
+			int result = io_uring_wait_cqe(&ring, &cqe);
+
+			if (-EINTR == result)
+				continue;
+
+			if (result < 0)
+				break;
+
+			Buffer* buffer = (Buffer*)io_uring_cqe_get_data(cqe);
+
+			io_uring_cqe_seen(&ring, cqe);
+
+			if (buffer) {
+				removeInFlight(buffer);
+				completed(buffer);
+			}
+		}
+	}
+
+	//tearing the ring down cancels and waits for anything left
+	io_uring_queue_exit(&ring);
+
+	for (unsigned int i = 0; i < pending; i++)
+		completed(inFlight[i]);
+
+	return ok;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Writes the rest of a buffer with pwrite(), dropping O_DIRECT if the file system refuses it.
+ */
+bool Vcap::AsyncWriter::writeBuffer(Buffer* buffer, std::size_t done) {
+	while (done < buffer->used) {
+		ssize_t written = pwrite(_fd, buffer->data + done, buffer->used - done, buffer->offset + done);
+
+		if (written < 0) {
+			if (EINTR == errno)
+				continue;
+
+			if (EINVAL == errno && _direct) {
+				_direct = false;
+				fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+				continue;
+			}
+
+			fail(errno);
+			return false;
+		}
+
+		done += written;
+		_written.fetch_add(written, std::memory_order_relaxed);
+	}
+
+	return true;
+}
+
+/*
+ * Records a written buffer's frames in the segment index and returns it to the producer.
+ */
+void Vcap::AsyncWriter::completed(Buffer* buffer) {
+	if (0 == _error.load()) {
+		_index.insert(_index.end(), buffer->index.begin(), buffer->index.end());
+		_dataEnd = std::max(_dataEnd, buffer->offset + buffer->used);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_inFlight--;
+		_free.push_back(buffer);
+	}
+
+	_bufferFree.notify_all();
+}
+
+/*
+ * Completes the open segment and creates the given one, with O_DIRECT if possible. Space is preallocated so the
+ * segment stays contiguous; any unused space is released when it is completed.
+ */
+void Vcap::AsyncWriter::openSegment(std::size_t segment) {
+	closeSegment();
+
+	std::string path = segmentPath(segment);
+
+	_direct = true;
+	_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+
+	if (-1 == _fd && EINVAL == errno) {
+		_direct = false;
+		_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+
+	if (-1 == _fd) {
+		fail(errno);
+		return;
+	}
+
+	//not every file system can preallocate; that only costs contiguity
+	fallocate(_fd, 0, 0, _segmentSize);
+
+	_openSegment = segment;
+	_dataEnd = 0;
+	_index.clear();
+}
+
+/*
+ * Runs on the writer thread once the segment's last buffer is on disk. The index and header update are small, so they
+ * go through plain pwrite() rather than the staging buffers.
+ */
+void Vcap::AsyncWriter::closeSegment() {
+	if (-1 == _fd)
+		return;
+
+	if (0 == _error.load()) {
+		sortIndex(_index);
+
+		std::uint64_t location[2] = { _dataEnd, _index.size() };
+		std::size_t indexSize = _index.size() * sizeof(FrameIndexEntry);
+
+		//the index and header update are not block-sized
+		if (_direct)
+			fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+
+		if (indexSize && (ssize_t)indexSize != pwrite(_fd, _index.data(), indexSize, _dataEnd))
+			fail(errno ? errno : EIO);
+		else if (sizeof(location) != pwrite(_fd, location, sizeof(location), offsetof(RecordingHeader, indexOffset)))
+			fail(errno ? errno : EIO);
+		else if (0 != ftruncate(_fd, _dataEnd + indexSize))
+			fail(errno);
+	}
+
+	if (0 != ::close(_fd))
+		fail(errno);
+
+	_fd = -1;
+	_openSegment = NO_SEGMENT;
+	_index.clear();
+}
+
+void Vcap::AsyncWriter::fail(int error) {
+	int expected = 0;
+
+	_error.compare_exchange_strong(expected, error);
+}
@@ -0,0 +1,490 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * File layout: magic, payload size, payload checksum, payload. Bump the magic whenever the payload changes.
+ */
+static const char CACHE_MAGIC[8] = { 'V', 'C', 'A', 'P', 'C', 'A', 'P', '1' };
+static const std::size_t HEADER_SIZE = sizeof(CACHE_MAGIC) + 4 + 8;
+
+static std::uint64_t fnv1a(const char* data, std::size_t size) {
+	std::uint64_t hash = 14695981039346656037ULL;
+
+	for (std::size_t i = 0; i < size; i++) {
+		hash ^= (std::uint8_t)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+namespace {
+	/*
+	 * Appends fixed-width little-endian fields to a byte buffer.
+	 */
+	class Writer {
+		public:
+			void u16(std::uint16_t value) {
+				for (int i = 0; i < 2; i++)
+					_data.push_back((char)(value >> (8 * i)));
+			}
+
+			void u32(std::uint32_t value) {
+				for (int i = 0; i < 4; i++)
+					_data.push_back((char)(value >> (8 * i)));
+			}
+
+			void u64(std::uint64_t value) {
+				for (int i = 0; i < 8; i++)
+					_data.push_back((char)(value >> (8 * i)));
+			}
+
+			void bytes(const char* data, std::size_t size) {
+				_data.append(data, size);
+			}
+
+			void string(const std::string& value) {
+				u32(value.size());
+				_data.append(value);
+			}
+
+			std::string& data() {
+				return _data;
+			}
+
+		private:
+			std::string _data;
+	};
+
+	/*
+	 * Reads fields written by Writer; every read is bounds-checked and latches a failure flag.
+	 */
+	class Reader {
+		public:
+			Reader(const char* data, std::size_t size) : _data(data), _size(size), _pos(0), _ok(true) { }
+
+			std::uint16_t u16() {
+				return (std::uint16_t)read(2);
+			}
+
+			std::uint32_t u32() {
+				return (std::uint32_t)read(4);
+			}
+
+			std::uint64_t u64() {
+				return read(8);
+			}
+
+			void bytes(char* out, std::size_t size) {
+				if (!check(size))
+					return;
+
+				std::memcpy(out, _data + _pos, size);
+				_pos += size;
+			}
+
+			std::string string() {
+				std::uint32_t size = u32();
+
+				if (!check(size))
+					return std::string();
+
+				std::string value(_data + _pos, size);
+				_pos += size;
+
+				return value;
+			}
+
+			/*
+			 * Guards element counts against corrupt files before they are used to size vectors.
+			 */
+			bool count(std::uint32_t count, std::size_t elementSize) {
+				return check((std::size_t)count * elementSize);
+			}
+
+			bool ok() const {
+				return _ok && _pos == _size;
+			}
+
+		private:
+			bool check(std::size_t size) {
+				if (!_ok || size > _size - _pos)
+					_ok = false;
+
+				return _ok;
+			}
+
+			std::uint64_t read(int size) {
+				if (!check(size))
+					return 0;
+
+				std::uint64_t value = 0;
+
+				for (int i = 0; i < size; i++)
+					value |= (std::uint64_t)(std::uint8_t)_data[_pos + i] << (8 * i);
+
+				_pos += size;
+
+				return value;
+			}
+
+			const char* _data;
+			std::size_t _size;
+			std::size_t _pos;
+			bool _ok;
+	};
+}
+
+static bool sameDevice(const Vcap::DeviceInfo& a, const Vcap::DeviceInfo& b) {
+	return a.driver == b.driver && a.card == b.card && a.busInfo == b.busInfo && a.version == b.version &&
+			a.firmware == b.firmware;
+}
+
+/*
+ * Capabilities class definition
+ */
+const Vcap::DeviceInfo& Vcap::Capabilities::deviceInfo() const {
+	return _deviceInfo;
+}
+
+const Vcap::FormatList& Vcap::Capabilities::formats() const {
+	return _formats;
+}
+
+const Vcap::ControlList& Vcap::Capabilities::controls() const {
+	return _controls;
+}
+
+std::size_t Vcap::Capabilities::numFrameRates(std::size_t sizeIndex) const {
+	if (sizeIndex + 1 >= _frameRateOffsets.size())
+		return 0;
+
+	return _frameRateOffsets[sizeIndex + 1] - _frameRateOffsets[sizeIndex];
+}
+
+const std::uint16_t* Vcap::Capabilities::frameRates(std::size_t sizeIndex) const {
+	if (sizeIndex + 1 >= _frameRateOffsets.size())
+		return NULL;
+
+	return _frameRates.data() + _frameRateOffsets[sizeIndex];
+}
+
+/*
+ * Capability cache class definition
+ */
+Vcap::CapabilityCache::CapabilityCache(const std::string& directory) : _directory(directory) {
+}
+
+Vcap::Capabilities Vcap::CapabilityCache::capabilities(Camera& camera) throw (RuntimeError) {
+	DeviceInfo info = camera.deviceInfo();
+
+	Capabilities caps;
+
+	if (load(info, caps))
+		return caps;
+
+	caps = camera.capabilities();
+
+	//the cache is only an optimisation; an unwritable directory must not cost the caller the probe
+	try {
+		store(caps);
+	} catch (RuntimeError&) {
+	}
+
+	return caps;
+}
+
+bool Vcap::CapabilityCache::load(const DeviceInfo& info, Capabilities& capabilities) {
+	std::ifstream file(path(info).c_str(), std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	if (contents.size() < HEADER_SIZE || 0 != std::memcmp(contents.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)))
+		return false;
+
+	Reader header(contents.data() + sizeof(CACHE_MAGIC), HEADER_SIZE - sizeof(CACHE_MAGIC));
+
+	std::uint32_t payloadSize = header.u32();
+	std::uint64_t checksum = header.u64();
+
+	const char* payload = contents.data() + HEADER_SIZE;
+
+	if (payloadSize != contents.size() - HEADER_SIZE || checksum != fnv1a(payload, payloadSize))
+		return false;
+
+	Reader in(payload, payloadSize);
+	Capabilities caps;
+
+	caps._deviceInfo.device = info.device;
+	caps._deviceInfo.driver = in.string();
+	caps._deviceInfo.card = in.string();
+	caps._deviceInfo.busInfo = in.string();
+	caps._deviceInfo.firmware = in.string();
+	caps._deviceInfo.version = in.u32();
+	caps._deviceInfo.capabilities = in.u32();
+
+	//a different driver, firmware or port means the entry is stale
+	if (!sameDevice(info, caps._deviceInfo))
+		return false;
+
+	std::uint32_t numFormats = in.u32();
+
+	if (!in.count(numFormats, 4 + 5 + 32 + 8))
+		return false;
+
+	caps._formats._formats.resize(numFormats);
+
+	for (std::uint32_t i = 0; i < numFormats; i++) {
+		FormatDesc& desc = caps._formats._formats[i];
+
+		desc.code = in.u32();
+		in.bytes(desc.codeString, sizeof(desc.codeString));
+		in.bytes(desc.description, sizeof(desc.description));
+		desc.firstSize = in.u32();
+		desc.numSizes = in.u32();
+	}
+
+	std::uint32_t numSizes = in.u32();
+
+	if (!in.count(numSizes, 8))
+		return false;
+
+	caps._formats._sizes.reserve(numSizes);
+
+	for (std::uint32_t i = 0; i < numSizes; i++) {
+		std::uint32_t width = in.u32();
+		std::uint32_t height = in.u32();
+
+		caps._formats._sizes.push_back(Size(width, height));
+	}
+
+	std::uint32_t numRates = in.u32();
+
+	if (!in.count(numRates, 2))
+		return false;
+
+	caps._frameRates.resize(numRates);
+
+	for (std::uint32_t i = 0; i < numRates; i++)
+		caps._frameRates[i] = in.u16();
+
+	std::uint32_t numOffsets = in.u32();
+
+	if (!in.count(numOffsets, 4))
+		return false;
+
+	caps._frameRateOffsets.resize(numOffsets);
+
+	for (std::uint32_t i = 0; i < numOffsets; i++)
+		caps._frameRateOffsets[i] = in.u32();
+
+	std::uint32_t numControls = in.u32();
+
+	if (!in.count(numControls, 4 + 4 + 32 + 16 + 8))
+		return false;
+
+	caps._controls._controls.resize(numControls);
+
+	for (std::uint32_t i = 0; i < numControls; i++) {
+		ControlDesc& desc = caps._controls._controls[i];
+
+		desc.id = (ControlId)in.u32();
+		desc.type = (ControlType)in.u32();
+		in.bytes(desc.name, sizeof(desc.name));
+		desc.min = (std::int32_t)in.u32();
+		desc.max = (std::int32_t)in.u32();
+		desc.step = (std::int32_t)in.u32();
+		desc.defaultValue = (std::int32_t)in.u32();
+		desc.firstMenuItem = in.u32();
+		desc.numMenuItems = in.u32();
+	}
+
+	std::uint32_t numMenuItems = in.u32();
+
+	if (!in.count(numMenuItems, 32 + 4))
+		return false;
+
+	caps._controls._menuItems.resize(numMenuItems);
+
+	for (std::uint32_t i = 0; i < numMenuItems; i++) {
+		MenuItemDesc& item = caps._controls._menuItems[i];
+
+		in.bytes(item.name, sizeof(item.name));
+		item.value = in.u32();
+	}
+
+	if (!in.ok())
+		return false;
+
+	//reject entries whose internal offsets do not line up
+	if (numOffsets != numSizes + 1 || (numOffsets > 0 && caps._frameRateOffsets[numSizes] != numRates))
+		return false;
+
+	for (std::uint32_t i = 0; i < numFormats; i++) {
+		const FormatDesc& desc = caps._formats._formats[i];
+
+		if (desc.firstSize + desc.numSizes > numSizes)
+			return false;
+	}
+
+	for (std::uint32_t i = 0; i < numControls; i++) {
+		const ControlDesc& desc = caps._controls._controls[i];
+
+		if (desc.firstMenuItem + desc.numMenuItems > numMenuItems)
+			return false;
+	}
+
+	for (std::uint32_t i = 0; i + 1 < numOffsets; i++) {
+		if (caps._frameRateOffsets[i] > caps._frameRateOffsets[i + 1])
+			return false;
+	}
+
+	capabilities = caps;
+
+	return true;
+}
+
+void Vcap::CapabilityCache::store(const Capabilities& capabilities) throw (RuntimeError) {
+	const DeviceInfo& info = capabilities._deviceInfo;
+
+	Writer out;
+
+	out.string(info.driver);
+	out.string(info.card);
+	out.string(info.busInfo);
+	out.string(info.firmware);
+	out.u32(info.version);
+	out.u32(info.capabilities);
+
+	const std::vector<FormatDesc>& formats = capabilities._formats._formats;
+
+	out.u32(formats.size());
+
+	for (std::size_t i = 0; i < formats.size(); i++) {
+		out.u32(formats[i].code);
+		out.bytes(formats[i].codeString, sizeof(formats[i].codeString));
+		out.bytes(formats[i].description, sizeof(formats[i].description));
+		out.u32(formats[i].firstSize);
+		out.u32(formats[i].numSizes);
+	}
+
+	const std::vector<Size>& sizes = capabilities._formats._sizes;
+
+	out.u32(sizes.size());
+
+	for (std::size_t i = 0; i < sizes.size(); i++) {
+		out.u32(sizes[i].width());
+		out.u32(sizes[i].height());
+	}
+
+	out.u32(capabilities._frameRates.size());
+
+	for (std::size_t i = 0; i < capabilities._frameRates.size(); i++)
+		out.u16(capabilities._frameRates[i]);
+
+	out.u32(capabilities._frameRateOffsets.size());
+
+	for (std::size_t i = 0; i < capabilities._frameRateOffsets.size(); i++)
+		out.u32(capabilities._frameRateOffsets[i]);
+
+	const std::vector<ControlDesc>& controls = capabilities._controls._controls;
+
+	out.u32(controls.size());
+
+	for (std::size_t i = 0; i < controls.size(); i++) {
+		out.u32(controls[i].id);
+		out.u32(controls[i].type);
+		out.bytes(controls[i].name, sizeof(controls[i].name));
+		out.u32(controls[i].min);
+		out.u32(controls[i].max);
+		out.u32(controls[i].step);
+		out.u32(controls[i].defaultValue);
+		out.u32(controls[i].firstMenuItem);
+		out.u32(controls[i].numMenuItems);
+	}
+
+	const std::vector<MenuItemDesc>& menuItems = capabilities._controls._menuItems;
+
+	out.u32(menuItems.size());
+
+	for (std::size_t i = 0; i < menuItems.size(); i++) {
+		out.bytes(menuItems[i].name, sizeof(menuItems[i].name));
+		out.u32(menuItems[i].value);
+	}
+
+	Writer header;
+
+	header.bytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.u32(out.data().size());
+	header.u64(fnv1a(out.data().data(), out.data().size()));
+
+	//the parent directory is up to the caller
+	if (-1 == mkdir(_directory.c_str(), 0755) && EEXIST != errno)
+		throw RuntimeError("Unable to create capability cache " + _directory + ": " + std::strerror(errno));
+
+	//write to a temporary file and rename it so readers never see a partial entry
+	std::string target = path(info);
+	std::string temp = target + ".tmp." + std::to_string(getpid());
+
+	FILE* file = std::fopen(temp.c_str(), "wb");
+
+	if (!file)
+		throw RuntimeError(std::string("Unable to write capability cache: ") + std::strerror(errno));
+
+	bool written = std::fwrite(header.data().data(), header.data().size(), 1, file) == 1 &&
+			std::fwrite(out.data().data(), out.data().size(), 1, file) == 1;
+
+	if (0 != std::fclose(file))
+		written = false;
+
+	if (!written || 0 != std::rename(temp.c_str(), target.c_str())) {
+		std::remove(temp.c_str());
+		throw RuntimeError(std::string("Unable to write capability cache: ") + std::strerror(errno));
+	}
+}
+
+void Vcap::CapabilityCache::invalidate(const DeviceInfo& info) {
+	std::remove(path(info).c_str());
+}
+
+std::string Vcap::CapabilityCache::path(const DeviceInfo& info) const {
+	std::string key = info.driver + '\0' + info.card + '\0' + info.busInfo + '\0' + std::to_string(info.version) +
+			'\0' + info.firmware;
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.caps", (unsigned long long)fnv1a(key.data(), key.size()));
+
+	return _directory + "/" + name;
+}
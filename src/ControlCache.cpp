@@ -0,0 +1,250 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "ControlCache.hpp"
+#include "ControlMap.hpp"
+#include "Ioctl.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+Vcap::ControlCache::ControlCache(vcap_camera_t* camera) :
+	_camera(camera),
+	_watching(false),
+	_wakeFd(-1),
+	_nextHandle(1) {
+	for (int i = 0; i < CTRL_INVALID; i++) {
+		_values[i].store(0, std::memory_order_relaxed);
+		_known[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+Vcap::ControlCache::~ControlCache() {
+	stop();
+}
+
+void Vcap::ControlCache::start(const ControlList& controls) {
+	if (_watching)
+		return;
+
+	//the event thread may have exited on its own (device gone); reap it before starting over
+	if (_thread.joinable())
+		stop();
+
+	int fd = _camera->fd;
+
+	for (std::size_t i = 0; i < controls.size(); i++) {
+		std::uint32_t cid = controlCid(controls[i].id);
+
+		if (0 == cid)
+			continue;
+
+		struct v4l2_event_subscription sub;
+		std::memset(&sub, 0, sizeof(sub));
+
+		sub.type = V4L2_EVENT_CTRL;
+		sub.id = cid;
+		sub.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL | V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK;
+
+		//controls the driver cannot report on are simply left uncached
+		xioctl(fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+	}
+
+	//the initial events carry the current values; consume them now so the cache is populated on return
+	dequeueEvents();
+
+	_wakeFd = eventfd(0, EFD_CLOEXEC);
+
+	if (-1 == _wakeFd) {
+		int error = errno;
+
+		stop();
+
+		throw RuntimeError(std::string("Unable to create control event wakeup: ") + std::strerror(error));
+	}
+
+	_watching = true;
+	_thread = std::thread(&ControlCache::run, this);
+}
+
+void Vcap::ControlCache::stop() {
+	if (_thread.joinable()) {
+		std::uint64_t one = 1;
+
+		//the thread also exits on its own if the device goes away, so a failed wakeup is harmless
+		ssize_t result = write(_wakeFd, &one, sizeof(one));
+		(void)result;
+
+		_thread.join();
+	}
+
+	_watching = false;
+
+	if (-1 != _wakeFd) {
+		close(_wakeFd);
+		_wakeFd = -1;
+	}
+
+	if (_camera->opened) {
+		struct v4l2_event_subscription sub;
+		std::memset(&sub, 0, sizeof(sub));
+
+		sub.type = V4L2_EVENT_ALL;
+
+		xioctl(_camera->fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+	}
+
+	for (int i = 0; i < CTRL_INVALID; i++)
+		_known[i].store(false, std::memory_order_release);
+}
+
+bool Vcap::ControlCache::watching() const {
+	return _watching;
+}
+
+bool Vcap::ControlCache::value(ControlId id, std::int32_t& value) const {
+	if (id < 0 || id >= CTRL_INVALID || !_known[id].load(std::memory_order_acquire))
+		return false;
+
+	value = _values[id].load(std::memory_order_relaxed);
+
+	return true;
+}
+
+void Vcap::ControlCache::update(ControlId id, std::int32_t value) {
+	if (id < 0 || id >= CTRL_INVALID || !_known[id].load(std::memory_order_acquire))
+		return;
+
+	_values[id].store(value, std::memory_order_relaxed);
+}
+
+std::size_t Vcap::ControlCache::addCallback(const ControlCallback& callback) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_callbacks.push_back(std::make_pair(_nextHandle, callback));
+
+	return _nextHandle++;
+}
+
+void Vcap::ControlCache::removeCallback(std::size_t handle) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (std::size_t i = 0; i < _callbacks.size(); i++) {
+		if (_callbacks[i].first == handle) {
+			_callbacks.erase(_callbacks.begin() + i);
+			break;
+		}
+	}
+}
+
+void Vcap::ControlCache::run() {
+	struct pollfd pfds[2];
+
+	pfds[0].fd = _camera->fd;
+	pfds[0].events = POLLPRI;
+	pfds[1].fd = _wakeFd;
+	pfds[1].events = POLLIN;
+
+	for (;;) {
+		pfds[0].revents = 0;
+		pfds[1].revents = 0;
+
+		if (-1 == poll(pfds, 2, -1)) {
+			if (EINTR == errno)
+				continue;
+
+			break;
+		}
+
+		if (pfds[1].revents)
+			break;
+
+		//the device was unregistered
+		if (pfds[0].revents & POLLHUP)
+			break;
+
+		if (pfds[0].revents & POLLPRI)
+			dequeueEvents();
+	}
+
+	//nothing keeps the values current any more, so reads must go back to the driver
+	for (int i = 0; i < CTRL_INVALID; i++)
+		_known[i].store(false, std::memory_order_release);
+
+	_watching = false;
+}
+
+/*
+ * Drains every pending event. The camera descriptor is normally blocking, so VIDIOC_DQEVENT is only issued while poll
+ * reports an event pending.
+ */
+void Vcap::ControlCache::dequeueEvents() {
+	struct v4l2_event event;
+	struct pollfd pfd;
+
+	pfd.fd = _camera->fd;
+	pfd.events = POLLPRI;
+
+	for (;;) {
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLPRI))
+			return;
+
+		std::memset(&event, 0, sizeof(event));
+
+		if (-1 == xioctl(_camera->fd, VIDIOC_DQEVENT, &event))
+			return;
+
+		handle(event);
+	}
+}
+
+void Vcap::ControlCache::handle(const struct v4l2_event& event) {
+	if (V4L2_EVENT_CTRL != event.type || !(event.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE))
+		return;
+
+	ControlId id = controlId(event.id);
+
+	if (CTRL_INVALID == id)
+		return;
+
+	std::int32_t value = event.u.ctrl.value;
+
+	_values[id].store(value, std::memory_order_relaxed);
+	_known[id].store(true, std::memory_order_release);
+
+	//copy so callbacks may add or remove callbacks
+	std::vector<std::pair<std::size_t, ControlCallback> > callbacks;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		callbacks = _callbacks;
+	}
+
+	for (std::size_t i = 0; i < callbacks.size(); i++)
+		callbacks[i].second(id, value);
+}
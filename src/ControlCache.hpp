@@ -0,0 +1,93 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_CONTROL_CACHE_HPP
+#define _VCAP_CONTROL_CACHE_HPP
+
+/*
+ * Control values kept current from V4L2 control change events. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct v4l2_event;
+
+namespace Vcap {
+	class ControlCache;
+}
+
+class Vcap::ControlCache {
+	public:
+		ControlCache(vcap_camera_t* camera);
+		~ControlCache();
+
+		/*
+		 * Subscribes to change events for the given controls and starts the event thread.
+		 */
+		void start(const ControlList& controls);
+		void stop();
+
+		bool watching() const;
+
+		/*
+		 * Looks up a cached value. Returns false if the control is not being watched.
+		 */
+		bool value(ControlId id, std::int32_t& value) const;
+
+		/*
+		 * Records a value just written to the driver, so reads see it before the change event arrives. Controls that
+		 * are not cached are left alone.
+		 */
+		void update(ControlId id, std::int32_t value);
+
+		std::size_t addCallback(const ControlCallback& callback);
+		void removeCallback(std::size_t handle);
+
+	private:
+		ControlCache(const ControlCache&);
+		ControlCache& operator = (const ControlCache&);
+
+		void run();
+		void dequeueEvents();
+		void handle(const struct v4l2_event& event);
+
+		vcap_camera_t* _camera;
+
+		std::atomic<bool> _watching;
+		std::atomic<std::int32_t> _values[CTRL_INVALID];
+		std::atomic<bool> _known[CTRL_INVALID];
+
+		std::thread _thread;
+		int _wakeFd;
+
+		std::mutex _mutex;
+		std::vector<std::pair<std::size_t, ControlCallback> > _callbacks;
+		std::size_t _nextHandle;
+};
+
+#endif
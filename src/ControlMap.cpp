@@ -0,0 +1,68 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "ControlMap.hpp"
+
+#include <linux/videodev2.h>
+
+/*
+ * Indexed by Vcap::ControlId; must be kept in the same order as the enum in Controls.hpp.
+ */
+static const std::uint32_t CONTROL_CIDS[] = {
+	V4L2_CID_BRIGHTNESS,
+	V4L2_CID_CONTRAST,
+	V4L2_CID_SATURATION,
+	V4L2_CID_HUE,
+	V4L2_CID_AUTO_WHITE_BALANCE,
+	V4L2_CID_DO_WHITE_BALANCE,
+	V4L2_CID_RED_BALANCE,
+	V4L2_CID_BLUE_BALANCE,
+	V4L2_CID_GAMMA,
+	V4L2_CID_EXPOSURE,
+	V4L2_CID_AUTOGAIN,
+	V4L2_CID_GAIN,
+	V4L2_CID_HFLIP,
+	V4L2_CID_VFLIP,
+	V4L2_CID_EXPOSURE_AUTO,
+	V4L2_CID_EXPOSURE_ABSOLUTE,
+	V4L2_CID_EXPOSURE_AUTO_PRIORITY,
+	V4L2_CID_FOCUS_ABSOLUTE,
+	V4L2_CID_FOCUS_RELATIVE,
+	V4L2_CID_FOCUS_AUTO,
+	V4L2_CID_ZOOM_ABSOLUTE,
+	V4L2_CID_ZOOM_RELATIVE,
+	V4L2_CID_WHITE_BALANCE_TEMPERATURE
+};
+
+std::uint32_t Vcap::controlCid(ControlId id) {
+	if (id < 0 || id >= CTRL_INVALID)
+		return 0;
+
+	return CONTROL_CIDS[id];
+}
+
+Vcap::ControlId Vcap::controlId(std::uint32_t cid) {
+	for (int i = 0; i < CTRL_INVALID; i++) {
+		if (CONTROL_CIDS[i] == cid)
+			return (ControlId)i;
+	}
+
+	return CTRL_INVALID;
+}
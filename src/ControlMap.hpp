@@ -0,0 +1,44 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_CONTROL_MAP_HPP
+#define _VCAP_CONTROL_MAP_HPP
+
+/*
+ * Mapping between Vcap control IDs and V4L2 control IDs, for code that talks to the driver directly. Not installed.
+ */
+
+#include <Vcap/Controls.hpp>
+
+#include <cstdint>
+
+namespace Vcap {
+	/*
+	 * Returns the V4L2 control ID for a Vcap control ID, or 0 if there is none.
+	 */
+	std::uint32_t controlCid(ControlId id);
+
+	/*
+	 * Returns the Vcap control ID for a V4L2 control ID, or CTRL_INVALID if there is none.
+	 */
+	ControlId controlId(std::uint32_t cid);
+}
+
+#endif
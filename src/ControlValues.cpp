@@ -0,0 +1,139 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include "ControlCache.hpp"
+#include "ControlMap.hpp"
+#include "Ioctl.hpp"
+#include "Tracing.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+/*
+ * Fills in the V4L2 control IDs for a batch, rejecting controls the driver interface has no ID for.
+ */
+static void prepareControls(const std::vector<Vcap::ControlValue>& values,
+		std::vector<struct v4l2_ext_control>& ctrls) {
+	ctrls.assign(values.size(), v4l2_ext_control());
+
+	for (std::size_t i = 0; i < values.size(); i++) {
+		ctrls[i].id = Vcap::controlCid(values[i].id);
+
+		if (0 == ctrls[i].id)
+			throw Vcap::RuntimeError("Unknown control in batch");
+	}
+}
+
+/*
+ * True if an extended control request failed because the driver cannot handle the batch as a whole (no extended
+ * control support, or controls from several classes on a pre-control-framework driver) rather than because of a
+ * particular control. The caller then falls back to one request per control.
+ */
+static bool batchUnsupported(const struct v4l2_ext_controls& ext) {
+	return ENOTTY == errno || (EINVAL == errno && ext.error_idx == ext.count);
+}
+
+/*
+ * Camera class definition (batched controls)
+ */
+void Vcap::Camera::controlValues(std::vector<ControlValue>& values) throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+
+	if (values.empty())
+		return;
+
+	//while every requested control is watched, the read is a memory lookup
+	std::size_t cached = 0;
+
+	while (cached < values.size() && _controlCache->value(values[cached].id, values[cached].value))
+		cached++;
+
+	if (cached == values.size())
+		return;
+
+	std::vector<struct v4l2_ext_control> ctrls;
+	prepareControls(values, ctrls);
+
+	struct v4l2_ext_controls ext;
+	std::memset(&ext, 0, sizeof(ext));
+
+	ext.count = (std::uint32_t)ctrls.size();
+	ext.controls = ctrls.data();
+
+	if (-1 == xioctl(_camera->fd, VIDIOC_G_EXT_CTRLS, &ext)) {
+		if (!batchUnsupported(ext))
+			throw ioctlError("Unable to get control values");
+
+		for (std::size_t i = 0; i < values.size(); i++)
+			values[i].value = controlValue(values[i].id);
+
+		return;
+	}
+
+	for (std::size_t i = 0; i < values.size(); i++)
+		values[i].value = ctrls[i].value;
+}
+
+void Vcap::Camera::setControlValues(const std::vector<ControlValue>& values) throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+
+	if (values.empty())
+		return;
+
+	std::vector<struct v4l2_ext_control> ctrls;
+	prepareControls(values, ctrls);
+
+	for (std::size_t i = 0; i < values.size(); i++)
+		ctrls[i].value = values[i].value;
+
+	struct v4l2_ext_controls ext;
+	std::memset(&ext, 0, sizeof(ext));
+
+	ext.count = (std::uint32_t)ctrls.size();
+	ext.controls = ctrls.data();
+
+	VCAP_TRACE_BEGIN(controls);
+
+	int result = xioctl(_camera->fd, VIDIOC_S_EXT_CTRLS, &ext);
+
+	VCAP_TRACE_END(controls, values.size());
+
+	if (-1 == result) {
+		if (!batchUnsupported(ext))
+			throw ioctlError("Unable to set control values");
+
+		for (std::size_t i = 0; i < values.size(); i++)
+			setControlValue(values[i].id, values[i].value);
+
+		return;
+	}
+
+	//the driver reports the values it actually applied
+	for (std::size_t i = 0; i < values.size(); i++)
+		_controlCache->update(values[i].id, ctrls[i].value);
+}
@@ -0,0 +1,212 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "Decode.hpp"
+
+/*
+ * Luma is metered on every LUMA_SAMPLE_STEP-th pixel of every LUMA_SAMPLE_STEP-th row.
+ */
+static const std::uint32_t LUMA_SAMPLE_STEP = 4;
+
+static inline std::uint8_t clamp(int value) {
+	return value < 0 ? 0 : (value > 255 ? 255 : (std::uint8_t)value);
+}
+
+/*
+ * ITU-R BT.601 (limited range) YUV to RGB, 8-bit fixed point.
+ */
+static inline void yuvToRgb(int y, int u, int v, std::uint8_t* out, bool bgr) {
+	int c = 298 * (y - 16);
+	int d = u - 128;
+	int e = v - 128;
+
+	std::uint8_t r = clamp((c + 409 * e + 128) >> 8);
+	std::uint8_t g = clamp((c - 100 * d - 208 * e + 128) >> 8);
+	std::uint8_t b = clamp((c + 516 * d + 128) >> 8);
+
+	out[0] = bgr ? b : r;
+	out[1] = g;
+	out[2] = bgr ? r : b;
+}
+
+/*
+ * Meters one row of luma samples spaced pixelStride bytes apart.
+ */
+static void sampleRow(const std::uint8_t* row, std::size_t pixelStride, std::uint32_t width, std::uint32_t y,
+		std::uint32_t height, Vcap::LumaStats& stats) {
+	unsigned int zoneRow = y * Vcap::EXPOSURE_ZONES / height * Vcap::EXPOSURE_ZONES;
+
+	for (std::uint32_t x = 0; x < width; x += LUMA_SAMPLE_STEP) {
+		std::uint8_t luma = row[x * pixelStride];
+		unsigned int zone = zoneRow + x * Vcap::EXPOSURE_ZONES / width;
+
+		stats.histogram[luma]++;
+		stats.zoneSum[zone] += luma;
+		stats.zoneSamples[zone]++;
+		stats.samples++;
+	}
+}
+
+/*
+ * One Y plane plus one interleaved CbCr (or CrCb) plane.
+ */
+static void decodeSemiPlanar(const Vcap::Plane& luma, const Vcap::Plane& chroma, std::uint32_t width,
+		std::uint32_t height, bool verticalSubsampling, bool swapUV, std::uint8_t* out, bool bgr,
+		Vcap::LumaStats* stats) {
+	std::size_t lumaStride = luma.stride ? luma.stride : width;
+	std::size_t chromaStride = chroma.stride ? chroma.stride : width;
+
+	for (std::uint32_t y = 0; y < height; y++) {
+		const std::uint8_t* yRow = luma.data + y * lumaStride;
+		const std::uint8_t* uvRow = chroma.data + (verticalSubsampling ? y / 2 : y) * chromaStride;
+
+		for (std::uint32_t x = 0; x < width; x++) {
+			const std::uint8_t* uv = uvRow + (x & ~1u);
+
+			int u = swapUV ? uv[1] : uv[0];
+			int v = swapUV ? uv[0] : uv[1];
+
+			yuvToRgb(yRow[x], u, v, out, bgr);
+			out += 3;
+		}
+
+		//the row is still in cache, so metering it costs no extra pass over the frame
+		if (stats && 0 == y % LUMA_SAMPLE_STEP)
+			sampleRow(yRow, 1, width, y, height, *stats);
+	}
+}
+
+/*
+ * Separate Y, Cb and Cr planes with 4:2:0 subsampling.
+ */
+static void decodePlanar420(const Vcap::Plane& luma, const Vcap::Plane& cb, const Vcap::Plane& cr,
+		std::uint32_t width, std::uint32_t height, std::uint8_t* out, bool bgr, Vcap::LumaStats* stats) {
+	std::size_t lumaStride = luma.stride ? luma.stride : width;
+	std::size_t cbStride = cb.stride ? cb.stride : (width + 1) / 2;
+	std::size_t crStride = cr.stride ? cr.stride : (width + 1) / 2;
+
+	for (std::uint32_t y = 0; y < height; y++) {
+		const std::uint8_t* yRow = luma.data + y * lumaStride;
+		const std::uint8_t* uRow = cb.data + (y / 2) * cbStride;
+		const std::uint8_t* vRow = cr.data + (y / 2) * crStride;
+
+		for (std::uint32_t x = 0; x < width; x++) {
+			yuvToRgb(yRow[x], uRow[x / 2], vRow[x / 2], out, bgr);
+			out += 3;
+		}
+
+		if (stats && 0 == y % LUMA_SAMPLE_STEP)
+			sampleRow(yRow, 1, width, y, height, *stats);
+	}
+}
+
+bool Vcap::decodePlanes(const Frame& frame, std::uint32_t code, std::uint32_t width, std::uint32_t height,
+		std::uint8_t* out, bool bgr, LumaStats* stats) {
+	Plane planes[MAX_PLANES];
+	unsigned int numPlanes = frame.numPlanes();
+
+	for (unsigned int i = 0; i < numPlanes; i++)
+		planes[i] = frame.plane(i);
+
+	return decodePlanes(planes, numPlanes, code, width, height, out, bgr, stats);
+}
+
+bool Vcap::decodePlanes(const Plane* planes, unsigned int numPlanes, std::uint32_t code, std::uint32_t width,
+		std::uint32_t height, std::uint8_t* out, bool bgr, LumaStats* stats) {
+	if (numPlanes >= 2) {
+		if (FMT_NV12M == code || FMT_NV21M == code) {
+			decodeSemiPlanar(planes[0], planes[1], width, height, true, FMT_NV21M == code, out, bgr, stats);
+			return true;
+		}
+
+		if (FMT_NV16M == code || FMT_NV61M == code) {
+			decodeSemiPlanar(planes[0], planes[1], width, height, false, FMT_NV61M == code, out, bgr, stats);
+			return true;
+		}
+	}
+
+	if (numPlanes >= 3) {
+		if (FMT_YUV420M == code) {
+			decodePlanar420(planes[0], planes[1], planes[2], width, height, out, bgr, stats);
+			return true;
+		}
+
+		if (FMT_YVU420M == code) {
+			decodePlanar420(planes[0], planes[2], planes[1], width, height, out, bgr, stats);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Vcap::sampleLuma(const std::uint8_t* data, std::size_t size, std::uint32_t code, std::uint32_t width,
+		std::uint32_t height, LumaStats& stats) {
+	std::size_t offset;
+	std::size_t pixelStride;
+
+	if (FMT_YUYV == code || FMT_YVYU == code) {
+		offset = 0;
+		pixelStride = 2;
+	} else if (FMT_UYVY == code || FMT_VYUY == code) {
+		offset = 1;
+		pixelStride = 2;
+	} else if (FMT_GREY == code || FMT_NV12 == code || FMT_NV21 == code || FMT_NV16 == code || FMT_NV61 == code ||
+			FMT_NV24 == code || FMT_NV42 == code || FMT_YUV420 == code || FMT_YVU420 == code ||
+			FMT_YUV422P == code || FMT_YUV411P == code) {
+		//greyscale, or a full resolution Y plane first
+		offset = 0;
+		pixelStride = 1;
+	} else {
+		return false;
+	}
+
+	if (size < (std::size_t)width * height * pixelStride)
+		return false;
+
+	for (std::uint32_t y = 0; y < height; y += LUMA_SAMPLE_STEP)
+		sampleRow(data + offset + (std::size_t)y * width * pixelStride, pixelStride, width, y, height, stats);
+
+	return true;
+}
+
+void Vcap::sampleRgbLuma(const std::uint8_t* data, std::uint32_t width, std::uint32_t height, bool bgr,
+		LumaStats& stats) {
+	for (std::uint32_t y = 0; y < height; y += LUMA_SAMPLE_STEP) {
+		const std::uint8_t* row = data + (std::size_t)y * width * 3;
+		unsigned int zoneRow = y * EXPOSURE_ZONES / height * EXPOSURE_ZONES;
+
+		for (std::uint32_t x = 0; x < width; x += LUMA_SAMPLE_STEP) {
+			const std::uint8_t* pixel = row + x * 3;
+
+			int r = bgr ? pixel[2] : pixel[0];
+			int b = bgr ? pixel[0] : pixel[2];
+
+			//BT.601 weights
+			std::uint8_t luma = (std::uint8_t)((77 * r + 150 * pixel[1] + 29 * b) >> 8);
+			unsigned int zone = zoneRow + x * EXPOSURE_ZONES / width;
+
+			stats.histogram[luma]++;
+			stats.zoneSum[zone] += luma;
+			stats.zoneSamples[zone]++;
+			stats.samples++;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_DECODE_HPP
+#define _VCAP_DECODE_HPP
+
+/*
+ * Decoders for formats Vcap's own decode functions cannot handle, and luma metering for decoded frames. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Vcap {
+	/*
+	 * Decodes a multi-planar YUV frame (NV12M, NV21M, NV16M, NV61M, YUV420M, YVU420M) straight from its planes into
+	 * packed RGB24 (or BGR24). Returns false if the format is not supported.
+	 */
+	bool decodePlanes(const Frame& frame, std::uint32_t code, std::uint32_t width, std::uint32_t height,
+			std::uint8_t* out, bool bgr, LumaStats* stats = NULL);
+
+	/*
+	 * As above, for planes that are not held in a Frame.
+	 */
+	bool decodePlanes(const Plane* planes, unsigned int numPlanes, std::uint32_t code, std::uint32_t width,
+			std::uint32_t height, std::uint8_t* out, bool bgr, LumaStats* stats = NULL);
+
+	/*
+	 * Accumulates luma statistics from a packed or planar YUV (or greyscale) frame of size bytes. Returns false if luma
+	 * cannot be read directly from the format, or the frame is too short to hold it.
+	 */
+	bool sampleLuma(const std::uint8_t* data, std::size_t size, std::uint32_t code, std::uint32_t width,
+			std::uint32_t height, LumaStats& stats);
+
+	/*
+	 * Accumulates luma statistics from a packed RGB24 (or BGR24) frame.
+	 */
+	void sampleRgbLuma(const std::uint8_t* data, std::uint32_t width, std::uint32_t height, bool bgr,
+			LumaStats& stats);
+}
+
+#endif
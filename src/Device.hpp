@@ -0,0 +1,44 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_DEVICE_HPP
+#define _VCAP_DEVICE_HPP
+
+/*
+ * Device identification shared by Camera and discovery. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <string>
+
+namespace Vcap {
+	/*
+	 * Fills info from VIDIOC_QUERYCAP and sysfs. Returns false (with errno set) if the query fails.
+	 */
+	bool queryDevice(int fd, const std::string& device, DeviceInfo& info);
+
+	/*
+	 * True if the device node can capture video (as opposed to metadata-only or output nodes).
+	 */
+	bool isCaptureDevice(const DeviceInfo& info);
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/*
+ * Only V4L2 video capture nodes are reported; media, subdev and other nodes in the directory are ignored.
+ */
+static bool isVideoNode(const char* name) {
+	return 0 == std::strncmp(name, "video", 5);
+}
+
+/*
+ * Device monitor class definition
+ */
+Vcap::DeviceMonitor::DeviceMonitor(const std::string& directory) throw (RuntimeError) : _directory(directory) {
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (-1 == _fd)
+		throw RuntimeError(std::string("Unable to create device monitor: ") + std::strerror(errno));
+
+	if (-1 == inotify_add_watch(_fd, directory.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM)) {
+		int error = errno;
+
+		close(_fd);
+
+		throw RuntimeError(std::string("Unable to watch ") + directory + ": " + std::strerror(error));
+	}
+}
+
+Vcap::DeviceMonitor::~DeviceMonitor() {
+	close(_fd);
+}
+
+int Vcap::DeviceMonitor::fd() const {
+	return _fd;
+}
+
+bool Vcap::DeviceMonitor::wait(int timeout) throw (RuntimeError) {
+	struct pollfd pfd;
+
+	pfd.fd = _fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	int ready;
+
+	do {
+		ready = poll(&pfd, 1, timeout);
+	} while (-1 == ready && EINTR == errno);
+
+	if (-1 == ready)
+		throw RuntimeError(std::string("Unable to wait for device events: ") + std::strerror(errno));
+
+	return ready > 0;
+}
+
+std::vector<Vcap::DeviceEvent> Vcap::DeviceMonitor::events() throw (RuntimeError) {
+	std::vector<DeviceEvent> events;
+
+	//large enough for a batch of events with full names
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	for (;;) {
+		ssize_t length = read(_fd, buffer, sizeof(buffer));
+
+		if (-1 == length) {
+			if (EINTR == errno)
+				continue;
+
+			if (EAGAIN == errno)
+				break;
+
+			throw RuntimeError(std::string("Unable to read device events: ") + std::strerror(errno));
+		}
+
+		if (0 == length)
+			break;
+
+		for (char* p = buffer; p < buffer + length; ) {
+			const struct inotify_event* event = (const struct inotify_event*)p;
+
+			p += sizeof(struct inotify_event) + event->len;
+
+			//the overflow notification carries no name; callers have to rescan to catch up
+			if (event->mask & IN_Q_OVERFLOW) {
+				DeviceEvent deviceEvent;
+
+				deviceEvent.type = DEVICE_OVERFLOW;
+
+				events.push_back(deviceEvent);
+
+				continue;
+			}
+
+			if (0 == event->len || (event->mask & IN_ISDIR) || !isVideoNode(event->name))
+				continue;
+
+			DeviceEvent deviceEvent;
+
+			deviceEvent.type = (event->mask & (IN_CREATE | IN_MOVED_TO)) ? DEVICE_ADDED : DEVICE_REMOVED;
+			deviceEvent.device = _directory + "/" + event->name;
+
+			events.push_back(deviceEvent);
+		}
+	}
+
+	return events;
+}
@@ -0,0 +1,172 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include "Device.hpp"
+#include "Ioctl.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+namespace {
+	/*
+	 * State shared between discover() and its probe threads. Threads that outlive the timeout keep it alive until
+	 * they finish, so a hung device never blocks the caller.
+	 */
+	struct Discovery {
+		std::mutex mutex;
+		std::condition_variable done;
+		std::size_t pending;
+		std::vector<Vcap::DeviceInfo> devices;
+	};
+}
+
+/*
+ * Reads the USB firmware revision (bcdDevice) of a video node from sysfs, if there is one.
+ */
+static std::string readFirmware(const std::string& device) {
+	std::string::size_type slash = device.rfind('/');
+	std::string node = std::string::npos == slash ? device : device.substr(slash + 1);
+
+	std::ifstream file(("/sys/class/video4linux/" + node + "/device/../bcdDevice").c_str());
+
+	std::string firmware;
+
+	if (file)
+		std::getline(file, firmware);
+
+	return firmware;
+}
+
+static std::string fixedString(const __u8* data, std::size_t size) {
+	return std::string((const char*)data, strnlen((const char*)data, size));
+}
+
+/*
+ * Orders video2 before video10.
+ */
+static bool nodeOrder(const Vcap::DeviceInfo& a, const Vcap::DeviceInfo& b) {
+	if (a.device.size() != b.device.size())
+		return a.device.size() < b.device.size();
+
+	return a.device < b.device;
+}
+
+static void probe(std::shared_ptr<Discovery> discovery, std::string device) {
+	Vcap::DeviceInfo info;
+
+	int fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+	bool found = -1 != fd && Vcap::queryDevice(fd, device, info) && Vcap::isCaptureDevice(info);
+
+	if (-1 != fd)
+		::close(fd);
+
+	std::lock_guard<std::mutex> lock(discovery->mutex);
+
+	if (found)
+		discovery->devices.push_back(info);
+
+	if (0 == --discovery->pending)
+		discovery->done.notify_all();
+}
+
+bool Vcap::queryDevice(int fd, const std::string& device, DeviceInfo& info) {
+	struct v4l2_capability caps;
+	std::memset(&caps, 0, sizeof(caps));
+
+	if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &caps))
+		return false;
+
+	info.device = device;
+	info.driver = fixedString(caps.driver, sizeof(caps.driver));
+	info.card = fixedString(caps.card, sizeof(caps.card));
+	info.busInfo = fixedString(caps.bus_info, sizeof(caps.bus_info));
+	info.version = caps.version;
+	info.capabilities = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+	info.firmware = readFirmware(device);
+
+	return true;
+}
+
+bool Vcap::isCaptureDevice(const DeviceInfo& info) {
+	return 0 != (info.capabilities & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE));
+}
+
+std::vector<Vcap::DeviceInfo> Vcap::Camera::discover(unsigned int timeout, const std::string& directory)
+		throw (RuntimeError) {
+	std::vector<std::string> nodes;
+
+	DIR* dir = opendir(directory.c_str());
+
+	if (!dir)
+		throw RuntimeError("Unable to open " + directory + ": " + std::strerror(errno));
+
+	struct dirent* entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (0 == std::strncmp(entry->d_name, "video", 5))
+			nodes.push_back(directory + "/" + entry->d_name);
+	}
+
+	closedir(dir);
+
+	std::shared_ptr<Discovery> discovery = std::make_shared<Discovery>();
+	discovery->pending = nodes.size();
+
+	for (std::size_t i = 0; i < nodes.size(); i++) {
+		try {
+			std::thread(probe, discovery, nodes[i]).detach();
+		} catch (std::system_error&) {
+			//out of threads: probe inline rather than skip the node
+			probe(discovery, nodes[i]);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(discovery->mutex);
+
+	discovery->done.wait_for(lock, std::chrono::milliseconds(timeout), [&discovery] {
+		return 0 == discovery->pending;
+	});
+
+	std::vector<DeviceInfo> devices = discovery->devices;
+
+	lock.unlock();
+
+	std::sort(devices.begin(), devices.end(), nodeOrder);
+
+	return devices;
+}
@@ -0,0 +1,286 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include "ControlMap.hpp"
+#include "Device.hpp"
+#include "Ioctl.hpp"
+#include "Stream.hpp"
+
+#include <cstring>
+
+#include <linux/videodev2.h>
+
+/*
+ * Typical upper bounds, so enumerating an ordinary camera needs one allocation per array.
+ */
+static const std::size_t EXPECTED_FORMATS = 16;
+static const std::size_t EXPECTED_SIZES = 64;
+static const std::size_t EXPECTED_MENU_ITEMS = 32;
+
+static void copyName(char* dst, const void* src, std::size_t size) {
+	std::strncpy(dst, (const char*)src, size - 1);
+	dst[size - 1] = '\0';
+}
+
+/*
+ * Format list class definition
+ */
+std::size_t Vcap::FormatList::size() const {
+	return _formats.size();
+}
+
+bool Vcap::FormatList::empty() const {
+	return _formats.empty();
+}
+
+const Vcap::FormatDesc& Vcap::FormatList::operator [] (std::size_t index) const {
+	return _formats[index];
+}
+
+const Vcap::FormatDesc* Vcap::FormatList::begin() const {
+	return _formats.data();
+}
+
+const Vcap::FormatDesc* Vcap::FormatList::end() const {
+	return _formats.data() + _formats.size();
+}
+
+const Vcap::Size* Vcap::FormatList::sizes(const FormatDesc& format) const {
+	return _sizes.data() + format.firstSize;
+}
+
+/*
+ * Control list class definition
+ */
+std::size_t Vcap::ControlList::size() const {
+	return _controls.size();
+}
+
+bool Vcap::ControlList::empty() const {
+	return _controls.empty();
+}
+
+const Vcap::ControlDesc& Vcap::ControlList::operator [] (std::size_t index) const {
+	return _controls[index];
+}
+
+const Vcap::ControlDesc* Vcap::ControlList::begin() const {
+	return _controls.data();
+}
+
+const Vcap::ControlDesc* Vcap::ControlList::end() const {
+	return _controls.data() + _controls.size();
+}
+
+const Vcap::MenuItemDesc* Vcap::ControlList::menu(const ControlDesc& control) const {
+	return _menuItems.data() + control.firstMenuItem;
+}
+
+/*
+ * Camera class definition (enumeration)
+ */
+Vcap::FormatList Vcap::Camera::formatList() throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+
+	int fd = _camera->fd;
+	std::uint32_t type = _stream->multiplanar() ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	FormatList list;
+	list._formats.reserve(EXPECTED_FORMATS);
+	list._sizes.reserve(EXPECTED_SIZES);
+
+	struct v4l2_fmtdesc fmt;
+	std::memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+
+	for (fmt.index = 0; 0 == xioctl(fd, VIDIOC_ENUM_FMT, &fmt); fmt.index++) {
+		FormatDesc desc;
+
+		desc.code = fmt.pixelformat;
+		desc.codeString[0] = (char)(fmt.pixelformat & 0xFF);
+		desc.codeString[1] = (char)((fmt.pixelformat >> 8) & 0xFF);
+		desc.codeString[2] = (char)((fmt.pixelformat >> 16) & 0xFF);
+		desc.codeString[3] = (char)((fmt.pixelformat >> 24) & 0xFF);
+		desc.codeString[4] = '\0';
+		copyName(desc.description, fmt.description, sizeof(desc.description));
+
+		desc.firstSize = list._sizes.size();
+
+		struct v4l2_frmsizeenum frmsize;
+		std::memset(&frmsize, 0, sizeof(frmsize));
+		frmsize.pixel_format = fmt.pixelformat;
+
+		for (frmsize.index = 0; 0 == xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &frmsize); frmsize.index++) {
+			if (V4L2_FRMSIZE_TYPE_DISCRETE == frmsize.type) {
+				list._sizes.push_back(Size(frmsize.discrete.width, frmsize.discrete.height));
+			} else {
+				//stepwise and continuous ranges are reported by their bounds
+				list._sizes.push_back(Size(frmsize.stepwise.min_width, frmsize.stepwise.min_height));
+				list._sizes.push_back(Size(frmsize.stepwise.max_width, frmsize.stepwise.max_height));
+				break;
+			}
+		}
+
+		desc.numSizes = list._sizes.size() - desc.firstSize;
+
+		list._formats.push_back(desc);
+	}
+
+	if (EINVAL != errno)
+		throw ioctlError("Unable to enumerate formats");
+
+	return list;
+}
+
+Vcap::ControlList Vcap::Camera::controlList() throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+
+	int fd = _camera->fd;
+
+	ControlList list;
+	list._controls.reserve(CTRL_INVALID);
+	list._menuItems.reserve(EXPECTED_MENU_ITEMS);
+
+	for (int id = 0; id < CTRL_INVALID; id++) {
+		struct v4l2_queryctrl query;
+		std::memset(&query, 0, sizeof(query));
+		query.id = controlCid((ControlId)id);
+
+		if (-1 == xioctl(fd, VIDIOC_QUERYCTRL, &query)) {
+			if (EINVAL == errno)
+				continue;
+
+			throw ioctlError("Unable to query control");
+		}
+
+		if (query.flags & V4L2_CTRL_FLAG_DISABLED)
+			continue;
+
+		ControlDesc desc;
+
+		desc.id = (ControlId)id;
+
+		switch (query.type) {
+			case V4L2_CTRL_TYPE_INTEGER:
+				desc.type = CTRL_TYPE_RANGE;
+				break;
+
+			case V4L2_CTRL_TYPE_BOOLEAN:
+				desc.type = CTRL_TYPE_BOOLEAN;
+				break;
+
+			case V4L2_CTRL_TYPE_MENU:
+				desc.type = CTRL_TYPE_MENU;
+				break;
+
+			case V4L2_CTRL_TYPE_BUTTON:
+				desc.type = CTRL_TYPE_BUTTON;
+				break;
+
+			default:
+				desc.type = CTRL_TYPE_INVALID;
+				break;
+		}
+
+		copyName(desc.name, query.name, sizeof(desc.name));
+
+		desc.min = query.minimum;
+		desc.max = query.maximum;
+		desc.step = query.step;
+		desc.defaultValue = query.default_value;
+
+		desc.firstMenuItem = list._menuItems.size();
+
+		if (CTRL_TYPE_MENU == desc.type) {
+			struct v4l2_querymenu menu;
+			std::memset(&menu, 0, sizeof(menu));
+			menu.id = query.id;
+
+			for (std::int32_t i = query.minimum; i <= query.maximum; i++) {
+				menu.index = i;
+
+				//drivers may leave gaps in the menu
+				if (-1 == xioctl(fd, VIDIOC_QUERYMENU, &menu))
+					continue;
+
+				MenuItemDesc item;
+
+				copyName(item.name, menu.name, sizeof(item.name));
+				item.value = i;
+
+				list._menuItems.push_back(item);
+			}
+		}
+
+		desc.numMenuItems = list._menuItems.size() - desc.firstMenuItem;
+
+		list._controls.push_back(desc);
+	}
+
+	return list;
+}
+
+Vcap::DeviceInfo Vcap::Camera::deviceInfo() throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+
+	DeviceInfo info;
+
+	if (!queryDevice(_camera->fd, device(), info))
+		throw ioctlError("Unable to query capabilities");
+
+	return info;
+}
+
+Vcap::Capabilities Vcap::Camera::capabilities() throw (RuntimeError) {
+	Capabilities caps;
+
+	caps._deviceInfo = deviceInfo();
+	caps._formats = formatList();
+	caps._controls = controlList();
+
+	const FormatList& formats = caps._formats;
+
+	caps._frameRateOffsets.reserve(formats._sizes.size() + 1);
+
+	for (std::size_t i = 0; i < formats.size(); i++) {
+		const FormatDesc& format = formats[i];
+		const Size* sizes = formats.sizes(format);
+
+		for (std::size_t j = 0; j < format.numSizes; j++) {
+			caps._frameRateOffsets.push_back(caps._frameRates.size());
+
+			//some drivers cannot report intervals for every size; those sizes simply have no rates
+			try {
+				std::vector<std::uint16_t> rates = frameRates(Format(format.code, sizes[j]));
+				caps._frameRates.insert(caps._frameRates.end(), rates.begin(), rates.end());
+			} catch (RuntimeError&) {
+			}
+		}
+	}
+
+	caps._frameRateOffsets.push_back(caps._frameRates.size());
+
+	return caps;
+}
@@ -0,0 +1,242 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+/*
+ * Exposure ratios are limited per adjustment so a single badly metered frame cannot swing the exposure wildly.
+ */
+static const float MAX_STEP_RATIO = 2.0f;
+
+static std::uint64_t monotonicMs() {
+	return (std::uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::int32_t clampValue(float value, std::int32_t min, std::int32_t max) {
+	if (value < (float)min)
+		return min;
+
+	if (value > (float)max)
+		return max;
+
+	return (std::int32_t)(value + 0.5f);
+}
+
+static const Vcap::ControlDesc* findControl(const Vcap::ControlList& controls, Vcap::ControlId id) {
+	for (std::size_t i = 0; i < controls.size(); i++) {
+		if (controls[i].id == id)
+			return &controls[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Exposure controller class definition
+ */
+Vcap::ExposureController::ExposureController(Camera& camera) throw (RuntimeError) :
+	_camera(camera),
+	_target(118),
+	_tolerance(8),
+	_interval(100),
+	_brightness(0.0f),
+	_lastWrite(0) {
+	for (unsigned int i = 0; i < EXPOSURE_ZONES * EXPOSURE_ZONES; i++)
+		_weights[i] = 1.0f;
+
+	ControlList controls = camera.controlList();
+
+	const ControlDesc* exposure = findControl(controls, CTRL_EXPOSURE_ABSOLUTE);
+
+	if (!exposure)
+		exposure = findControl(controls, CTRL_EXPOSURE);
+
+	if (!exposure)
+		throw RuntimeError("Camera has no exposure control");
+
+	_exposureId = exposure->id;
+	_exposureMin = exposure->min;
+	_exposureMax = exposure->max;
+
+	const ControlDesc* gain = findControl(controls, CTRL_GAIN);
+
+	_hasGain = gain != NULL;
+	_gainMin = gain ? gain->min : 0;
+	_gainMax = gain ? gain->max : 0;
+
+	//the driver's own loops would fight ours
+	std::vector<ControlValue> modes;
+
+	if (findControl(controls, CTRL_EXPOSURE_AUTO)) {
+		ControlValue mode = { CTRL_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL };
+		modes.push_back(mode);
+	}
+
+	if (findControl(controls, CTRL_AUTOGAIN)) {
+		ControlValue mode = { CTRL_AUTOGAIN, 0 };
+		modes.push_back(mode);
+	}
+
+	camera.setControlValues(modes);
+
+	std::vector<ControlValue> values;
+
+	ControlValue value = { _exposureId, 0 };
+	values.push_back(value);
+
+	if (_hasGain) {
+		value.id = CTRL_GAIN;
+		values.push_back(value);
+	}
+
+	camera.controlValues(values);
+
+	_exposure = values[0].value;
+	_gain = _hasGain ? values[1].value : 0;
+}
+
+std::uint8_t Vcap::ExposureController::target() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _target;
+}
+
+void Vcap::ExposureController::setTarget(std::uint8_t target) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_target = target;
+}
+
+void Vcap::ExposureController::setTolerance(std::uint8_t tolerance) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_tolerance = tolerance;
+}
+
+void Vcap::ExposureController::setInterval(unsigned int interval) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_interval = interval;
+}
+
+void Vcap::ExposureController::setZoneWeight(unsigned int row, unsigned int column, float weight) {
+	if (row >= EXPOSURE_ZONES || column >= EXPOSURE_ZONES)
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_weights[row * EXPOSURE_ZONES + column] = weight < 0.0f ? 0.0f : weight;
+}
+
+float Vcap::ExposureController::brightness() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _brightness;
+}
+
+Vcap::LumaStats* Vcap::ExposureController::beginFrame() {
+	std::memset(&_stats, 0, sizeof(_stats));
+
+	return &_stats;
+}
+
+void Vcap::ExposureController::update(const LumaStats& stats) throw (RuntimeError) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	float weighted = 0.0f;
+	float totalWeight = 0.0f;
+
+	for (unsigned int i = 0; i < EXPOSURE_ZONES * EXPOSURE_ZONES; i++) {
+		if (0 == stats.zoneSamples[i] || _weights[i] <= 0.0f)
+			continue;
+
+		weighted += _weights[i] * (float)stats.zoneSum[i] / (float)stats.zoneSamples[i];
+		totalWeight += _weights[i];
+	}
+
+	if (totalWeight <= 0.0f)
+		return;
+
+	_brightness = weighted / totalWeight;
+
+	std::uint64_t now = monotonicMs();
+
+	if (now - _lastWrite < _interval)
+		return;
+
+	float error = _brightness - (float)_target;
+
+	if (error <= (float)_tolerance && error >= -(float)_tolerance)
+		return;
+
+	float ratio = (float)_target / (_brightness < 1.0f ? 1.0f : _brightness);
+
+	if (ratio > MAX_STEP_RATIO)
+		ratio = MAX_STEP_RATIO;
+	else if (ratio < 1.0f / MAX_STEP_RATIO)
+		ratio = 1.0f / MAX_STEP_RATIO;
+
+	std::int32_t exposure = _exposure;
+	std::int32_t gain = _gain;
+	float gainSpan = (float)(_gainMax - _gainMin);
+
+	if (ratio > 1.0f) {
+		//brighten with exposure first; gain only adds noise
+		exposure = clampValue((float)(_exposure > 0 ? _exposure : 1) * ratio, _exposureMin, _exposureMax);
+
+		float residual = ratio * (float)(_exposure > 0 ? _exposure : 1) / (float)(exposure > 0 ? exposure : 1);
+
+		if (_hasGain && residual > 1.0f)
+			gain = clampValue((float)_gain + (residual - 1.0f) * gainSpan, _gainMin, _gainMax);
+	} else {
+		//darken by shedding gain first
+		if (_hasGain && _gain > _gainMin)
+			gain = clampValue((float)_gain - (1.0f - ratio) * gainSpan, _gainMin, _gainMax);
+		else
+			exposure = clampValue((float)_exposure * ratio, _exposureMin, _exposureMax);
+	}
+
+	if (exposure == _exposure && gain == _gain)
+		return;
+
+	std::vector<ControlValue> values;
+
+	ControlValue value = { _exposureId, exposure };
+	values.push_back(value);
+
+	if (_hasGain) {
+		value.id = CTRL_GAIN;
+		value.value = gain;
+		values.push_back(value);
+	}
+
+	_camera.setControlValues(values);
+
+	_exposure = exposure;
+	_gain = gain;
+	_lastWrite = now;
+}
@@ -0,0 +1,236 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include "FrameSize.hpp"
+
+#include <cstdint>
+#include <limits>
+
+/*
+ * Relative CPU cost, per pixel, of turning a frame into what the application consumes. Negative means the format
+ * cannot produce that output.
+ */
+struct FormatCost {
+	float rgb;
+	float gray;
+
+	/*
+	 * Estimated bytes per pixel on the bus for compressed formats; zero for raw formats, whose frames are sized exactly.
+	 */
+	float bytesPerPixel;
+};
+
+/*
+ * Sizes below the target are only chosen as a last resort.
+ */
+static const float UNDERSIZE_PENALTY = 1000.0f;
+
+/*
+ * Cost, per byte, of moving a frame over the bus and into memory.
+ */
+static const float BUS_COST = 0.1f;
+
+/*
+ * Cost, per surplus pixel, of scaling a larger frame down to the target.
+ */
+static const float SCALE_COST = 0.5f;
+
+static FormatCost formatCost(std::uint32_t code) {
+	FormatCost cost = { -1.0f, -1.0f, 0.0f };
+
+	if (Vcap::FMT_RGB24 == code || Vcap::FMT_BGR24 == code) {
+		cost.rgb = 0.1f;
+		cost.gray = 1.0f;
+	} else if (Vcap::FMT_RGB32 == code || Vcap::FMT_BGR32 == code) {
+		cost.rgb = 0.3f;
+		cost.gray = 1.0f;
+	} else if (Vcap::FMT_RGB565 == code) {
+		cost.rgb = 0.5f;
+		cost.gray = 1.0f;
+	} else if (Vcap::FMT_YUYV == code || Vcap::FMT_YVYU == code || Vcap::FMT_UYVY == code || Vcap::FMT_VYUY == code) {
+		cost.rgb = 1.0f;
+		cost.gray = 0.2f;
+	} else if (Vcap::FMT_NV12 == code || Vcap::FMT_NV21 == code || Vcap::FMT_YUV420 == code ||
+			Vcap::FMT_YVU420 == code || Vcap::FMT_NV12M == code || Vcap::FMT_NV21M == code ||
+			Vcap::FMT_YUV420M == code || Vcap::FMT_YVU420M == code) {
+		//the Y plane is already a gray image
+		cost.rgb = 1.0f;
+		cost.gray = 0.1f;
+	} else if (Vcap::FMT_NV16 == code || Vcap::FMT_NV61 == code || Vcap::FMT_NV16M == code ||
+			Vcap::FMT_NV61M == code) {
+		cost.rgb = 1.0f;
+		cost.gray = 0.1f;
+	} else if (Vcap::FMT_M420 == code || Vcap::FMT_HM12 == code || Vcap::FMT_SN9C20X_I420 == code ||
+			Vcap::FMT_KONICA420 == code || Vcap::FMT_SPCA501 == code || Vcap::FMT_SPCA505 == code ||
+			Vcap::FMT_SPCA508 == code || Vcap::FMT_CIT_YYVYUY == code) {
+		//vendor 4:2:0 layouts need their planes gathered before conversion
+		cost.rgb = 1.2f;
+		cost.gray = 0.3f;
+	} else if (Vcap::FMT_GREY == code) {
+		//only replicated into three channels
+		cost.rgb = 0.3f;
+		cost.gray = 0.05f;
+	} else if (Vcap::FMT_Y4 == code || Vcap::FMT_Y6 == code) {
+		cost.rgb = 0.4f;
+		cost.gray = 0.2f;
+	} else if (Vcap::FMT_Y10 == code || Vcap::FMT_Y12 == code || Vcap::FMT_Y16 == code) {
+		cost.rgb = 0.5f;
+		cost.gray = 0.3f;
+	} else if (Vcap::FMT_SBGGR8 == code || Vcap::FMT_SGBRG8 == code || Vcap::FMT_SGRBG8 == code ||
+			Vcap::FMT_SRGGB8 == code) {
+		cost.rgb = 1.5f;
+		cost.gray = 1.5f;
+	} else if (Vcap::FMT_SBGGR10 == code || Vcap::FMT_SGBRG10 == code || Vcap::FMT_SGRBG10 == code ||
+			Vcap::FMT_SRGGB10 == code) {
+		cost.rgb = 1.7f;
+		cost.gray = 1.7f;
+	} else if (Vcap::FMT_SBGGR10ALAW8 == code || Vcap::FMT_SGBRG10ALAW8 == code || Vcap::FMT_SGRBG10ALAW8 == code ||
+			Vcap::FMT_SRGGB10ALAW8 == code || Vcap::FMT_SBGGR10DPCM8 == code || Vcap::FMT_SGBRG10DPCM8 == code ||
+			Vcap::FMT_SGRBG10DPCM8 == code || Vcap::FMT_SRGGB10DPCM8 == code) {
+		//companded samples are expanded before demosaicing
+		cost.rgb = 1.7f;
+		cost.gray = 1.7f;
+	} else if (Vcap::FMT_MJPEG == code || Vcap::FMT_JPEG == code) {
+		//full entropy decode, but a fraction of the bus bandwidth
+		cost.rgb = 4.0f;
+		cost.gray = 3.0f;
+		cost.bytesPerPixel = 0.3f;
+	}
+
+	return cost;
+}
+
+/*
+ * Picks the frame rate to use for a size, or returns false if none meets the requirements. With no minimum, the
+ * highest rate that fits the bandwidth is used; otherwise the lowest rate that satisfies the minimum.
+ */
+static bool chooseRate(const std::uint16_t* rates, std::size_t numRates, float bytesPerFrame,
+		const Vcap::FormatRequirements& requirements, std::uint16_t& rate) {
+	//drivers that cannot report rates leave the rate to the driver
+	if (0 == numRates) {
+		rate = 0;
+		return 0 == requirements.minFrameRate;
+	}
+
+	bool found = false;
+
+	for (std::size_t i = 0; i < numRates; i++) {
+		if (rates[i] < requirements.minFrameRate)
+			continue;
+
+		if (requirements.maxBandwidth && bytesPerFrame * rates[i] > (float)requirements.maxBandwidth)
+			continue;
+
+		bool better = 0 == requirements.minFrameRate ? rates[i] > rate : rates[i] < rate;
+
+		if (!found || better) {
+			rate = rates[i];
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Camera class definition (format selection)
+ */
+Vcap::Format Vcap::Camera::autoSetFormat(const FormatRequirements& requirements) throw (RuntimeError) {
+	return autoSetFormat(requirements, capabilities());
+}
+
+Vcap::Format Vcap::Camera::autoSetFormat(const FormatRequirements& requirements, const Capabilities& capabilities)
+		throw (RuntimeError) {
+	const FormatList& formats = capabilities.formats();
+
+	float bestCost = std::numeric_limits<float>::max();
+	bool found = false;
+
+	std::uint32_t bestCode = 0;
+	Size bestSize(0, 0);
+	std::uint16_t bestRate = 0;
+
+	float target = (float)requirements.width * (float)requirements.height;
+
+	for (std::size_t i = 0; i < formats.size(); i++) {
+		const FormatDesc& format = formats[i];
+		const Size* sizes = formats.sizes(format);
+
+		FormatCost cost = formatCost(format.code);
+
+		float pixelCost;
+
+		if (OUTPUT_RGB == requirements.output)
+			pixelCost = cost.rgb;
+		else if (OUTPUT_GRAY == requirements.output)
+			pixelCost = cost.gray;
+		else
+			pixelCost = 0.0f;
+
+		if (pixelCost < 0.0f)
+			continue;
+
+		for (std::size_t j = 0; j < format.numSizes; j++) {
+			std::size_t sizeIndex = format.firstSize + j;
+
+			float pixels = (float)sizes[j].width() * (float)sizes[j].height();
+			float bytesPerFrame = cost.bytesPerPixel > 0.0f ? pixels * cost.bytesPerPixel :
+					(float)frameBytes(format.code, sizes[j].width(), sizes[j].height());
+
+			std::uint16_t rate = 0;
+
+			if (!chooseRate(capabilities.frameRates(sizeIndex), capabilities.numFrameRates(sizeIndex), bytesPerFrame,
+					requirements, rate))
+				continue;
+
+			//work per frame: producing the output, scaling it to the target, and moving it over the bus
+			float frameCost = pixels * pixelCost + bytesPerFrame * BUS_COST;
+
+			if (requirements.width && requirements.height) {
+				if (sizes[j].width() < requirements.width || sizes[j].height() < requirements.height)
+					frameCost += UNDERSIZE_PENALTY * (target - pixels > 0.0f ? target - pixels : target);
+				else
+					frameCost += SCALE_COST * (pixels - target);
+			}
+
+			if (!found || frameCost < bestCost) {
+				bestCost = frameCost;
+				bestCode = format.code;
+				bestSize = sizes[j];
+				bestRate = rate;
+				found = true;
+			}
+		}
+	}
+
+	if (!found)
+		throw RuntimeError("No format meets the requirements");
+
+	Format best(bestCode, bestSize);
+
+	setFormat(best);
+
+	if (bestRate)
+		setFrameRate(bestRate);
+
+	return best;
+}
@@ -0,0 +1,284 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/FrameLog.hpp>
+
+#include "RecordFormat.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Written data is handed to the kernel for writeback in chunks of this size, so dirty pages do not pile up until the
+ * segment is closed.
+ */
+static const std::size_t WRITEBACK_CHUNK = 16 * 1024 * 1024;
+
+static Vcap::RuntimeError logError(const std::string& message, const std::string& path) {
+	return Vcap::RuntimeError(message + " " + path + ": " + std::strerror(errno));
+}
+
+/*
+ * Frame log class definition
+ */
+Vcap::FrameLog::FrameLog(const std::string& prefix, const Format& format, std::size_t segmentSize,
+		std::uint16_t frameRate) throw (RuntimeError) : _prefix(prefix), _segmentSize(segmentSize),
+		_frameRate(frameRate), _fd(-1), _map(NULL), _offset(0), _flushed(0), _segments(0), _frames(0), _bytes(0) {
+	if (_segmentSize < sizeof(RecordingHeader) + sizeof(RecordHeader))
+		throw RuntimeError("Frame log segment size is too small");
+
+	Format fmt = format;
+
+	_code = fmt.code();
+	_width = fmt.size().width();
+	_height = fmt.size().height();
+
+	openSegment();
+}
+
+Vcap::FrameLog::~FrameLog() {
+	try {
+		close();
+	} catch (RuntimeError& e) {
+		//nothing more can be done from a destructor
+	}
+}
+
+void Vcap::FrameLog::write(const Frame& frame) throw (RuntimeError) {
+	Plane parts[MAX_PLANES];
+	unsigned int numParts = frame.numPlanes();
+
+	for (unsigned int i = 0; i < numParts; i++)
+		parts[i] = frame.plane(i);
+
+	append(RECORD_FRAME, frame.timestamp(), frame.sequence(), parts, numParts);
+}
+
+void Vcap::FrameLog::write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp,
+		std::uint32_t sequence) throw (RuntimeError) {
+	Plane part;
+	part.data = (std::uint8_t*)data;
+	part.size = size;
+	part.stride = 0;
+
+	append(RECORD_FRAME, timestamp, sequence, &part, 1);
+}
+
+void Vcap::FrameLog::mark(std::uint64_t timestamp, std::uint32_t id) throw (RuntimeError) {
+	MarkerRecord marker;
+	marker.id = id;
+	marker.reserved = 0;
+
+	Plane part;
+	part.data = (std::uint8_t*)&marker;
+	part.size = sizeof(marker);
+	part.stride = 0;
+
+	append(RECORD_MARKER, timestamp, 0, &part, 1);
+}
+
+void Vcap::FrameLog::close() throw (RuntimeError) {
+	if (-1 != _fd)
+		closeSegment();
+}
+
+std::string Vcap::FrameLog::segmentPath(std::size_t segment) const {
+	return logSegmentPath(_prefix, segment);
+}
+
+std::size_t Vcap::FrameLog::segments() const {
+	return _segments;
+}
+
+std::uint64_t Vcap::FrameLog::frames() const {
+	return _frames;
+}
+
+std::uint64_t Vcap::FrameLog::bytes() const {
+	return _bytes;
+}
+
+/*
+ * Creates, preallocates and maps the next segment, and writes its header. Preallocation keeps the log from running
+ * out of space in the middle of a frame (which would raise SIGBUS) and keeps the segment contiguous on disk.
+ */
+void Vcap::FrameLog::openSegment() throw (RuntimeError) {
+	std::string path = segmentPath(_segments);
+
+	_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (-1 == _fd)
+		throw logError("Unable to create frame log", path);
+
+	int result = posix_fallocate(_fd, 0, _segmentSize);
+
+	//not every file system can preallocate; a sparse file still works
+	if (EOPNOTSUPP == result || EINVAL == result)
+		result = (0 == ftruncate(_fd, _segmentSize)) ? 0 : errno;
+
+	if (0 != result) {
+		errno = result;
+
+		RuntimeError error = logError("Unable to allocate frame log", path);
+
+		::close(_fd);
+		_fd = -1;
+		throw error;
+	}
+
+	void* map = mmap(NULL, _segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+
+	if (MAP_FAILED == map) {
+		RuntimeError error = logError("Unable to map frame log", path);
+
+		::close(_fd);
+		_fd = -1;
+		throw error;
+	}
+
+	_map = (std::uint8_t*)map;
+
+	RecordingHeader header;
+	initRecordingHeader(header, _code, _width, _height, _frameRate);
+
+	std::memcpy(_map, &header, sizeof(header));
+
+	_offset = sizeof(header);
+	_flushed = 0;
+	_segments++;
+	_index.clear();
+}
+
+/*
+ * Finishes the segment in the layout RecordFormat.hpp describes: the header is updated through the mapping, and the
+ * index is written once it is gone, trimming the preallocated tail.
+ */
+void Vcap::FrameLog::closeSegment() throw (RuntimeError) {
+	std::string path = segmentPath(_segments - 1);
+
+	sortIndex(_index);
+
+	RecordingHeader* header = (RecordingHeader*)_map;
+	header->indexOffset = _offset;
+	header->indexCount = _index.size();
+
+	munmap(_map, _segmentSize);
+	_map = NULL;
+
+	std::size_t indexSize = _index.size() * sizeof(FrameIndexEntry);
+	int error = 0;
+
+	if (indexSize && (ssize_t)indexSize != pwrite(_fd, _index.data(), indexSize, _offset))
+		error = errno ? errno : EIO;
+	else if (0 != ftruncate(_fd, _offset + indexSize))
+		error = errno;
+
+	if (0 != ::close(_fd) && 0 == error)
+		error = errno;
+
+	_fd = -1;
+	_index.clear();
+
+	if (error) {
+		errno = error;
+		throw logError("Unable to write frame log", path);
+	}
+}
+
+/*
+ * Returns space for a record of the given size, starting a new segment if the current one is full.
+ */
+std::uint8_t* Vcap::FrameLog::reserve(std::size_t recordSize) throw (RuntimeError) {
+	if (-1 == _fd)
+		throw RuntimeError("Frame log " + _prefix + " is closed");
+
+	if (recordSize > _segmentSize - sizeof(RecordingHeader) || recordSize > UINT32_MAX)
+		throw RuntimeError("Frame is too large for frame log " + _prefix);
+
+	if (_offset + recordSize > _segmentSize) {
+		closeSegment();
+		openSegment();
+	}
+
+	std::uint8_t* record = _map + _offset;
+
+	_offset += recordSize;
+
+	//start writing back what is complete; this only queues I/O
+	if (_offset - _flushed >= WRITEBACK_CHUNK) {
+		std::size_t start = _flushed & ~(std::size_t)(sysconf(_SC_PAGESIZE) - 1);
+
+		sync_file_range(_fd, start, _offset - start, SYNC_FILE_RANGE_WRITE);
+		_flushed = _offset;
+	}
+
+	return record;
+}
+
+void Vcap::FrameLog::append(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence, const Plane* parts,
+		unsigned int numParts) throw (RuntimeError) {
+	std::size_t size = 0;
+
+	for (unsigned int i = 0; i < numParts; i++)
+		size += parts[i].size;
+
+	std::size_t recordSize = (sizeof(RecordHeader) + size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT *
+			RECORD_ALIGNMENT;
+
+	std::uint8_t* record = reserve(recordSize);
+
+	RecordHeader header;
+	header.type = type;
+	header.recordSize = (std::uint32_t)recordSize;
+	header.timestamp = timestamp;
+	header.sequence = sequence;
+	header.size = (std::uint32_t)size;
+
+	//the header goes in last, so a reader of a crashed segment never sees a record without its payload
+	std::uint8_t* out = record + sizeof(header);
+
+	for (unsigned int i = 0; i < numParts; i++) {
+		std::memcpy(out, parts[i].data, parts[i].size);
+		out += parts[i].size;
+	}
+
+	std::memset(out, 0, recordSize - sizeof(header) - size);
+	std::memcpy(record, &header, sizeof(header));
+
+	if (RECORD_FRAME == type) {
+		FrameIndexEntry entry;
+		entry.timestamp = timestamp;
+		entry.offset = record - _map;
+		entry.sequence = sequence;
+		entry.size = (std::uint32_t)size;
+
+		_index.push_back(entry);
+
+		_frames++;
+	}
+
+	_bytes += recordSize;
+}
@@ -0,0 +1,347 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/FrameLog.hpp>
+
+#include "RecordFormat.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Frames next() keeps requested ahead of the position.
+ */
+static const std::size_t READ_AHEAD = 16;
+
+/*
+ * A mapped segment and its index, either in the mapping or rebuilt by scanning.
+ */
+struct Vcap::FrameLogReader::Segment {
+	std::string path;
+
+	const std::uint8_t* map;
+	std::size_t size;
+
+	const FrameIndexEntry* index;
+	std::size_t count;
+
+	std::vector<FrameIndexEntry> built;
+};
+
+/*
+ * Frame log reader class definition
+ */
+Vcap::FrameLogReader::FrameLogReader(const std::string& path) throw (RuntimeError) : _size(0), _code(0), _width(0),
+		_height(0), _frameRate(0), _created(0), _createdMonotonic(0), _position(0), _prefetched(0) {
+	struct stat st;
+
+	try {
+		if (0 == stat(path.c_str(), &st)) {
+			openSegment(path);
+		} else {
+			for (std::size_t i = 0; ; i++) {
+				std::string segmentPath = logSegmentPath(path, i);
+
+				if (0 != stat(segmentPath.c_str(), &st))
+					break;
+
+				openSegment(segmentPath);
+			}
+
+			if (_segments.empty())
+				throw RuntimeError("No frame log at " + path);
+		}
+	} catch (RuntimeError& e) {
+		for (std::size_t i = 0; i < _segments.size(); i++)
+			munmap((void*)_segments[i].map, _segments[i].size);
+
+		throw;
+	}
+
+	//the segment vector is complete, so rebuilt indexes no longer move
+	for (std::size_t i = 0; i < _segments.size(); i++) {
+		if (!_segments[i].built.empty())
+			_segments[i].index = _segments[i].built.data();
+
+		_starts.push_back(_size);
+		_size += _segments[i].count;
+	}
+}
+
+Vcap::FrameLogReader::~FrameLogReader() {
+	for (std::size_t i = 0; i < _segments.size(); i++)
+		munmap((void*)_segments[i].map, _segments[i].size);
+}
+
+Vcap::Format Vcap::FrameLogReader::format() const {
+	return Format(_code, Size(_width, _height));
+}
+
+std::uint16_t Vcap::FrameLogReader::frameRate() const {
+	return _frameRate;
+}
+
+std::size_t Vcap::FrameLogReader::size() const {
+	return _size;
+}
+
+std::size_t Vcap::FrameLogReader::segments() const {
+	return _segments.size();
+}
+
+Vcap::FrameView Vcap::FrameLogReader::frame(std::size_t index) const throw (RuntimeError) {
+	if (index >= _size)
+		throw RuntimeError("Frame index out of range");
+
+	const Segment& segment = _segments[segmentOf(index)];
+	const FrameIndexEntry& e = entry(index);
+
+	if (e.offset > segment.size || segment.size - e.offset < sizeof(RecordHeader) + (std::size_t)e.size)
+		throw RuntimeError("Corrupt index in " + segment.path);
+
+	FrameView view;
+	view.data = segment.map + e.offset + sizeof(RecordHeader);
+	view.size = e.size;
+	view.timestamp = e.timestamp;
+	view.sequence = e.sequence;
+
+	return view;
+}
+
+/*
+ * Binary search over all frames; segments are written in order, so timestamps increase across them.
+ */
+std::size_t Vcap::FrameLogReader::seek(std::uint64_t timestamp) const {
+	std::size_t first = 0;
+	std::size_t last = _size;
+
+	while (first < last) {
+		std::size_t middle = first + (last - first) / 2;
+
+		if (entry(middle).timestamp < timestamp)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return first;
+}
+
+std::uint64_t Vcap::FrameLogReader::wallClock(std::uint64_t timestamp) const {
+	//recordings from before the monotonic creation time was stored
+	if (0 == _createdMonotonic)
+		return 0;
+
+	return (std::uint64_t)((std::int64_t)_created + ((std::int64_t)timestamp - (std::int64_t)_createdMonotonic));
+}
+
+void Vcap::FrameLogReader::prefetch(std::size_t index, std::size_t count) const {
+	if (index >= _size)
+		return;
+
+	count = std::min(count, _size - index);
+
+	while (count > 0) {
+		std::size_t s = segmentOf(index);
+		const Segment& segment = _segments[s];
+
+		std::size_t local = index - _starts[s];
+		std::size_t n = std::min(count, segment.count - local);
+
+		std::uint64_t start = segment.size;
+		std::uint64_t end = 0;
+
+		for (std::size_t i = local; i < local + n; i++) {
+			start = std::min(start, segment.index[i].offset);
+			end = std::max(end, segment.index[i].offset + sizeof(RecordHeader) + segment.index[i].size);
+		}
+
+		end = std::min(end, (std::uint64_t)segment.size);
+
+		if (start < end) {
+			std::uint64_t page = start & ~(std::uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+
+			madvise((void*)(segment.map + page), end - page, MADV_WILLNEED);
+		}
+
+		index += n;
+		count -= n;
+	}
+}
+
+void Vcap::FrameLogReader::setPosition(std::size_t index) {
+	_position = std::min(index, _size);
+	_prefetched = _position;
+}
+
+std::size_t Vcap::FrameLogReader::position() const {
+	return _position;
+}
+
+bool Vcap::FrameLogReader::next(FrameView& frame) throw (RuntimeError) {
+	if (_position >= _size)
+		return false;
+
+	//request the next batch while half of the current one is still ahead
+	if (_prefetched < _position + READ_AHEAD / 2) {
+		std::size_t from = std::max(_prefetched, _position);
+
+		prefetch(from, READ_AHEAD);
+		_prefetched = from + READ_AHEAD;
+	}
+
+	frame = this->frame(_position++);
+
+	return true;
+}
+
+void Vcap::FrameLogReader::openSegment(const std::string& path) throw (RuntimeError) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (-1 == fd)
+		throw RuntimeError("Unable to open frame log " + path + ": " + std::strerror(errno));
+
+	struct stat st;
+
+	if (0 != fstat(fd, &st) || (std::size_t)st.st_size < sizeof(RecordingHeader)) {
+		::close(fd);
+		throw RuntimeError(path + " is not a recording");
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	::close(fd);
+
+	if (MAP_FAILED == map)
+		throw RuntimeError("Unable to map frame log " + path + ": " + std::strerror(errno));
+
+	Segment segment;
+	segment.path = path;
+	segment.map = (const std::uint8_t*)map;
+	segment.size = st.st_size;
+	segment.index = NULL;
+	segment.count = 0;
+
+	_segments.push_back(segment);
+
+	Segment& added = _segments.back();
+
+	RecordingHeader header;
+	std::memcpy(&header, added.map, sizeof(header));
+
+	if (0 != std::memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)))
+		throw RuntimeError(path + " is not a recording");
+
+	if (header.version > RECORDING_VERSION || header.headerSize < sizeof(header) || header.headerSize > added.size)
+		throw RuntimeError("Unsupported recording version in " + path);
+
+	if (1 == _segments.size()) {
+		_code = header.code;
+		_width = header.width;
+		_height = header.height;
+		_frameRate = (std::uint16_t)header.frameRate;
+		_created = header.created;
+		_createdMonotonic = header.createdMonotonic;
+	}
+
+	madvise((void*)added.map, added.size, MADV_RANDOM);
+
+	bool indexed = header.indexOffset >= header.headerSize && 0 == header.indexOffset % RECORD_ALIGNMENT &&
+			header.indexOffset <= added.size &&
+			header.indexCount <= (added.size - header.indexOffset) / sizeof(FrameIndexEntry);
+
+	if (indexed) {
+		added.index = (const FrameIndexEntry*)(added.map + header.indexOffset);
+		added.count = header.indexCount;
+	} else {
+		buildIndex(added);
+	}
+}
+
+/*
+ * Indexes a segment without an index by walking its records, stopping at the first zeroed or truncated one as
+ * Replay does.
+ */
+void Vcap::FrameLogReader::buildIndex(Segment& segment) throw (RuntimeError) {
+	RecordingHeader header;
+	std::memcpy(&header, segment.map, sizeof(header));
+
+	std::size_t end = segment.size;
+
+	if (header.indexOffset > 0 && header.indexOffset < end)
+		end = header.indexOffset;
+
+	madvise((void*)segment.map, segment.size, MADV_SEQUENTIAL);
+
+	std::size_t offset = header.headerSize;
+
+	while (end - offset >= sizeof(RecordHeader)) {
+		RecordHeader record;
+		std::memcpy(&record, segment.map + offset, sizeof(record));
+
+		if (record.recordSize < sizeof(record) || record.recordSize > end - offset)
+			break;
+
+		if (RECORD_FRAME == record.type && record.size <= record.recordSize - sizeof(record)) {
+			FrameIndexEntry entry;
+			entry.timestamp = record.timestamp;
+			entry.offset = offset;
+			entry.sequence = record.sequence;
+			entry.size = record.size;
+
+			segment.built.push_back(entry);
+		}
+
+		offset += record.recordSize;
+	}
+
+	madvise((void*)segment.map, segment.size, MADV_RANDOM);
+
+	sortIndex(segment.built);
+
+	segment.count = segment.built.size();
+}
+
+/*
+ * Returns the segment holding a frame. Empty segments share their start with the next one, so the search skips
+ * back over them.
+ */
+std::size_t Vcap::FrameLogReader::segmentOf(std::size_t index) const {
+	std::size_t s = std::upper_bound(_starts.begin(), _starts.end(), index) - _starts.begin() - 1;
+
+	while (s > 0 && 0 == _segments[s].count)
+		s--;
+
+	return s;
+}
+
+const Vcap::FrameIndexEntry& Vcap::FrameLogReader::entry(std::size_t index) const {
+	std::size_t s = segmentOf(index);
+
+	return _segments[s].index[index - _starts[s]];
+}
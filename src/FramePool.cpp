@@ -0,0 +1,361 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include "FrameSize.hpp"
+#include "SlotArray.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Buffers are aligned to this boundary so SIMD decoders and O_DIRECT writers can consume them directly.
+ */
+static const std::size_t FRAME_ALIGNMENT = 4096;
+
+/*
+ * Size of a huge page on the platforms we care about.
+ */
+static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static std::size_t alignUp(std::size_t value, std::size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Frame class definition
+ */
+Vcap::Frame::Frame() : _slot(NULL) {
+}
+
+Vcap::Frame::Frame(FrameSlot* slot) : _slot(slot) {
+}
+
+Vcap::Frame::Frame(const Frame& frame) : _slot(frame._slot) {
+	if (_slot)
+		_slot->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+Vcap::Frame::Frame(Frame&& frame) noexcept : _slot(frame._slot) {
+	frame._slot = NULL;
+}
+
+Vcap::Frame::~Frame() {
+	release();
+}
+
+Vcap::Frame& Vcap::Frame::operator = (const Frame& frame) {
+	if (_slot != frame._slot) {
+		if (frame._slot)
+			frame._slot->refs.fetch_add(1, std::memory_order_relaxed);
+
+		release();
+
+		_slot = frame._slot;
+	}
+
+	return *this;
+}
+
+Vcap::Frame& Vcap::Frame::operator = (Frame&& frame) noexcept {
+	if (this != &frame) {
+		release();
+
+		_slot = frame._slot;
+		frame._slot = NULL;
+	}
+
+	return *this;
+}
+
+bool Vcap::Frame::valid() const {
+	return _slot != NULL;
+}
+
+std::uint8_t* Vcap::Frame::data() const {
+	return _slot ? _slot->data : NULL;
+}
+
+std::size_t Vcap::Frame::size() const {
+	return _slot ? _slot->size : 0;
+}
+
+unsigned int Vcap::Frame::numPlanes() const {
+	if (!_slot)
+		return 0;
+
+	return _slot->numPlanes > 1 ? _slot->numPlanes : 1;
+}
+
+Vcap::Plane Vcap::Frame::plane(unsigned int index) const {
+	if (_slot && _slot->numPlanes > 1 && index < _slot->numPlanes)
+		return _slot->planes[index];
+
+	Plane plane;
+
+	plane.data = (_slot && 0 == index) ? _slot->data : NULL;
+	plane.size = (_slot && 0 == index) ? _slot->size : 0;
+	plane.stride = (_slot && 0 == index) ? _slot->stride : 0;
+
+	return plane;
+}
+
+std::size_t Vcap::Frame::capacity() const {
+	return _slot ? _slot->capacity : 0;
+}
+
+std::uint32_t Vcap::Frame::index() const {
+	return _slot ? _slot->index : 0;
+}
+
+int Vcap::Frame::fd() const {
+	return _slot ? _slot->fd : -1;
+}
+
+std::uint32_t Vcap::Frame::sequence() const {
+	return _slot ? _slot->sequence : 0;
+}
+
+std::uint64_t Vcap::Frame::timestamp() const {
+	return _slot ? _slot->timestamp : 0;
+}
+
+void Vcap::Frame::release() {
+	if (!_slot)
+		return;
+
+	if (_slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		_slot->owner->recycle(_slot);
+
+	_slot = NULL;
+}
+
+/*
+ * Frame pool class definition
+ */
+Vcap::FramePool::FramePool(std::size_t count, std::size_t frameSize, bool hugePages) {
+	allocate(count, frameSize, hugePages);
+}
+
+Vcap::FramePool::FramePool(std::size_t count, const Format& format, bool hugePages) {
+	Format fmt = format;
+
+	std::size_t width = fmt.size().width();
+	std::size_t height = fmt.size().height();
+
+	//big enough for a raw grab as well as a decoded one
+	allocate(count, std::max(3 * width * height, frameBytes(fmt.code(), width, height)), hugePages);
+}
+
+/*
+ * Frames still checked out keep the buffers (and slots) alive until they are released.
+ */
+Vcap::FramePool::~FramePool() {
+	_slots->retire(_memory, _memorySize);
+}
+
+void Vcap::FramePool::allocate(std::size_t count, std::size_t frameSize, bool hugePages) {
+	if (0 == count || 0 == frameSize)
+		throw RuntimeError("Frame pool requires a non-zero buffer count and size");
+
+	_count = count;
+	_frameSize = frameSize;
+
+	std::size_t stride = alignUp(frameSize, FRAME_ALIGNMENT);
+
+	_memory = (std::uint8_t*)MAP_FAILED;
+
+	//prefer explicit huge pages, fall back to transparent huge pages
+	if (hugePages) {
+		_memorySize = alignUp(count * stride, HUGE_PAGE_SIZE);
+		_memory = (std::uint8_t*)mmap(NULL, _memorySize, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+	}
+
+	if (MAP_FAILED == _memory) {
+		_memorySize = alignUp(count * stride, FRAME_ALIGNMENT);
+		_memory = (std::uint8_t*)mmap(NULL, _memorySize, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+		if (MAP_FAILED == _memory)
+			throw RuntimeError(std::string("Unable to allocate frame pool: ") + std::strerror(errno));
+
+		if (hugePages)
+			madvise(_memory, _memorySize, MADV_HUGEPAGE);
+	}
+
+	_slots = SlotArray::create(this, count);
+
+	if (!_slots) {
+		munmap(_memory, _memorySize);
+		throw RuntimeError("Unable to allocate frame pool slots");
+	}
+
+	_free.reserve(count);
+
+	FrameSlot* slots = _slots->slots();
+
+	for (std::size_t i = 0; i < count; i++) {
+		slots[i].data = _memory + i * stride;
+		slots[i].capacity = frameSize;
+		slots[i].numPlanes = 1;
+
+		_free.push_back(&slots[i]);
+	}
+}
+
+Vcap::Frame Vcap::FramePool::acquire() {
+	FrameSlot* slot;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_free.empty())
+			return Frame();
+
+		slot = _free.back();
+		_free.pop_back();
+	}
+
+	_slots->checkout(slot);
+	slot->size = 0;
+
+	return Frame(slot);
+}
+
+std::size_t Vcap::FramePool::count() const {
+	return _count;
+}
+
+std::size_t Vcap::FramePool::frameSize() const {
+	return _frameSize;
+}
+
+std::size_t Vcap::FramePool::available() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _free.size();
+}
+
+void Vcap::FramePool::recycle(FrameSlot* slot) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_free.push_back(slot);
+}
+
+/*
+ * Slot array class definition
+ */
+Vcap::SlotArray* Vcap::SlotArray::create(FrameOwner* owner, std::size_t count) {
+	FrameSlot* slots = new (std::nothrow) FrameSlot[count];
+
+	if (!slots)
+		return NULL;
+
+	SlotArray* array = new (std::nothrow) SlotArray(owner, slots, count);
+
+	if (!array)
+		delete [] slots;
+
+	return array;
+}
+
+Vcap::SlotArray::SlotArray(FrameOwner* owner, FrameSlot* slots, std::size_t count) : _owner(owner), _slots(slots),
+		_count(count), _outstanding(0), _memory(NULL), _memorySize(0) {
+	for (std::size_t i = 0; i < _count; i++) {
+		_slots[i].owner = this;
+		_slots[i].refs.store(0, std::memory_order_relaxed);
+		_slots[i].index = (std::uint32_t)i;
+		_slots[i].fd = -1;
+		_slots[i].data = NULL;
+		_slots[i].capacity = 0;
+		_slots[i].size = 0;
+		_slots[i].stride = 0;
+		_slots[i].numPlanes = 0;
+		_slots[i].sequence = 0;
+		_slots[i].timestamp = 0;
+	}
+}
+
+Vcap::SlotArray::~SlotArray() {
+	delete [] _slots;
+
+	if (_memory)
+		munmap(_memory, _memorySize);
+}
+
+Vcap::FrameSlot* Vcap::SlotArray::slots() {
+	return _slots;
+}
+
+std::size_t Vcap::SlotArray::count() const {
+	return _count;
+}
+
+void Vcap::SlotArray::checkout(FrameSlot* slot) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	slot->refs.store(1, std::memory_order_relaxed);
+	_outstanding++;
+}
+
+void Vcap::SlotArray::retire(void* memory, std::size_t memorySize) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_owner = NULL;
+		_memory = memory;
+		_memorySize = memorySize;
+
+		if (_outstanding > 0)
+			return;
+	}
+
+	delete this;
+}
+
+/*
+ * The owner is called with the lock held, so it cannot be retired (and destroyed) in the middle of the call.
+ */
+void Vcap::SlotArray::recycle(FrameSlot* slot) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_outstanding--;
+
+		if (_owner) {
+			_owner->recycle(slot);
+			return;
+		}
+
+		if (_outstanding > 0)
+			return;
+	}
+
+	delete this;
+}
@@ -0,0 +1,81 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_FRAME_SIZE_HPP
+#define _VCAP_FRAME_SIZE_HPP
+
+/*
+ * Sizes of raw frames, for code that has to reserve room for them before the driver reports one. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Vcap {
+	/*
+	 * Bits per pixel of raw frames. Formats not listed (compressed and vendor formats) get the 32-bit worst case.
+	 */
+	struct FormatBits {
+		std::uint32_t code;
+		unsigned int bits;
+	};
+
+	static const FormatBits FORMAT_BITS[] = {
+		{ FMT_GREY, 8 }, { FMT_Y4, 8 }, { FMT_Y6, 8 }, { FMT_UV8, 8 }, { FMT_RGB332, 8 }, { FMT_PAL8, 8 },
+		{ FMT_HI240, 8 }, { FMT_SBGGR8, 8 }, { FMT_SGBRG8, 8 }, { FMT_SGRBG8, 8 }, { FMT_SRGGB8, 8 },
+		{ FMT_SBGGR10ALAW8, 8 }, { FMT_SGBRG10ALAW8, 8 }, { FMT_SGRBG10ALAW8, 8 }, { FMT_SRGGB10ALAW8, 8 },
+		{ FMT_SBGGR10DPCM8, 8 }, { FMT_SGBRG10DPCM8, 8 }, { FMT_SGRBG10DPCM8, 8 }, { FMT_SRGGB10DPCM8, 8 },
+		{ FMT_YUV410, 9 }, { FMT_YVU410, 9 },
+		{ FMT_NV12, 12 }, { FMT_NV21, 12 }, { FMT_NV12M, 12 }, { FMT_NV21M, 12 }, { FMT_NV12MT, 12 },
+		{ FMT_NV12MT_16X16, 12 }, { FMT_YUV420, 12 }, { FMT_YVU420, 12 }, { FMT_YUV420M, 12 }, { FMT_YVU420M, 12 },
+		{ FMT_YUV411P, 12 }, { FMT_Y41P, 12 }, { FMT_M420, 12 }, { FMT_HM12, 12 }, { FMT_SN9C20X_I420, 12 },
+		{ FMT_KONICA420, 12 }, { FMT_CIT_YYVYUY, 12 }, { FMT_SPCA501, 12 }, { FMT_SPCA505, 12 }, { FMT_SPCA508, 12 },
+		{ FMT_YUYV, 16 }, { FMT_YVYU, 16 }, { FMT_UYVY, 16 }, { FMT_VYUY, 16 }, { FMT_YYUV, 16 }, { FMT_NV16, 16 },
+		{ FMT_NV61, 16 }, { FMT_NV16M, 16 }, { FMT_NV61M, 16 }, { FMT_YUV422P, 16 }, { FMT_YUV444, 16 },
+		{ FMT_YUV555, 16 }, { FMT_YUV565, 16 }, { FMT_RGB444, 16 }, { FMT_RGB555, 16 }, { FMT_RGB565, 16 },
+		{ FMT_RGB555X, 16 }, { FMT_RGB565X, 16 }, { FMT_Y10, 16 }, { FMT_Y12, 16 }, { FMT_Y16, 16 },
+		{ FMT_SBGGR10, 16 }, { FMT_SGBRG10, 16 }, { FMT_SGRBG10, 16 }, { FMT_SRGGB10, 16 }, { FMT_SBGGR12, 16 },
+		{ FMT_SGBRG12, 16 }, { FMT_SGRBG12, 16 }, { FMT_SRGGB12, 16 }, { FMT_SBGGR16, 16 },
+		{ FMT_RGB24, 24 }, { FMT_BGR24, 24 }, { FMT_NV24, 24 }, { FMT_NV42, 24 }
+	};
+
+	inline unsigned int bitsPerPixel(std::uint32_t code) {
+		for (const FormatBits& format : FORMAT_BITS) {
+			if (format.code == code)
+				return format.bits;
+		}
+
+		return 32;
+	}
+
+	/*
+	 * Bytes in a raw frame of the given format and size. Chroma planes of odd-sized frames round up.
+	 */
+	inline std::size_t frameBytes(std::uint32_t code, std::uint32_t width, std::uint32_t height) {
+		std::size_t w = ((std::size_t)width + 1) & ~(std::size_t)1;
+		std::size_t h = ((std::size_t)height + 1) & ~(std::size_t)1;
+
+		return (w * h * bitsPerPixel(code) + 7) / 8;
+	}
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_IOCTL_HPP
+#define _VCAP_IOCTL_HPP
+
+/*
+ * Helpers for code that issues V4L2 ioctls directly. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/ioctl.h>
+
+namespace Vcap {
+	/*
+	 * ioctl() that retries when interrupted by a signal.
+	 */
+	inline int xioctl(int fd, unsigned long request, void* arg) {
+		int result;
+
+		do {
+			result = ioctl(fd, request, arg);
+		} while (-1 == result && EINTR == errno);
+
+		return result;
+	}
+
+	/*
+	 * Builds an error from a description and the current errno.
+	 */
+	inline RuntimeError ioctlError(const char* what) {
+		return RuntimeError(std::string(what) + ": " + std::strerror(errno));
+	}
+
+	/*
+	 * Status for a call that failed and set errno. Some Vcap calls fail without setting it; those report EIO.
+	 */
+	inline Status errnoStatus(const char* what) {
+		return Status(errno ? errno : EIO, what);
+	}
+
+	/*
+	 * Throws the exception equivalent of a failed status: DeviceLostError if the device is gone, RuntimeError
+	 * otherwise.
+	 */
+	[[noreturn]] inline void throwStatus(const Status& status, const char* device) {
+		if (ENODEV == status.error())
+			throw DeviceLostError(std::string("Device lost: ") + device);
+
+		throw RuntimeError(std::string(status.message()) + ": " + std::strerror(status.error()));
+	}
+}
+
+#endif
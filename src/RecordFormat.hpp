@@ -0,0 +1,153 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_RECORD_FORMAT_HPP
+#define _VCAP_RECORD_FORMAT_HPP
+
+/*
+ * On-disk layout of recordings and frame log segments: a fixed header followed by records, each starting on an 8-byte
+ * boundary. Records carry their full size, so readers can skip record types they do not know. Frame log segments are
+ * preallocated, so the records may be followed by zeroes (a record of size 0 ends the data) and, once the segment is
+ * complete, by an index of its frames sorted by timestamp, which the header points at. Fields are in host byte order.
+ * Not installed.
+ */
+
+#include <Vcap/FrameLog.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+namespace Vcap {
+	const char RECORDING_MAGIC[8] = { 'V', 'C', 'A', 'P', 'R', 'E', 'C', '\0' };
+	const std::uint32_t RECORDING_VERSION = 1;
+	const std::uint32_t RECORD_ALIGNMENT = 8;
+
+	enum RecordType {
+		RECORD_FRAME = 1,	// frame payload
+		RECORD_CONTROL = 2,	// ControlRecord
+		RECORD_FORMAT = 3,	// FormatRecord
+		RECORD_MARKER = 4,	// MarkerRecord
+		RECORD_PADDING = 5	// nothing; fills up to a block boundary for direct I/O
+	};
+
+	struct RecordingHeader {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t headerSize;
+
+		std::uint32_t code;
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint32_t frameRate;
+
+		std::uint64_t created;		// us since the epoch
+		std::uint64_t createdMonotonic;	// us, CLOCK_MONOTONIC at creation, relating timestamps to wall-clock time
+
+		std::uint64_t indexOffset;	// FrameIndexEntry array, or 0 if there is none
+		std::uint64_t indexCount;
+	};
+
+	struct RecordHeader {
+		std::uint32_t type;
+		std::uint32_t recordSize;	// header, payload and padding
+		std::uint64_t timestamp;	// us, CLOCK_MONOTONIC
+		std::uint32_t sequence;
+		std::uint32_t size;			// payload bytes
+	};
+
+	struct ControlRecord {
+		std::uint32_t id;
+		std::int32_t value;
+	};
+
+	struct FormatRecord {
+		std::uint32_t code;
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint32_t frameRate;
+	};
+
+	struct MarkerRecord {
+		std::uint32_t id;
+		std::uint32_t reserved;
+	};
+
+	static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader layout");
+	static_assert(sizeof(RecordHeader) == 24, "RecordHeader layout");
+
+	/*
+	 * Current CLOCK_MONOTONIC time in microseconds, the clock record timestamps are in.
+	 */
+	inline std::uint64_t monotonicTime() {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return (std::uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+	/*
+	 * Fills in the header of a new recording or segment, stamping it with both clocks.
+	 */
+	inline void initRecordingHeader(RecordingHeader& header, std::uint32_t code, std::uint32_t width,
+			std::uint32_t height, std::uint32_t frameRate) {
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+		header.version = RECORDING_VERSION;
+		header.headerSize = sizeof(header);
+		header.code = code;
+		header.width = width;
+		header.height = height;
+		header.frameRate = frameRate;
+		header.created = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+		header.createdMonotonic = monotonicTime();
+	}
+
+	/*
+	 * Path of a frame log segment: the prefix followed by _NNNNNN.vlog.
+	 */
+	inline std::string logSegmentPath(const std::string& prefix, std::size_t segment) {
+		char suffix[32];
+
+		std::snprintf(suffix, sizeof(suffix), "_%06zu.vlog", segment);
+
+		return prefix + suffix;
+	}
+
+	/*
+	 * Orders index entries by timestamp, keeping frames with equal timestamps in the order they were written.
+	 */
+	inline void sortIndex(std::vector<FrameIndexEntry>& index) {
+		std::stable_sort(index.begin(), index.end(), [](const FrameIndexEntry& a, const FrameIndexEntry& b) {
+			return a.timestamp < b.timestamp;
+		});
+	}
+}
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/Recording.hpp>
+
+#include "RecordFormat.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+/*
+ * Stdio buffer for recordings; large enough that frames are written with few system calls.
+ */
+static const std::size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+static Vcap::RuntimeError writeError(const std::string& path) {
+	return Vcap::RuntimeError("Unable to write recording " + path + ": " + std::strerror(errno));
+}
+
+/*
+ * Target of the control callback. The camera may still be running a callback after it has been removed, so the
+ * callback holds this rather than the recorder, and close() detaches it.
+ */
+struct Vcap::Recorder::ControlSink {
+	std::mutex mutex;
+	Recorder* recorder;
+};
+
+/*
+ * Recorder class definition
+ */
+Vcap::Recorder::Recorder(const std::string& path, const Format& format, std::uint16_t frameRate)
+		throw (RuntimeError) : _path(path), _camera(NULL), _callback(0), _frames(0), _bytes(0) {
+	_file = std::fopen(path.c_str(), "wb");
+
+	if (!_file)
+		throw RuntimeError("Unable to create recording " + path + ": " + std::strerror(errno));
+
+	std::setvbuf(_file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+	Format fmt = format;
+
+	RecordingHeader header;
+	initRecordingHeader(header, fmt.code(), fmt.size().width(), fmt.size().height(), frameRate);
+
+	if (1 != std::fwrite(&header, sizeof(header), 1, _file)) {
+		RuntimeError error = writeError(path);
+
+		std::fclose(_file);
+		throw error;
+	}
+}
+
+Vcap::Recorder::~Recorder() {
+	try {
+		close();
+	} catch (RuntimeError& e) {
+		//nothing more can be done from a destructor
+	}
+}
+
+void Vcap::Recorder::write(const Frame& frame) throw (RuntimeError) {
+	Plane parts[MAX_PLANES];
+	unsigned int numParts = frame.numPlanes();
+
+	for (unsigned int i = 0; i < numParts; i++)
+		parts[i] = frame.plane(i);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!writeRecord(RECORD_FRAME, frame.timestamp(), frame.sequence(), parts, numParts))
+		throw writeError(_path);
+
+	_frames++;
+}
+
+void Vcap::Recorder::write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp,
+		std::uint32_t sequence) throw (RuntimeError) {
+	Plane part;
+	part.data = (std::uint8_t*)data;
+	part.size = size;
+	part.stride = 0;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!writeRecord(RECORD_FRAME, timestamp, sequence, &part, 1))
+		throw writeError(_path);
+
+	_frames++;
+}
+
+void Vcap::Recorder::writeControl(ControlId id, std::int32_t value, std::uint64_t timestamp) throw (RuntimeError) {
+	ControlRecord control;
+	control.id = (std::uint32_t)id;
+	control.value = value;
+
+	Plane part;
+	part.data = (std::uint8_t*)&control;
+	part.size = sizeof(control);
+	part.stride = 0;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!writeRecord(RECORD_CONTROL, timestamp, 0, &part, 1))
+		throw writeError(_path);
+}
+
+void Vcap::Recorder::writeFormat(const Format& format, std::uint16_t frameRate) throw (RuntimeError) {
+	Format fmt = format;
+
+	FormatRecord record;
+	record.code = fmt.code();
+	record.width = fmt.size().width();
+	record.height = fmt.size().height();
+	record.frameRate = frameRate;
+
+	Plane part;
+	part.data = (std::uint8_t*)&record;
+	part.size = sizeof(record);
+	part.stride = 0;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!writeRecord(RECORD_FORMAT, monotonicTime(), 0, &part, 1))
+		throw writeError(_path);
+}
+
+void Vcap::Recorder::recordControls(Camera& camera) throw (RuntimeError) {
+	if (_camera)
+		throw RuntimeError("Recorder is already recording controls");
+
+	if (!camera.watchingControls())
+		camera.watchControls();
+
+	_camera = &camera;
+	_controls = std::make_shared<ControlSink>();
+	_controls->recorder = this;
+
+	std::shared_ptr<ControlSink> sink = _controls;
+
+	//runs on the camera's event thread; a failed write will also fail the next frame, which reports it
+	_callback = camera.addControlCallback([sink](ControlId id, std::int32_t value) {
+		std::lock_guard<std::mutex> sinkLock(sink->mutex);
+
+		if (!sink->recorder)
+			return;
+
+		ControlRecord control;
+		control.id = (std::uint32_t)id;
+		control.value = value;
+
+		Plane part;
+		part.data = (std::uint8_t*)&control;
+		part.size = sizeof(control);
+		part.stride = 0;
+
+		std::lock_guard<std::mutex> lock(sink->recorder->_mutex);
+
+		sink->recorder->writeRecord(RECORD_CONTROL, monotonicTime(), 0, &part, 1);
+	});
+}
+
+void Vcap::Recorder::close() throw (RuntimeError) {
+	if (_camera) {
+		_camera->removeControlCallback(_callback);
+		_camera = NULL;
+
+		std::lock_guard<std::mutex> lock(_controls->mutex);
+
+		_controls->recorder = NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_file)
+		return;
+
+	int result = std::fclose(_file);
+	_file = NULL;
+
+	if (0 != result)
+		throw writeError(_path);
+}
+
+std::uint64_t Vcap::Recorder::frames() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _frames;
+}
+
+std::uint64_t Vcap::Recorder::bytes() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _bytes;
+}
+
+bool Vcap::Recorder::writeRecord(std::uint32_t type, std::uint64_t timestamp, std::uint32_t sequence,
+		const Plane* parts, unsigned int numParts) {
+	if (!_file) {
+		errno = EBADF;
+		return false;
+	}
+
+	std::size_t size = 0;
+
+	for (unsigned int i = 0; i < numParts; i++)
+		size += parts[i].size;
+
+	std::size_t recordSize = (sizeof(RecordHeader) + size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT *
+			RECORD_ALIGNMENT;
+
+	if (recordSize > UINT32_MAX) {
+		errno = EFBIG;
+		return false;
+	}
+
+	RecordHeader header;
+	header.type = type;
+	header.recordSize = (std::uint32_t)recordSize;
+	header.timestamp = timestamp;
+	header.sequence = sequence;
+	header.size = (std::uint32_t)size;
+
+	static const std::uint8_t padding[RECORD_ALIGNMENT] = { 0 };
+
+	if (1 != std::fwrite(&header, sizeof(header), 1, _file))
+		return false;
+
+	for (unsigned int i = 0; i < numParts; i++) {
+		if (parts[i].size > 0 && 1 != std::fwrite(parts[i].data, parts[i].size, 1, _file))
+			return false;
+	}
+
+	std::size_t pad = recordSize - sizeof(header) - size;
+
+	if (pad > 0 && 1 != std::fwrite(padding, pad, 1, _file))
+		return false;
+
+	if (RECORD_FRAME == type)
+		_bytes += size;
+
+	return true;
+}
@@ -0,0 +1,348 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/Recording.hpp>
+
+#include "RecordFormat.hpp"
+
+extern "C" {
+#include <vcap/decode.h>
+}
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <time.h>
+
+/*
+ * Stdio buffer for playback.
+ */
+static const std::size_t READ_BUFFER_SIZE = 1024 * 1024;
+
+/*
+ * Replay class definition
+ */
+Vcap::Replay::Replay(const std::string& path, bool realTime) throw (RuntimeError) : _path(path), _file(NULL),
+		_dataEnd(0), _padding(0), _realTime(realTime), _loop(false), _capturing(false), _finished(false),
+		_firstTimestamp(0), _startTime(0), _paced(false) {
+	_file = std::fopen(path.c_str(), "rb");
+
+	if (!_file)
+		throw RuntimeError("Unable to open recording " + path + ": " + std::strerror(errno));
+
+	std::setvbuf(_file, NULL, _IOFBF, READ_BUFFER_SIZE);
+
+	try {
+		rewind();
+	} catch (RuntimeError& e) {
+		std::fclose(_file);
+		throw;
+	}
+}
+
+Vcap::Replay::~Replay() {
+	std::fclose(_file);
+}
+
+Vcap::Format Vcap::Replay::format() throw (RuntimeError) {
+	return Format(_code, Size(_width, _height));
+}
+
+std::uint16_t Vcap::Replay::frameRate() {
+	return _frameRate;
+}
+
+void Vcap::Replay::start() throw (RuntimeError) {
+	rewind();
+
+	_capturing = true;
+	_finished = false;
+}
+
+void Vcap::Replay::stop() throw (RuntimeError) {
+	_capturing = false;
+}
+
+bool Vcap::Replay::capturing() {
+	return _capturing;
+}
+
+bool Vcap::Replay::finished() {
+	return _finished;
+}
+
+void Vcap::Replay::setRealTime(bool realTime) {
+	_realTime = realTime;
+	_paced = false;
+}
+
+void Vcap::Replay::setLoop(bool loop) {
+	_loop = loop;
+}
+
+void Vcap::Replay::setControlCallback(const ControlCallback& callback) {
+	_callback = callback;
+}
+
+std::size_t Vcap::Replay::grab(std::uint8_t** buffer, bool decode, bool bgr) throw (RuntimeError) {
+	std::uint32_t size;
+	std::uint64_t timestamp;
+	std::uint32_t sequence;
+
+	if (!nextFrame(size, timestamp, sequence))
+		throw RuntimeError("End of recording");
+
+	pace(timestamp);
+
+	if (!decode) {
+		std::uint8_t* data = new std::uint8_t[size];
+
+		try {
+			readPayload(data, size);
+		} catch (RuntimeError& e) {
+			delete [] data;
+			throw;
+		}
+
+		*buffer = data;
+
+		return size;
+	}
+
+	_scratch.resize(size);
+	readPayload(_scratch.data(), size);
+
+	std::size_t rgbSize = 3 * _width * _height;
+	std::uint8_t* rgb = new std::uint8_t[rgbSize];
+
+	if (-1 == vcap_decode(_scratch.data(), rgb, _code, _width, _height, bgr)) {
+		delete [] rgb;
+		throw RuntimeError("Unable to decode frame");
+	}
+
+	*buffer = rgb;
+
+	return rgbSize;
+}
+
+Vcap::Frame Vcap::Replay::grab(FramePool& pool, bool decode, bool bgr) throw (RuntimeError) {
+	Frame out = pool.acquire();
+
+	if (!out.valid())
+		throw RuntimeError("Frame pool exhausted");
+
+	std::uint32_t size;
+	std::uint64_t timestamp;
+	std::uint32_t sequence;
+
+	if (!nextFrame(size, timestamp, sequence))
+		throw RuntimeError("End of recording");
+
+	pace(timestamp);
+
+	FrameSlot* slot = out._slot;
+
+	if (!decode) {
+		if (size > slot->capacity) {
+			skip(size);
+			throw RuntimeError("Frame pool buffers are too small for raw frame");
+		}
+
+		readPayload(slot->data, size);
+
+		slot->size = size;
+		slot->stride = 0;
+	} else {
+		std::size_t rgbSize = 3 * _width * _height;
+
+		if (rgbSize > slot->capacity) {
+			skip(size);
+			throw RuntimeError("Frame pool buffers are too small for decoded frame");
+		}
+
+		_scratch.resize(size);
+		readPayload(_scratch.data(), size);
+
+		if (-1 == vcap_decode(_scratch.data(), slot->data, _code, _width, _height, bgr))
+			throw RuntimeError("Unable to decode frame");
+
+		slot->size = rgbSize;
+		slot->stride = 3 * _width;
+	}
+
+	slot->timestamp = timestamp;
+	slot->sequence = sequence;
+
+	return out;
+}
+
+/*
+ * Returns to the first record and restores the format from the header, since format records may have changed it.
+ */
+void Vcap::Replay::rewind() throw (RuntimeError) {
+	RecordingHeader header;
+
+	if (0 != std::fseek(_file, 0, SEEK_SET) || 1 != std::fread(&header, sizeof(header), 1, _file))
+		throw RuntimeError("Unable to read recording " + _path);
+
+	if (0 != std::memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)))
+		throw RuntimeError(_path + " is not a recording");
+
+	if (header.version > RECORDING_VERSION || header.headerSize < sizeof(header))
+		throw RuntimeError("Unsupported recording version in " + _path);
+
+	if (0 != std::fseek(_file, header.headerSize, SEEK_SET))
+		throw RuntimeError("Unable to read recording " + _path);
+
+	//frame log segments end at their index
+	_dataEnd = (long)header.indexOffset;
+
+	_code = header.code;
+	_width = header.width;
+	_height = header.height;
+	_frameRate = (std::uint16_t)header.frameRate;
+
+	_padding = 0;
+	_paced = false;
+}
+
+/*
+ * Advances to the next frame record, applying the control and format records before it, and leaves the file at the
+ * frame's payload. At the end of the recording, starts over when looping. A truncated final record (e.g. from a
+ * recorder that was killed) or the unused tail of a frame log segment ends the recording.
+ */
+bool Vcap::Replay::nextFrame(std::uint32_t& size, std::uint64_t& timestamp, std::uint32_t& sequence)
+		throw (RuntimeError) {
+	if (!_capturing)
+		throw RuntimeError("Replay is not started");
+
+	if (_finished)
+		return false;
+
+	bool restarted = false;
+
+	while (true) {
+		RecordHeader header;
+
+		bool end = (_dataEnd && std::ftell(_file) >= _dataEnd) || 1 != std::fread(&header, sizeof(header), 1, _file) ||
+				0 == header.recordSize;
+
+		if (end) {
+			//a loop that finds no frames would never end
+			if (!_loop || restarted) {
+				_finished = true;
+				return false;
+			}
+
+			rewind();
+			restarted = true;
+
+			continue;
+		}
+
+		if (header.recordSize < sizeof(header) || header.size > header.recordSize - sizeof(header))
+			throw RuntimeError("Corrupt record in " + _path);
+
+		std::uint32_t payload = header.recordSize - sizeof(header);
+
+		if (RECORD_FRAME == header.type) {
+			size = header.size;
+			timestamp = header.timestamp;
+			sequence = header.sequence;
+
+			_padding = payload - header.size;
+
+			return true;
+		}
+
+		if (RECORD_CONTROL == header.type && header.size >= sizeof(ControlRecord)) {
+			ControlRecord control;
+
+			readPayload((std::uint8_t*)&control, sizeof(control));
+			payload -= sizeof(control);
+
+			if (_callback)
+				_callback((ControlId)control.id, control.value);
+		} else if (RECORD_FORMAT == header.type && header.size >= sizeof(FormatRecord)) {
+			FormatRecord format;
+
+			readPayload((std::uint8_t*)&format, sizeof(format));
+			payload -= sizeof(format);
+
+			_code = format.code;
+			_width = format.width;
+			_height = format.height;
+			_frameRate = (std::uint16_t)format.frameRate;
+		}
+
+		//unknown record types are skipped
+		skip(payload);
+	}
+}
+
+void Vcap::Replay::readPayload(std::uint8_t* data, std::size_t size) throw (RuntimeError) {
+	if (size > 0 && 1 != std::fread(data, size, 1, _file)) {
+		_finished = true;
+		throw RuntimeError("Truncated frame in " + _path);
+	}
+
+	skip(0);
+}
+
+/*
+ * Skips bytes of the current record, followed by any padding left over from the last frame's payload.
+ */
+void Vcap::Replay::skip(std::size_t size) throw (RuntimeError) {
+	size += _padding;
+	_padding = 0;
+
+	if (size > 0 && 0 != std::fseek(_file, (long)size, SEEK_CUR))
+		throw RuntimeError("Unable to read recording " + _path);
+}
+
+/*
+ * Sleeps until a frame is due: frames are released at their recorded spacing, measured from the first frame
+ * played back.
+ */
+void Vcap::Replay::pace(std::uint64_t timestamp) {
+	if (!_realTime)
+		return;
+
+	if (!_paced) {
+		_firstTimestamp = timestamp;
+		_startTime = monotonicTime();
+		_paced = true;
+
+		return;
+	}
+
+	if (timestamp <= _firstTimestamp)
+		return;
+
+	std::uint64_t due = _startTime + (timestamp - _firstTimestamp);
+
+	struct timespec ts;
+	ts.tv_sec = due / 1000000;
+	ts.tv_nsec = (due % 1000000) * 1000;
+
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+}
@@ -0,0 +1,80 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_SLOT_ARRAY_HPP
+#define _VCAP_SLOT_ARRAY_HPP
+
+/*
+ * Frame slots shared by a pool or stream and the Frame handles it gives out. The array forwards released slots to its
+ * owner; once the owner retires it, the array (and optionally the memory behind the slots) lives on until the last
+ * outstanding handle is released. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <cstddef>
+#include <mutex>
+
+namespace Vcap {
+	class SlotArray;
+}
+
+class Vcap::SlotArray : public FrameOwner {
+	public:
+		/*
+		 * Returns NULL if the slots cannot be allocated.
+		 */
+		static SlotArray* create(FrameOwner* owner, std::size_t count);
+
+		FrameSlot* slots();
+		std::size_t count() const;
+
+		/*
+		 * Hands out a slot: sets its reference count to 1 and counts it as outstanding.
+		 */
+		void checkout(FrameSlot* slot);
+
+		/*
+		 * Detaches the array from its owner, which must not use it again. The array, and the given mapping if any, are
+		 * freed once no slot is outstanding.
+		 */
+		void retire(void* memory = NULL, std::size_t memorySize = 0);
+
+		void recycle(FrameSlot* slot);
+
+	private:
+		SlotArray(FrameOwner* owner, FrameSlot* slots, std::size_t count);
+		~SlotArray();
+
+		SlotArray(const SlotArray&);
+		SlotArray& operator = (const SlotArray&);
+
+		FrameOwner* _owner;
+		FrameSlot* _slots;
+		std::size_t _count;
+
+		std::mutex _mutex;
+		std::size_t _outstanding;
+
+		void* _memory;
+		std::size_t _memorySize;
+};
+
+#endif
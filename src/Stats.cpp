@@ -0,0 +1,211 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Stats.hpp>
+
+#include "StatsRecorder.hpp"
+
+#include <cstring>
+#include <limits>
+
+/*
+ * Each power of two is split into 2^SUB_BITS buckets; values below 2^SUB_BITS get a bucket each.
+ */
+static const unsigned int SUB_BITS = 4;
+static const unsigned int SUB_BUCKETS = 1u << SUB_BITS;
+
+/*
+ * Values are clamped to below 2^MAX_BITS microseconds.
+ */
+static const unsigned int MAX_BITS = 36;
+
+static const std::uint64_t NO_MIN = std::numeric_limits<std::uint64_t>::max();
+
+/*
+ * Latency histogram class definition
+ */
+Vcap::LatencyHistogram::LatencyHistogram() : _count(0), _sum(0), _min(NO_MIN), _max(0) {
+	std::memset(_counts, 0, sizeof(_counts));
+}
+
+unsigned int Vcap::LatencyHistogram::bucketIndex(std::uint64_t value) {
+	if (value < 2 * SUB_BUCKETS)
+		return (unsigned int)value;
+
+	if (value >> MAX_BITS)
+		value = ((std::uint64_t)1 << MAX_BITS) - 1;
+
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int shift = msb - SUB_BITS;
+	unsigned int sub = (unsigned int)(value >> shift) - SUB_BUCKETS;
+
+	return 2 * SUB_BUCKETS + (msb - SUB_BITS - 1) * SUB_BUCKETS + sub;
+}
+
+std::uint64_t Vcap::LatencyHistogram::bucketLimit(unsigned int bucket) {
+	if (bucket < 2 * SUB_BUCKETS)
+		return bucket;
+
+	unsigned int msb = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS + 1;
+	unsigned int sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	unsigned int shift = msb - SUB_BITS;
+
+	return (((std::uint64_t)sub + 1) << shift) - 1;
+}
+
+void Vcap::LatencyHistogram::record(std::uint64_t value) {
+	_counts[bucketIndex(value)]++;
+	_count++;
+	_sum += value;
+
+	if (value < _min)
+		_min = value;
+
+	if (value > _max)
+		_max = value;
+}
+
+std::uint64_t Vcap::LatencyHistogram::count() const {
+	return _count;
+}
+
+std::uint64_t Vcap::LatencyHistogram::min() const {
+	return _count ? _min : 0;
+}
+
+std::uint64_t Vcap::LatencyHistogram::max() const {
+	return _max;
+}
+
+std::uint64_t Vcap::LatencyHistogram::mean() const {
+	return _count ? _sum / _count : 0;
+}
+
+std::uint64_t Vcap::LatencyHistogram::percentile(double percent) const {
+	if (0 == _count)
+		return 0;
+
+	std::uint64_t rank = (std::uint64_t)(percent / 100.0 * (double)_count + 0.5);
+
+	if (rank < 1)
+		rank = 1;
+
+	std::uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < BUCKETS; i++) {
+		seen += _counts[i];
+
+		//the bucket limit can overstate the largest value actually seen
+		if (seen >= rank)
+			return bucketLimit(i) < _max ? bucketLimit(i) : _max;
+	}
+
+	return _max;
+}
+
+std::uint64_t Vcap::LatencyHistogram::bucketCount(unsigned int bucket) const {
+	return bucket < BUCKETS ? _counts[bucket] : 0;
+}
+
+/*
+ * Stats recorder class definition
+ */
+Vcap::StatsRecorder::StatsRecorder() {
+	reset();
+}
+
+void Vcap::StatsRecorder::record(Stage stage, std::uint64_t latency) {
+	Histogram& histogram = _stages[stage];
+
+	histogram.counts[LatencyHistogram::bucketIndex(latency)].fetch_add(1, std::memory_order_relaxed);
+	histogram.count.fetch_add(1, std::memory_order_relaxed);
+	histogram.sum.fetch_add(latency, std::memory_order_relaxed);
+
+	//extremes rarely change, so these loops almost never spin
+	std::uint64_t current = histogram.min.load(std::memory_order_relaxed);
+
+	while (latency < current && !histogram.min.compare_exchange_weak(current, latency, std::memory_order_relaxed)) {
+	}
+
+	current = histogram.max.load(std::memory_order_relaxed);
+
+	while (latency > current && !histogram.max.compare_exchange_weak(current, latency, std::memory_order_relaxed)) {
+	}
+}
+
+void Vcap::StatsRecorder::frame(std::size_t bytes, std::uint32_t sequence, bool sequenced) {
+	_frames.fetch_add(1, std::memory_order_relaxed);
+	_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+	if (!sequenced)
+		return;
+
+	std::int64_t last = _lastSequence.exchange(sequence, std::memory_order_relaxed);
+
+	if (last >= 0 && sequence > (std::uint64_t)last + 1)
+		_drops.fetch_add(sequence - (std::uint64_t)last - 1, std::memory_order_relaxed);
+}
+
+void Vcap::StatsRecorder::error() {
+	_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Vcap::StatsRecorder::copy(const Histogram& from, LatencyHistogram& to) {
+	for (unsigned int i = 0; i < LatencyHistogram::BUCKETS; i++)
+		to._counts[i] = from.counts[i].load(std::memory_order_relaxed);
+
+	to._count = from.count.load(std::memory_order_relaxed);
+	to._sum = from.sum.load(std::memory_order_relaxed);
+	to._min = from.min.load(std::memory_order_relaxed);
+	to._max = from.max.load(std::memory_order_relaxed);
+}
+
+void Vcap::StatsRecorder::snapshot(CaptureStats& stats) const {
+	copy(_stages[STAGE_WAIT], stats.wait);
+	copy(_stages[STAGE_COPY], stats.copy);
+	copy(_stages[STAGE_DECODE], stats.decode);
+	copy(_stages[STAGE_TOTAL], stats.total);
+
+	stats.frames = _frames.load(std::memory_order_relaxed);
+	stats.bytes = _bytes.load(std::memory_order_relaxed);
+	stats.drops = _drops.load(std::memory_order_relaxed);
+	stats.errors = _errors.load(std::memory_order_relaxed);
+}
+
+void Vcap::StatsRecorder::reset() {
+	for (unsigned int i = 0; i < STAGE_COUNT; i++) {
+		Histogram& histogram = _stages[i];
+
+		for (unsigned int j = 0; j < LatencyHistogram::BUCKETS; j++)
+			histogram.counts[j].store(0, std::memory_order_relaxed);
+
+		histogram.count.store(0, std::memory_order_relaxed);
+		histogram.sum.store(0, std::memory_order_relaxed);
+		histogram.min.store(NO_MIN, std::memory_order_relaxed);
+		histogram.max.store(0, std::memory_order_relaxed);
+	}
+
+	_frames.store(0, std::memory_order_relaxed);
+	_bytes.store(0, std::memory_order_relaxed);
+	_drops.store(0, std::memory_order_relaxed);
+	_errors.store(0, std::memory_order_relaxed);
+
+	_lastSequence.store(-1, std::memory_order_relaxed);
+}
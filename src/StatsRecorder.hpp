@@ -0,0 +1,88 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_STATS_RECORDER_HPP
+#define _VCAP_STATS_RECORDER_HPP
+
+/*
+ * Lock-free collection of a camera's capture statistics. Not installed.
+ */
+
+#include <Vcap/Stats.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace Vcap {
+	class StatsRecorder;
+
+	/*
+	 * Capture stages timed by the recorder.
+	 */
+	typedef enum {
+		STAGE_WAIT,
+		STAGE_COPY,
+		STAGE_DECODE,
+		STAGE_TOTAL,
+		STAGE_COUNT
+	} Stage;
+}
+
+class Vcap::StatsRecorder {
+	public:
+		StatsRecorder();
+
+		void record(Stage stage, std::uint64_t latency);
+
+		/*
+		 * Counts a delivered frame, and any frames the driver dropped before it.
+		 */
+		void frame(std::size_t bytes, std::uint32_t sequence, bool sequenced);
+
+		void error();
+
+		void snapshot(CaptureStats& stats) const;
+		void reset();
+
+	private:
+		StatsRecorder(const StatsRecorder&);
+		StatsRecorder& operator = (const StatsRecorder&);
+
+		struct Histogram {
+			std::atomic<std::uint64_t> counts[LatencyHistogram::BUCKETS];
+			std::atomic<std::uint64_t> count;
+			std::atomic<std::uint64_t> sum;
+			std::atomic<std::uint64_t> min;
+			std::atomic<std::uint64_t> max;
+		};
+
+		static void copy(const Histogram& from, LatencyHistogram& to);
+
+		Histogram _stages[STAGE_COUNT];
+
+		std::atomic<std::uint64_t> _frames;
+		std::atomic<std::uint64_t> _bytes;
+		std::atomic<std::uint64_t> _drops;
+		std::atomic<std::uint64_t> _errors;
+
+		std::atomic<std::int64_t> _lastSequence;
+};
+
+#endif
@@ -0,0 +1,624 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "Ioctl.hpp"
+#include "SlotArray.hpp"
+#include "Stream.hpp"
+#include "Tracing.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+/*
+ * How long to wait for the driver to fill a buffer before giving up.
+ */
+static const int DEQUEUE_TIMEOUT_MS = 2000;
+
+/*
+ * Number of buffers requested for IO_MMAP streaming unless overridden.
+ */
+static const std::size_t DEFAULT_BUFFER_COUNT = 4;
+
+static std::uint32_t memoryType(Vcap::IoMode mode) {
+	return Vcap::IO_USERPTR == mode ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
+}
+
+Vcap::Stream::Stream(vcap_camera_t* camera) :
+	_camera(camera),
+	_mode(IO_DEFAULT),
+	_streaming(false),
+	_code(0),
+	_width(0),
+	_height(0),
+	_imageSize(0),
+	_multiplanar(-1),
+	_numPlanes(1),
+	_bufferCount(DEFAULT_BUFFER_COUNT),
+	_slotArray(NULL),
+	_slots(NULL),
+	_numSlots(0) {
+}
+
+Vcap::Stream::~Stream() {
+	try {
+		stop();
+	} catch (RuntimeError&) {
+	}
+
+	freeSlots();
+}
+
+Vcap::IoMode Vcap::Stream::mode() const {
+	return _mode;
+}
+
+void Vcap::Stream::setMode(IoMode mode) {
+	if (_streaming)
+		throw RuntimeError("Unable to change I/O mode while capturing");
+
+	_mode = mode;
+}
+
+std::size_t Vcap::Stream::bufferCount() const {
+	return _bufferCount;
+}
+
+void Vcap::Stream::setBufferCount(std::size_t count) {
+	if (_streaming)
+		throw RuntimeError("Unable to change buffer count while capturing");
+
+	if (0 == count)
+		throw RuntimeError("Buffer count must be non-zero");
+
+	_bufferCount = count;
+}
+
+void Vcap::Stream::addUserBuffer(std::uint8_t* data, std::size_t length) {
+	if (_streaming)
+		throw RuntimeError("Unable to register buffers while capturing");
+
+	if (!data || 0 == length)
+		throw RuntimeError("Invalid user buffer");
+
+	//the driver would only reject it at VIDIOC_QBUF, with a bare EINVAL
+	if (0 != (std::uintptr_t)data % (std::uintptr_t)sysconf(_SC_PAGESIZE))
+		throw RuntimeError("User buffers must be page-aligned");
+
+	_userData.push_back(data);
+	_userLengths.push_back(length);
+}
+
+void Vcap::Stream::clearUserBuffers() {
+	if (_streaming)
+		throw RuntimeError("Unable to unregister buffers while capturing");
+
+	_userData.clear();
+	_userLengths.clear();
+}
+
+bool Vcap::Stream::streaming() const {
+	return _streaming;
+}
+
+std::uint32_t Vcap::Stream::code() const {
+	return _code;
+}
+
+std::uint32_t Vcap::Stream::width() const {
+	return _width;
+}
+
+std::uint32_t Vcap::Stream::height() const {
+	return _height;
+}
+
+bool Vcap::Stream::multiplanar() {
+	if (-1 != _multiplanar)
+		return _multiplanar;
+
+	struct v4l2_capability caps;
+	std::memset(&caps, 0, sizeof(caps));
+
+	//not cached, so a transient failure is retried on the next call
+	if (-1 == xioctl(_camera->fd, VIDIOC_QUERYCAP, &caps))
+		return false;
+
+	std::uint32_t deviceCaps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+
+	_multiplanar = (deviceCaps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) && !(deviceCaps & V4L2_CAP_VIDEO_CAPTURE);
+
+	return _multiplanar;
+}
+
+void Vcap::Stream::format(std::uint32_t& code, std::uint32_t& width, std::uint32_t& height) {
+	Status status = readFormat();
+
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+
+	code = _code;
+	width = _width;
+	height = _height;
+}
+
+void Vcap::Stream::setFormat(std::uint32_t code, std::uint32_t width, std::uint32_t height) {
+	if (_streaming)
+		throw RuntimeError("Unable to change format while capturing");
+
+	struct v4l2_format fmt;
+	std::memset(&fmt, 0, sizeof(fmt));
+	fmt.type = bufferType();
+
+	if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == fmt.type) {
+		fmt.fmt.pix_mp.pixelformat = code;
+		fmt.fmt.pix_mp.width = width;
+		fmt.fmt.pix_mp.height = height;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+	} else {
+		fmt.fmt.pix.pixelformat = code;
+		fmt.fmt.pix.width = width;
+		fmt.fmt.pix.height = height;
+		fmt.fmt.pix.field = V4L2_FIELD_ANY;
+	}
+
+	if (-1 == xioctl(_camera->fd, VIDIOC_S_FMT, &fmt))
+		throw ioctlError("Unable to set format");
+
+	Status status = readFormat();
+
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+}
+
+std::uint32_t Vcap::Stream::bufferType() {
+	return multiplanar() ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+}
+
+Vcap::Status Vcap::Stream::readFormat() {
+	struct v4l2_format fmt;
+	std::memset(&fmt, 0, sizeof(fmt));
+	fmt.type = bufferType();
+
+	if (-1 == xioctl(_camera->fd, VIDIOC_G_FMT, &fmt))
+		return errnoStatus("Unable to get format");
+
+	if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == fmt.type) {
+		_code = fmt.fmt.pix_mp.pixelformat;
+		_width = fmt.fmt.pix_mp.width;
+		_height = fmt.fmt.pix_mp.height;
+		_numPlanes = fmt.fmt.pix_mp.num_planes;
+		_imageSize = 0;
+
+		if (0 == _numPlanes || _numPlanes > MAX_PLANES)
+			return Status(EINVAL, "Unsupported number of planes");
+
+		for (unsigned int j = 0; j < _numPlanes; j++) {
+			_strides[j] = fmt.fmt.pix_mp.plane_fmt[j].bytesperline;
+			_imageSize += fmt.fmt.pix_mp.plane_fmt[j].sizeimage;
+		}
+	} else {
+		_code = fmt.fmt.pix.pixelformat;
+		_width = fmt.fmt.pix.width;
+		_height = fmt.fmt.pix.height;
+		_imageSize = fmt.fmt.pix.sizeimage;
+		_numPlanes = 1;
+		_strides[0] = fmt.fmt.pix.bytesperline;
+	}
+
+	return Status();
+}
+
+void Vcap::Stream::start() {
+	Status status = tryStart();
+
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+}
+
+Vcap::Status Vcap::Stream::tryStart() {
+	if (_streaming)
+		return Status();
+
+	if (IO_USERPTR != _mode && IO_MMAP != _mode)
+		return Status(EINVAL, "Unsupported I/O mode");
+
+	int fd = _camera->fd;
+
+	Status status = readFormat();
+
+	if (!status.ok())
+		return status;
+
+	std::uint32_t type = bufferType();
+	std::size_t count = _bufferCount;
+
+	if (IO_USERPTR == _mode) {
+		if (_numPlanes > 1)
+			return Status(EINVAL, "User pointer I/O is not supported for multi-planar formats");
+
+		if (_userData.empty())
+			return Status(EINVAL, "No user buffers registered");
+
+		for (std::size_t i = 0; i < _userLengths.size(); i++) {
+			if (_userLengths[i] < _imageSize)
+				return Status(EINVAL, "User buffer too small for current format");
+		}
+
+		count = _userData.size();
+	}
+
+	struct v4l2_requestbuffers req;
+	std::memset(&req, 0, sizeof(req));
+	req.count = count;
+	req.type = type;
+	req.memory = memoryType(_mode);
+
+	if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
+		if (EINVAL == errno)
+			return Status(EINVAL, IO_USERPTR == _mode ? "Device does not support user pointer I/O" :
+					"Device does not support memory-mapped I/O");
+
+		return errnoStatus("Unable to request buffers");
+	}
+
+	//the driver may grant fewer MMAP buffers than requested
+	if (IO_MMAP == _mode) {
+		if (0 == req.count)
+			return Status(ENOMEM, "Insufficient buffer memory");
+
+		count = req.count;
+	}
+
+	if (!allocateSlots(count))
+		return Status(ENOMEM, "Unable to allocate buffer slots");
+
+	if (IO_USERPTR == _mode) {
+		for (std::size_t i = 0; i < _numSlots; i++) {
+			_slots[i].data = _slots[i].planes[0].data = _userData[i];
+			_slots[i].capacity = _slots[i].planeCapacity[0] = _userLengths[i];
+		}
+	} else {
+		for (std::size_t i = 0; i < _numSlots; i++) {
+			struct v4l2_plane planes[VIDEO_MAX_PLANES];
+			struct v4l2_buffer buf;
+			std::memset(&buf, 0, sizeof(buf));
+			std::memset(planes, 0, sizeof(planes));
+			buf.type = type;
+			buf.memory = V4L2_MEMORY_MMAP;
+			buf.index = i;
+
+			if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == type) {
+				buf.m.planes = planes;
+				buf.length = _numPlanes;
+			}
+
+			if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf)) {
+				status = errnoStatus("Unable to query buffer");
+				unmapBuffers();
+				return status;
+			}
+
+			FrameSlot& slot = _slots[i];
+
+			//every plane of a multi-planar buffer is mapped separately
+			for (unsigned int j = 0; j < _numPlanes; j++) {
+				std::size_t length = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == type ? planes[j].length : buf.length;
+				off_t offset = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == type ? planes[j].m.mem_offset : buf.m.offset;
+
+				void* data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+
+				if (MAP_FAILED == data) {
+					status = errnoStatus("Unable to map buffer");
+					unmapBuffers();
+					return status;
+				}
+
+				slot.planes[j].data = (std::uint8_t*)data;
+				slot.planes[j].size = 0;
+				slot.planes[j].stride = _strides[j];
+				slot.planeCapacity[j] = length;
+			}
+
+			slot.data = slot.planes[0].data;
+			slot.capacity = slot.planeCapacity[0];
+		}
+	}
+
+	_streaming = true;
+
+	for (std::size_t i = 0; i < _numSlots && status.ok(); i++) {
+		if (!queue(&_slots[i]))
+			status = errnoStatus("Unable to queue buffer");
+	}
+
+	if (status.ok() && -1 == xioctl(fd, VIDIOC_STREAMON, &type))
+		status = errnoStatus("Unable to start streaming");
+
+	if (!status.ok()) {
+		_streaming = false;
+		unmapBuffers();
+	}
+
+	return status;
+}
+
+void Vcap::Stream::stop() {
+	Status status = tryStop();
+
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+}
+
+Vcap::Status Vcap::Stream::tryStop() {
+	if (!_streaming)
+		return Status();
+
+	_streaming = false;
+
+	int fd = _camera->fd;
+
+	int type = bufferType();
+
+	if (-1 == xioctl(fd, VIDIOC_STREAMOFF, &type))
+		return errnoStatus("Unable to stop streaming");
+
+	//MMAP buffers (and their exports) must be gone before the driver will free them
+	unmapBuffers();
+
+	struct v4l2_requestbuffers req;
+	std::memset(&req, 0, sizeof(req));
+	req.count = 0;
+	req.type = type;
+	req.memory = memoryType(_mode);
+
+	xioctl(fd, VIDIOC_REQBUFS, &req);
+
+	return Status();
+}
+
+Vcap::Frame Vcap::Stream::dequeue() {
+	Frame frame;
+	Status status = tryDequeue(frame);
+
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+
+	return frame;
+}
+
+Vcap::Status Vcap::Stream::tryDequeue(Frame& frame) {
+	if (!_streaming)
+		return Status(EINVAL, "Camera is not capturing");
+
+	int fd = _camera->fd;
+
+	VCAP_TRACE_BEGIN(dequeue);
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	int ready;
+
+	do {
+		ready = poll(&pfd, 1, DEQUEUE_TIMEOUT_MS);
+	} while (-1 == ready && EINTR == errno);
+
+	if (-1 == ready)
+		return errnoStatus("Unable to wait for frame");
+
+	//the V4L2 core reports POLLHUP once the device has been unregistered
+	if (pfd.revents & POLLHUP)
+		return Status(ENODEV, "Device lost");
+
+	if (0 == ready)
+		return Status(ETIMEDOUT, "Timed out waiting for frame");
+
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	struct v4l2_buffer buf;
+	std::memset(&buf, 0, sizeof(buf));
+	std::memset(planes, 0, sizeof(planes));
+	buf.type = bufferType();
+	buf.memory = memoryType(_mode);
+
+	if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == buf.type) {
+		buf.m.planes = planes;
+		buf.length = _numPlanes;
+	}
+
+	int result = xioctl(fd, VIDIOC_DQBUF, &buf);
+
+	//the wait is included, so long events are starved queues rather than slow ioctls
+	VCAP_TRACE_END(dequeue, -1 == result ? -1 : (int)buf.index);
+
+	if (-1 == result)
+		return errnoStatus("Unable to dequeue buffer");
+
+	if (buf.index >= _numSlots)
+		return Status(EIO, "Driver returned an unknown buffer");
+
+	FrameSlot* slot = &_slots[buf.index];
+
+	if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == buf.type) {
+		for (unsigned int j = 0; j < _numPlanes; j++)
+			slot->planes[j].size = planes[j].bytesused;
+
+		slot->size = slot->planes[0].size;
+	} else {
+		slot->size = buf.bytesused;
+	}
+
+	slot->sequence = buf.sequence;
+	slot->timestamp = (std::uint64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+	_slotArray->checkout(slot);
+
+	frame = Frame(slot);
+
+	return Status();
+}
+
+int Vcap::Stream::exportFrame(const Frame& frame, unsigned int importers) {
+	if (IO_MMAP != _mode)
+		throw RuntimeError("DMABUF export requires IO_MMAP mode");
+
+	FrameSlot* slot = frame._slot;
+
+	if (!slot || slot->owner != _slotArray || !_streaming)
+		throw RuntimeError("Frame does not belong to this stream");
+
+	if (slot->numPlanes > 1)
+		throw RuntimeError("DMABUF export is not supported for multi-planar formats");
+
+	if (-1 == slot->fd) {
+		struct v4l2_exportbuffer exp;
+		std::memset(&exp, 0, sizeof(exp));
+		exp.type = bufferType();
+		exp.index = slot->index;
+		exp.flags = O_RDONLY | O_CLOEXEC;
+
+		if (-1 == xioctl(_camera->fd, VIDIOC_EXPBUF, &exp))
+			throw ioctlError("Unable to export buffer");
+
+		slot->fd = exp.fd;
+	}
+
+	slot->refs.fetch_add(importers, std::memory_order_relaxed);
+
+	return slot->fd;
+}
+
+void Vcap::Stream::releaseExported(std::uint32_t index) {
+	if (index >= _numSlots)
+		throw RuntimeError("Invalid buffer index");
+
+	FrameSlot* slot = &_slots[index];
+
+	//releases may race on other threads, so never decrement past zero
+	unsigned int refs = slot->refs.load(std::memory_order_relaxed);
+
+	do {
+		if (0 == refs)
+			throw RuntimeError("Buffer has no outstanding references");
+	} while (!slot->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+	if (1 == refs)
+		_slotArray->recycle(slot);
+}
+
+void Vcap::Stream::recycle(FrameSlot* slot) {
+	//buffers released after stop() are reclaimed by the next start()
+	if (!_streaming)
+		return;
+
+	//called from Frame destructors, so a failure here cannot be reported; the buffer is simply lost until restart
+	queue(slot);
+}
+
+bool Vcap::Stream::queue(FrameSlot* slot) {
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	struct v4l2_buffer buf;
+	std::memset(&buf, 0, sizeof(buf));
+	std::memset(planes, 0, sizeof(planes));
+	buf.type = bufferType();
+	buf.memory = memoryType(_mode);
+	buf.index = slot->index;
+
+	if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == buf.type) {
+		buf.m.planes = planes;
+		buf.length = _numPlanes;
+	}
+
+	if (IO_USERPTR == _mode) {
+		buf.m.userptr = (unsigned long)slot->data;
+		buf.length = slot->capacity;
+	}
+
+	VCAP_TRACE_BEGIN(requeue);
+
+	int result = xioctl(_camera->fd, VIDIOC_QBUF, &buf);
+
+	VCAP_TRACE_END(requeue, slot->index);
+
+	return -1 != result;
+}
+
+bool Vcap::Stream::allocateSlots(std::size_t count) {
+	freeSlots();
+
+	_slotArray = SlotArray::create(this, count);
+
+	if (!_slotArray)
+		return false;
+
+	_slots = _slotArray->slots();
+	_numSlots = count;
+
+	for (std::size_t i = 0; i < _numSlots; i++) {
+		_slots[i].stride = _strides[0];
+		_slots[i].numPlanes = _numPlanes;
+	}
+
+	return true;
+}
+
+void Vcap::Stream::unmapBuffers() {
+	for (std::size_t i = 0; i < _numSlots; i++) {
+		if (-1 != _slots[i].fd) {
+			::close(_slots[i].fd);
+			_slots[i].fd = -1;
+		}
+
+		if (IO_MMAP != _mode || !_slots[i].data)
+			continue;
+
+		for (unsigned int j = 0; j < _slots[i].numPlanes; j++) {
+			if (_slots[i].planes[j].data)
+				munmap(_slots[i].planes[j].data, _slots[i].planeCapacity[j]);
+
+			_slots[i].planes[j].data = NULL;
+		}
+
+		_slots[i].data = NULL;
+	}
+}
+
+/*
+ * Frames from earlier sessions may still be held; the slots stay valid until they are released, but their data is
+ * already unmapped.
+ */
+void Vcap::Stream::freeSlots() {
+	unmapBuffers();
+
+	if (_slotArray)
+		_slotArray->retire();
+
+	_slotArray = NULL;
+	_slots = NULL;
+	_numSlots = 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_STREAM_HPP
+#define _VCAP_STREAM_HPP
+
+/*
+ * Internal V4L2 streaming engine used for the I/O modes that Vcap itself does not implement. Not installed.
+ */
+
+#include <Vcap/Vcap.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Vcap {
+	class Stream;
+}
+
+class Vcap::Stream : public FrameOwner {
+	public:
+		Stream(vcap_camera_t* camera);
+		virtual ~Stream();
+
+		IoMode mode() const;
+		void setMode(IoMode mode);
+
+		std::size_t bufferCount() const;
+		void setBufferCount(std::size_t count);
+
+		void addUserBuffer(std::uint8_t* data, std::size_t length);
+		void clearUserBuffers();
+
+		void start();
+		void stop();
+
+		Status tryStart();
+		Status tryStop();
+
+		bool streaming() const;
+
+		/*
+		 * True if the device only supports the multi-planar capture API.
+		 */
+		bool multiplanar();
+
+		void format(std::uint32_t& code, std::uint32_t& width, std::uint32_t& height);
+		void setFormat(std::uint32_t code, std::uint32_t width, std::uint32_t height);
+
+		std::uint32_t code() const;
+		std::uint32_t width() const;
+		std::uint32_t height() const;
+
+		/*
+		 * Waits for the next filled buffer. The buffer is re-queued once the returned frame is released. Frame data is
+		 * invalid after stop(), though the handle itself may be released at any time.
+		 */
+		Frame dequeue();
+		Status tryDequeue(Frame& frame);
+
+		/*
+		 * Exports the frame's buffer as a DMABUF and adds importer references that keep it from being re-queued.
+		 */
+		int exportFrame(const Frame& frame, unsigned int importers);
+		void releaseExported(std::uint32_t index);
+
+	protected:
+		void recycle(FrameSlot* slot);
+
+	private:
+		Stream(const Stream&);
+		Stream& operator = (const Stream&);
+
+		std::uint32_t bufferType();
+		Status readFormat();
+
+		bool queue(FrameSlot* slot);
+		bool allocateSlots(std::size_t count);
+		void unmapBuffers();
+		void freeSlots();
+
+		vcap_camera_t* _camera;
+
+		IoMode _mode;
+		std::atomic<bool> _streaming;
+
+		std::uint32_t _code;
+		std::uint32_t _width;
+		std::uint32_t _height;
+		std::size_t _imageSize;
+
+		int _multiplanar;
+		unsigned int _numPlanes;
+		std::size_t _strides[MAX_PLANES];
+
+		std::size_t _bufferCount;
+
+		std::vector<std::uint8_t*> _userData;
+		std::vector<std::size_t> _userLengths;
+
+		SlotArray* _slotArray;
+		FrameSlot* _slots;
+		std::size_t _numSlots;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/Trace.hpp>
+
+#include "Tracing.hpp"
+
+#include <fstream>
+
+#ifdef VCAP_TRACING
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+	/*
+	 * The name is cleared while the slot is being written and published last, so dump() can skip unfinished events.
+	 */
+	struct TraceEvent {
+		std::atomic<const char*> name;
+		std::uint64_t start;
+		std::uint64_t end;
+		std::int64_t arg;
+		std::uint32_t tid;
+	};
+
+	/*
+	 * Writers claim slots with a single atomic increment and overwrite the oldest events once the ring is full.
+	 */
+	struct TraceRing {
+		TraceEvent* events;
+		std::size_t capacity;
+		std::atomic<std::uint64_t> next;
+	};
+
+	/*
+	 * Rings are never freed: a writer may still hold one after stop(). Only a start() with a new capacity replaces it.
+	 */
+	std::atomic<TraceRing*> ring(NULL);
+	std::mutex control;
+
+	std::uint32_t threadId() {
+		static thread_local std::uint32_t tid = (std::uint32_t)syscall(SYS_gettid);
+
+		return tid;
+	}
+}
+
+std::atomic<bool> Vcap::traceActive(false);
+
+std::uint64_t Vcap::traceClock() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (std::uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Vcap::traceEvent(const char* name, std::uint64_t start, std::int64_t arg) {
+	TraceRing* current = ring.load(std::memory_order_acquire);
+
+	if (!current)
+		return;
+
+	std::uint64_t index = current->next.fetch_add(1, std::memory_order_relaxed);
+	TraceEvent& event = current->events[index % current->capacity];
+
+	event.name.store(NULL, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	event.start = start;
+	event.end = traceClock();
+	event.arg = arg;
+	event.tid = threadId();
+
+	event.name.store(name, std::memory_order_release);
+}
+
+/*
+ * Trace class definition
+ */
+bool Vcap::Trace::start(std::size_t capacity) {
+	std::lock_guard<std::mutex> lock(control);
+
+	if (0 == capacity)
+		return false;
+
+	TraceRing* current = ring.load(std::memory_order_relaxed);
+
+	if (!current || current->capacity != capacity) {
+		TraceRing* fresh = new TraceRing;
+
+		fresh->events = new TraceEvent[capacity]();
+		fresh->capacity = capacity;
+		fresh->next.store(0, std::memory_order_relaxed);
+
+		ring.store(fresh, std::memory_order_release);
+	} else {
+		current->next.store(0, std::memory_order_relaxed);
+	}
+
+	traceActive.store(true, std::memory_order_relaxed);
+
+	return true;
+}
+
+void Vcap::Trace::stop() {
+	std::lock_guard<std::mutex> lock(control);
+
+	traceActive.store(false, std::memory_order_relaxed);
+}
+
+bool Vcap::Trace::active() {
+	return traceActive.load(std::memory_order_relaxed);
+}
+
+void Vcap::Trace::dump(std::ostream& out) {
+	std::lock_guard<std::mutex> lock(control);
+
+	out << "{\"traceEvents\":[";
+
+	TraceRing* current = ring.load(std::memory_order_acquire);
+
+	if (current) {
+		std::uint64_t next = current->next.load(std::memory_order_relaxed);
+		std::uint64_t first = next > current->capacity ? next - current->capacity : 0;
+
+		int pid = getpid();
+		bool comma = false;
+
+		//slots still being written while tracing is active are skipped; stop() first for a complete dump
+		for (std::uint64_t i = first; i < next; i++) {
+			const TraceEvent& event = current->events[i % current->capacity];
+
+			const char* name = event.name.load(std::memory_order_acquire);
+
+			if (!name)
+				continue;
+
+			std::uint64_t eventStart = event.start;
+			std::uint64_t eventEnd = event.end;
+			std::int64_t arg = event.arg;
+			std::uint32_t tid = event.tid;
+
+			//rewritten while it was being copied
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (event.name.load(std::memory_order_relaxed) != name)
+				continue;
+
+			if (comma)
+				out << ",";
+
+			out << "\n{\"name\":\"" << name << "\",\"cat\":\"vcap\",\"ph\":\"X\",\"ts\":" << eventStart
+					<< ",\"dur\":" << (eventEnd - eventStart) << ",\"pid\":" << pid << ",\"tid\":" << tid
+					<< ",\"args\":{\"value\":" << arg << "}}";
+
+			comma = true;
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+#else
+
+bool Vcap::Trace::start(std::size_t capacity) {
+	return false;
+}
+
+void Vcap::Trace::stop() {
+}
+
+bool Vcap::Trace::active() {
+	return false;
+}
+
+void Vcap::Trace::dump(std::ostream& out) {
+	out << "{\"traceEvents\":[]}\n";
+}
+
+#endif
+
+void Vcap::Trace::dump(const std::string& path) throw (RuntimeError) {
+	std::ofstream out(path.c_str());
+
+	if (!out)
+		throw RuntimeError("Unable to open trace file " + path);
+
+	dump(out);
+
+	if (!out)
+		throw RuntimeError("Unable to write trace file " + path);
+}
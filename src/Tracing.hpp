@@ -0,0 +1,73 @@
+/*
+ * Vcap C++ Bindings
+ *
+ * Copyright (C) 2014 James McLean
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VCAP_TRACING_HPP
+#define _VCAP_TRACING_HPP
+
+/*
+ * Tracepoints. With VCAP_TRACING undefined they expand to nothing; with it defined each pair fires SDT probes
+ * (vcap:NAME__start / vcap:NAME__done, when <sys/sdt.h> is available) and records an event while Trace is active.
+ * Not installed.
+ *
+ *	VCAP_TRACE_BEGIN(decode);
+ *	...
+ *	VCAP_TRACE_END(decode, value);
+ */
+
+#ifdef VCAP_TRACING
+
+#include <Vcap/Trace.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef VCAP_HAVE_SDT
+#include <sys/sdt.h>
+#define VCAP_PROBE(name, arg) DTRACE_PROBE1(vcap, name, arg)
+#else
+#define VCAP_PROBE(name, arg)
+#endif
+
+namespace Vcap {
+	extern std::atomic<bool> traceActive;
+
+	std::uint64_t traceClock();
+	void traceEvent(const char* name, std::uint64_t start, std::int64_t arg);
+}
+
+#define VCAP_TRACE_BEGIN(name) \
+	VCAP_PROBE(name##__start, 0); \
+	std::uint64_t vcapTrace_##name = Vcap::traceActive.load(std::memory_order_relaxed) ? Vcap::traceClock() : 0
+
+#define VCAP_TRACE_END(name, arg) \
+	do { \
+		VCAP_PROBE(name##__done, (std::int64_t)(arg)); \
+		if (vcapTrace_##name) \
+			Vcap::traceEvent(#name, vcapTrace_##name, (std::int64_t)(arg)); \
+	} while (0)
+
+#else
+
+#define VCAP_TRACE_BEGIN(name) do { } while (0)
+#define VCAP_TRACE_END(name, arg) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * Vcap C++ Bindings
+ * 
+ * Copyright (C) 2014 James McLean
+ * 
+ * This library is free software; you can redistribute it and/or 
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <Vcap/Vcap.hpp>
+#include <Vcap/TriggerRecorder.hpp>
+
+#include "FrameSize.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <sys/mman.h>
+
+/*
+ * Slots are page-aligned, like frame pool buffers.
+ */
+static const std::size_t SLOT_ALIGNMENT = 4096;
+
+/*
+ * Seconds of frames the ring holds beyond the pre-trigger window, so saving can fall behind capture briefly.
+ */
+static const double WRITER_HEADROOM = 1.0;
+
+static std::size_t alignUp(std::size_t value, std::size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Trigger recorder class definition
+ */
+Vcap::TriggerRecorder::TriggerRecorder(const std::string& prefix, const Format& format, std::uint16_t frameRate,
+		double preSeconds, double postSeconds, std::size_t segmentSize, std::size_t frameSize) throw (RuntimeError) :
+		_prefix(prefix), _format(format), _frameRate(frameRate), _segmentSize(segmentSize), _written(0), _next(0),
+		_active(false), _end(0), _stopping(false), _closed(false), _dropped(0), _saved(0), _events(0), _log(NULL) {
+	if (0 == frameRate || preSeconds < 0 || postSeconds < 0)
+		throw RuntimeError("Trigger recorder requires a frame rate and a non-negative window");
+
+	_pre = (std::uint64_t)(preSeconds * 1000000);
+	_post = (std::uint64_t)(postSeconds * 1000000);
+
+	if (0 == frameSize)
+		frameSize = frameBytes(_format.code(), _format.size().width(), _format.size().height());
+
+	_slotSize = alignUp(frameSize, SLOT_ALIGNMENT);
+
+	if (0 == _slotSize)
+		throw RuntimeError("Trigger recorder requires a non-zero frame size");
+
+	std::size_t count = (std::size_t)std::ceil((preSeconds + WRITER_HEADROOM) * frameRate) + 1;
+
+	_memorySize = count * _slotSize;
+	_memory = (std::uint8_t*)mmap(NULL, _memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+			MAP_POPULATE, -1, 0);
+
+	if (MAP_FAILED == _memory)
+		throw RuntimeError(std::string("Unable to allocate trigger recorder: ") + std::strerror(errno));
+
+	_slots.resize(count);
+
+	for (std::size_t i = 0; i < count; i++) {
+		_slots[i].timestamp = 0;
+		_slots[i].sequence = 0;
+		_slots[i].size = 0;
+		_slots[i].data = _memory + i * _slotSize;
+	}
+
+	_markers.reserve(16);
+
+	try {
+		_thread = std::thread(&TriggerRecorder::run, this);
+	} catch (std::system_error& e) {
+		munmap(_memory, _memorySize);
+		throw RuntimeError(std::string("Unable to start trigger recorder thread: ") + e.what());
+	}
+}
+
+Vcap::TriggerRecorder::~TriggerRecorder() {
+	try {
+		close();
+	} catch (RuntimeError& e) {
+		//nothing more can be done from a destructor
+	}
+
+	munmap(_memory, _memorySize);
+}
+
+bool Vcap::TriggerRecorder::write(const Frame& frame) throw (RuntimeError) {
+	Plane parts[MAX_PLANES];
+	unsigned int numParts = frame.numPlanes();
+
+	for (unsigned int i = 0; i < numParts; i++)
+		parts[i] = frame.plane(i);
+
+	return append(parts, numParts, frame.timestamp(), frame.sequence());
+}
+
+bool Vcap::TriggerRecorder::write(const std::uint8_t* data, std::size_t size, std::uint64_t timestamp,
+		std::uint32_t sequence) throw (RuntimeError) {
+	Plane part;
+	part.data = (std::uint8_t*)data;
+	part.size = size;
+	part.stride = 0;
+
+	return append(&part, 1, timestamp, sequence);
+}
+
+/*
+ * Starts an event at the oldest frame in the ring within the pre-trigger window, or extends the current one.
+ */
+void Vcap::TriggerRecorder::trigger(std::uint64_t timestamp, std::uint32_t id) throw (RuntimeError) {
+	check();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		Marker marker;
+		marker.timestamp = timestamp;
+		marker.id = id;
+
+		_markers.push_back(marker);
+		_events++;
+
+		if (_active) {
+			_end = std::max(_end, timestamp + _post);
+		} else {
+			std::uint64_t oldest = _written > _slots.size() ? _written - _slots.size() : 0;
+			std::uint64_t from = timestamp > _pre ? timestamp - _pre : 0;
+			std::uint64_t start = _written;
+
+			while (start > oldest && _slots[(start - 1) % _slots.size()].timestamp >= from)
+				start--;
+
+			//frames saved by the previous event are not saved again
+			_next = std::max(start, _next);
+			_end = timestamp + _post;
+			_active = true;
+		}
+	}
+
+	_ready.notify_one();
+}
+
+bool Vcap::TriggerRecorder::recording() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _active;
+}
+
+void Vcap::TriggerRecorder::close() throw (RuntimeError) {
+	if (_closed)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_stopping = true;
+	}
+
+	_ready.notify_one();
+	_thread.join();
+
+	_closed = true;
+
+	delete _log;
+	_log = NULL;
+
+	if (!_error.empty())
+		throw RuntimeError(_error);
+}
+
+std::size_t Vcap::TriggerRecorder::capacity() const {
+	return _slots.size();
+}
+
+std::uint64_t Vcap::TriggerRecorder::frames() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _written;
+}
+
+std::uint64_t Vcap::TriggerRecorder::dropped() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _dropped;
+}
+
+std::uint64_t Vcap::TriggerRecorder::saved() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _saved;
+}
+
+std::uint64_t Vcap::TriggerRecorder::events() {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _events;
+}
+
+/*
+ * Copies a frame into the next slot. The slot is published only once it is filled, and is never one the writer has
+ * yet to save.
+ */
+bool Vcap::TriggerRecorder::append(const Plane* parts, unsigned int numParts, std::uint64_t timestamp,
+		std::uint32_t sequence) throw (RuntimeError) {
+	check();
+
+	std::size_t size = 0;
+
+	for (unsigned int i = 0; i < numParts; i++)
+		size += parts[i].size;
+
+	if (size > _slotSize)
+		throw RuntimeError("Frame is too large for trigger recorder " + _prefix);
+
+	std::uint64_t n;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_active && _written - _next >= _slots.size()) {
+			_dropped++;
+			return false;
+		}
+
+		n = _written;
+	}
+
+	Slot& slot = _slots[n % _slots.size()];
+	std::uint8_t* out = slot.data;
+
+	for (unsigned int i = 0; i < numParts; i++) {
+		std::memcpy(out, parts[i].data, parts[i].size);
+		out += parts[i].size;
+	}
+
+	slot.timestamp = timestamp;
+	slot.sequence = sequence;
+	slot.size = size;
+
+	bool active;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_written++;
+		active = _active;
+	}
+
+	if (active)
+		_ready.notify_one();
+
+	return true;
+}
+
+void Vcap::TriggerRecorder::check() throw (RuntimeError) {
+	if (_closed)
+		throw RuntimeError("Trigger recorder " + _prefix + " is closed");
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_error.empty())
+		throw RuntimeError(_error);
+}
+
+/*
+ * Writer thread: saves markers and the current event's frames, ending the event at the first frame past its end. The
+ * frame log is created with the first event.
+ */
+void Vcap::TriggerRecorder::run() {
+	while (true) {
+		std::vector<Marker> markers;
+		Slot slot;
+		bool save = false;
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			auto pending = [this] { return _active && (_next < _written || !_markers.empty()); };
+
+			_ready.wait(lock, [this, &pending] { return pending() || _stopping; });
+
+			if (!pending())
+				break;
+
+			markers.swap(_markers);
+
+			if (_next < _written) {
+				slot = _slots[_next % _slots.size()];
+
+				if (slot.timestamp > _end)
+					_active = false;
+				else
+					save = true;
+			}
+		}
+
+		try {
+			if (!_log)
+				_log = new FrameLog(_prefix, _format, _segmentSize, _frameRate);
+
+			for (std::size_t i = 0; i < markers.size(); i++)
+				_log->mark(markers[i].timestamp, markers[i].id);
+
+			if (save)
+				_log->write(slot.data, slot.size, slot.timestamp, slot.sequence);
+		} catch (RuntimeError& e) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			//stop the event so capture is not held up by frames that will never be saved
+			_error = e.what();
+			_active = false;
+			break;
+		}
+
+		if (save) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_next++;
+			_saved++;
+		}
+	}
+
+	if (_log) {
+		try {
+			_log->close();
+		} catch (RuntimeError& e) {
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (_error.empty())
+				_error = e.what();
+		}
+	}
+}
@@ -20,13 +20,181 @@
 
 #include <Vcap/Vcap.hpp>
 
+#include "ControlCache.hpp"
+#include "Decode.hpp"
+#include "Ioctl.hpp"
+#include "StatsRecorder.hpp"
+#include "Stream.hpp"
+#include "Tracing.hpp"
+
 extern "C" {
 #include <vcap/decode.h>
 }
 
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in microseconds.
+ */
+static std::uint64_t monotonicTime() {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (std::uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Status for a failed vcap_grab_frame(), distinguishing a device that has gone away.
+ */
+static Vcap::Status grabStatus(vcap_camera_t* camera) {
+	int error = errno;
+	
+	if (ENODEV == error || -1 == access(camera->device, F_OK))
+		return Vcap::Status(ENODEV, "Device lost");
+	
+	return Vcap::Status(error ? error : EIO, "Unable to grab frame");
+}
+
+/*
+ * Throws the error for a failed vcap_grab_frame(), keeping Vcap's own description where the device is still there.
+ */
+static void throwGrabError(vcap_camera_t* camera) {
+	Vcap::Status status = grabStatus(camera);
+	
+	if (ENODEV == status.error())
+		Vcap::throwStatus(status, camera->device);
+	
+	throw Vcap::RuntimeError(std::string(vcap_error()));
+}
+
+/*
+ * Size of a driver frame with all of its planes packed back to back.
+ */
+static std::size_t packedSize(const Vcap::Frame& raw) {
+	std::size_t size = 0;
+	
+	for (unsigned int i = 0; i < raw.numPlanes(); i++)
+		size += raw.plane(i).size;
+	
+	return size;
+}
+
+static void packPlanes(const Vcap::Frame& raw, std::uint8_t* out) {
+	for (unsigned int i = 0; i < raw.numPlanes(); i++) {
+		Vcap::Plane plane = raw.plane(i);
+		
+		std::memcpy(out, plane.data, plane.size);
+		out += plane.size;
+	}
+}
+
+/*
+ * Consecutive frames must agree to within these margins for the stream to count as settled: mean luma levels for
+ * formats whose luma can be read directly, otherwise a fraction of the payload size.
+ */
+static const float READY_LUMA_MARGIN = 2.0f;
+static const float READY_SIZE_MARGIN = 0.05f;
+static const unsigned int READY_STABLE_FRAMES = 3;
+
+/*
+ * Waits up to timeout milliseconds for a frame to become available. Returns false on timeout; a lost device counts as
+ * ready so that the following dequeue reports it.
+ */
+static bool waitForFrame(int fd, int timeout) {
+	struct pollfd pfd;
+	
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	
+	int ready;
+	
+	do {
+		ready = poll(&pfd, 1, timeout);
+	} while (-1 == ready && EINTR == errno);
+	
+	return 0 != ready;
+}
+
+/*
+ * Waits for the next frame captured through Vcap.
+ */
+static int grabRaw(vcap_camera_t* camera, std::uint8_t** buffer) {
+	VCAP_TRACE_BEGIN(dequeue);
+	
+	int bufferSize = vcap_grab_frame(camera, buffer);
+	
+	VCAP_TRACE_END(dequeue, bufferSize);
+	
+	return bufferSize;
+}
+
+/*
+ * Decodes a buffer captured through Vcap, metering luma for the exposure controller when stats is given. Vcap's
+ * decoders cannot be hooked, so luma is sampled from the raw buffer where the format allows and from the decoded
+ * output otherwise.
+ */
+static Vcap::Status decodeBuffer(std::uint8_t* raw, std::size_t size, std::uint32_t code, std::uint32_t width,
+		std::uint32_t height, std::uint8_t* out, bool bgr, Vcap::LumaStats* stats) {
+	VCAP_TRACE_BEGIN(decode);
+	
+	int result = vcap_decode(raw, out, code, width, height, bgr);
+	
+	VCAP_TRACE_END(decode, size);
+	
+	if (-1 == result)
+		return Vcap::Status(EINVAL, "Unable to decode frame");
+	
+	if (stats && !Vcap::sampleLuma(raw, size, code, width, height, *stats))
+		Vcap::sampleRgbLuma(out, width, height, bgr, *stats);
+	
+	return Vcap::Status();
+}
+
+/*
+ * Decodes a driver frame, consuming the planes of multi-planar formats directly.
+ */
+static Vcap::Status decodeRaw(const Vcap::Frame& raw, std::uint32_t code, std::uint32_t width, std::uint32_t height,
+		std::uint8_t* out, bool bgr, Vcap::LumaStats* stats) {
+	if (raw.numPlanes() > 1) {
+		VCAP_TRACE_BEGIN(decode);
+		
+		bool decoded = Vcap::decodePlanes(raw, code, width, height, out, bgr, stats);
+		
+		VCAP_TRACE_END(decode, raw.size());
+		
+		if (!decoded)
+			return Vcap::Status(EINVAL, "Unsupported multi-planar format");
+		
+		return Vcap::Status();
+	}
+	
+	return decodeBuffer(raw.data(), raw.size(), code, width, height, out, bgr, stats);
+}
+
+/*
+ * Feeds a decoded frame's statistics to the exposure controller. A failed control write must not cost the frame, so
+ * it is dropped; the next frame tries again. This also runs on the noexcept grab paths, so nothing may escape.
+ */
+static void adjustExposure(Vcap::ExposureController* controller, const Vcap::LumaStats* stats) {
+	if (!stats)
+		return;
+	
+	try {
+		controller->update(*stats);
+	} catch (...) {
+	}
+}
+
 /*
  * Size class definition
  */
@@ -99,7 +267,7 @@ std::vector<Vcap::SizePtr> Vcap::FormatInfo::sizes() {
 	std::vector<SizePtr> sizes;
 	
 	for (int i = 0; i < _format->num_sizes; i++) {
-		sizes.push_back(SizePtr(new Size(_format->sizes[i])));
+		sizes.push_back(makeSmart<Size>(_format->sizes[i]));
 	}
 	
 	return sizes;
@@ -169,7 +337,7 @@ std::vector<Vcap::MenuItemPtr> Vcap::ControlInfo::menu() {
 	std::vector<MenuItemPtr> menu;
 	
 	for (int i = 0; i < _control->menu_length; i++)
-		menu.push_back(MenuItemPtr(new MenuItem(&_control->menu[i])));
+		menu.push_back(makeSmart<MenuItem>(&_control->menu[i]));
 	
 	return menu;
 }
@@ -188,7 +356,7 @@ std::vector<Vcap::CameraPtr> Vcap::Camera::cameras() throw (RuntimeError) {
 		throw RuntimeError(std::string(vcap_error()));
 		
 	for (int i = 0; i < numCameras; i++) {
-		cameras.push_back(CameraPtr(new Camera(&cams[i])));
+		cameras.push_back(makeSmart<Camera>(&cams[i]));
 	}
 	
 	if (-1 == vcap_destroy_cameras(cams, numCameras))
@@ -197,21 +365,39 @@ std::vector<Vcap::CameraPtr> Vcap::Camera::cameras() throw (RuntimeError) {
 	return cameras;
 }
 
-Vcap::Camera::Camera(const std::string& device) {
+Vcap::Camera::Camera(const std::string& device) : _sequence(0) {
 	_camera = vcap_create_camera(device.c_str());
 	
 	if (!_camera)
 		throw RuntimeError(std::string(vcap_error()));
+	
+	_stream = new Stream(_camera);
+	_controlCache = new ControlCache(_camera);
+	_exposure = NULL;
+	_stats = new StatsRecorder();
+	
+	std::memset(&_captureFormat, 0, sizeof(_captureFormat));
 }
 
-Vcap::Camera::Camera(vcap_camera_t* camera) {
+Vcap::Camera::Camera(vcap_camera_t* camera) : _sequence(0) {
 	_camera = new vcap_camera_t;
 	
 	if (-1 == vcap_copy_camera(camera, _camera))
 		throw RuntimeError(std::string(vcap_error()));
+	
+	_stream = new Stream(_camera);
+	_controlCache = new ControlCache(_camera);
+	_exposure = NULL;
+	_stats = new StatsRecorder();
+	
+	std::memset(&_captureFormat, 0, sizeof(_captureFormat));
 }
 
 Vcap::Camera::~Camera() {
+	delete _stats;
+	delete _controlCache;
+	delete _stream;
+	
 	vcap_destroy_camera(_camera);
 }
 
@@ -233,6 +419,8 @@ void Vcap::Camera::open() throw (RuntimeError) {
 }
 
 void Vcap::Camera::close() throw (RuntimeError) {
+	_controlCache->stop();
+	
 	if (-1 == vcap_close_camera(_camera))
 		throw RuntimeError(std::string(vcap_error()));
 }
@@ -252,7 +440,7 @@ std::vector<Vcap::FormatInfoPtr> Vcap::Camera::formats() throw (RuntimeError) {
 		throw RuntimeError(std::string(vcap_error()));
 		
 	for (int i = 0; i < numFormats; i++)
-		formats.push_back(FormatInfoPtr(new FormatInfo(&fmts[i])));
+		formats.push_back(makeSmart<FormatInfo>(&fmts[i]));
 
 	vcap_destroy_formats(fmts, numFormats);
 
@@ -260,6 +448,14 @@ std::vector<Vcap::FormatInfoPtr> Vcap::Camera::formats() throw (RuntimeError) {
 }
 
 Vcap::Format Vcap::Camera::format() throw (RuntimeError) {
+	if (opened() && _stream->multiplanar()) {
+		std::uint32_t code, width, height;
+		
+		_stream->format(code, width, height);
+		
+		return Format(code, Size(width, height));
+	}
+	
 	vcap_format_t format;
 	
 	if (-1 == vcap_get_format(_camera, &format))
@@ -269,8 +465,15 @@ Vcap::Format Vcap::Camera::format() throw (RuntimeError) {
 }
 
 void Vcap::Camera::setFormat(const Format& format) throw (RuntimeError) {
+	if (opened() && _stream->multiplanar()) {
+		_stream->setFormat(format._format.code, format._format.size.width, format._format.size.height);
+		return;
+	}
+	
 	if (-1 == vcap_set_format(_camera, format._format))
 		throw RuntimeError(std::string(vcap_error()));
+	
+	_captureFormat = format._format;
 }
 
 void Vcap::Camera::autoSetFormat() throw (RuntimeError) {
@@ -321,7 +524,7 @@ std::vector<Vcap::ControlInfoPtr> Vcap::Camera::controls() throw (RuntimeError)
 		throw RuntimeError(std::string(vcap_error()));
 		
 	for (int i = 0; i < numControls; i++) {
-		controls.push_back(ControlInfoPtr(new ControlInfo(&ctrls[i])));
+		controls.push_back(makeSmart<ControlInfo>(&ctrls[i]));
 	}
 	
 	vcap_destroy_controls(ctrls, numControls);
@@ -332,6 +535,9 @@ std::vector<Vcap::ControlInfoPtr> Vcap::Camera::controls() throw (RuntimeError)
 std::int32_t Vcap::Camera::controlValue(const ControlId& id) throw (RuntimeError) {
 	std::int32_t value;
 	
+	if (_controlCache->value(id, value))
+		return value;
+	
 	if (-1 == vcap_get_control_value(_camera, (vcap_control_id_t)id, &value))
 		throw RuntimeError(std::string(vcap_error()));
 	
@@ -339,52 +545,574 @@ std::int32_t Vcap::Camera::controlValue(const ControlId& id) throw (RuntimeError
 }
 
 void Vcap::Camera::setControlValue(const ControlId& id, const std::int32_t& value) throw (RuntimeError) {
-	if (-1 == vcap_set_control_value(_camera, (vcap_control_id_t)id, value))
+	VCAP_TRACE_BEGIN(control);
+	
+	int result = vcap_set_control_value(_camera, (vcap_control_id_t)id, value);
+	
+	VCAP_TRACE_END(control, id);
+	
+	if (-1 == result)
 		throw RuntimeError(std::string(vcap_error()));
+	
+	_controlCache->update(id, value);
+}
+
+void Vcap::Camera::watchControls() throw (RuntimeError) {
+	if (!opened())
+		throw RuntimeError("Camera is not open");
+	
+	_controlCache->start(controlList());
+}
+
+void Vcap::Camera::unwatchControls() {
+	_controlCache->stop();
+}
+
+bool Vcap::Camera::watchingControls() {
+	return _controlCache->watching();
+}
+
+std::size_t Vcap::Camera::addControlCallback(const ControlCallback& callback) {
+	return _controlCache->addCallback(callback);
+}
+
+void Vcap::Camera::removeControlCallback(std::size_t handle) {
+	_controlCache->removeCallback(handle);
+}
+
+void Vcap::Camera::setExposureController(ExposureController* controller) {
+	_exposure = controller;
+}
+
+Vcap::Status Vcap::Camera::tryControlValue(const ControlId& id, std::int32_t& value) noexcept {
+	if (_controlCache->value(id, value))
+		return Status();
+	
+	if (-1 == vcap_get_control_value(_camera, (vcap_control_id_t)id, &value))
+		return errnoStatus("Unable to get control value");
+	
+	return Status();
+}
+
+Vcap::Status Vcap::Camera::trySetControlValue(const ControlId& id, std::int32_t value) noexcept {
+	VCAP_TRACE_BEGIN(control);
+	
+	int result = vcap_set_control_value(_camera, (vcap_control_id_t)id, value);
+	
+	VCAP_TRACE_END(control, id);
+	
+	if (-1 == result)
+		return errnoStatus("Unable to set control value");
+	
+	_controlCache->update(id, value);
+	
+	return Status();
+}
+
+Vcap::CaptureStats Vcap::Camera::stats() {
+	CaptureStats stats;
+	
+	_stats->snapshot(stats);
+	
+	return stats;
+}
+
+void Vcap::Camera::resetStats() {
+	_stats->reset();
+}
+
+Vcap::IoMode Vcap::Camera::ioMode() {
+	return _stream->mode();
+}
+
+void Vcap::Camera::setIoMode(IoMode mode) throw (RuntimeError) {
+	if (capturing())
+		throw RuntimeError("Unable to change I/O mode while capturing");
+	
+	_stream->setMode(mode);
+}
+
+std::size_t Vcap::Camera::bufferCount() {
+	return _stream->bufferCount();
+}
+
+void Vcap::Camera::setBufferCount(std::size_t count) throw (RuntimeError) {
+	_stream->setBufferCount(count);
+}
+
+void Vcap::Camera::addUserBuffer(std::uint8_t* data, std::size_t length) throw (RuntimeError) {
+	_stream->addUserBuffer(data, length);
+}
+
+void Vcap::Camera::clearUserBuffers() throw (RuntimeError) {
+	_stream->clearUserBuffers();
 }
 
 void Vcap::Camera::start() throw (RuntimeError) {
+	if (IO_DEFAULT != _stream->mode()) {
+		if (!opened())
+			throw RuntimeError("Camera is not open");
+		
+		_stream->start();
+		return;
+	}
+	
 	if (-1 == vcap_start_capture(_camera))
 		throw RuntimeError(std::string(vcap_error()));
+	
+	//the format cannot change while capturing
+	if (-1 == vcap_get_format(_camera, &_captureFormat))
+		throw RuntimeError(std::string(vcap_error()));
 }
 
 void Vcap::Camera::stop() throw (RuntimeError) {
+	if (_stream->streaming()) {
+		_stream->stop();
+		return;
+	}
+	
 	if (-1 == vcap_stop_capture(_camera))
 		throw RuntimeError(std::string(vcap_error()));
 }
 
+Vcap::Status Vcap::Camera::tryStart() noexcept {
+	if (IO_DEFAULT != _stream->mode()) {
+		if (!opened())
+			return Status(EBADF, "Camera is not open");
+		
+		return _stream->tryStart();
+	}
+	
+	if (-1 == vcap_start_capture(_camera))
+		return errnoStatus("Unable to start capture");
+	
+	if (-1 == vcap_get_format(_camera, &_captureFormat))
+		return errnoStatus("Unable to get format");
+	
+	return Status();
+}
+
+Vcap::Status Vcap::Camera::tryStop() noexcept {
+	if (_stream->streaming())
+		return _stream->tryStop();
+	
+	if (-1 == vcap_stop_capture(_camera))
+		return errnoStatus("Unable to stop capture");
+	
+	return Status();
+}
+
 bool Vcap::Camera::capturing() {
-	return _camera->capturing;
+	return _camera->capturing || _stream->streaming();
+}
+
+bool Vcap::Camera::waitUntilReady(unsigned int timeout, unsigned int frames) throw (RuntimeError) {
+	if (!capturing())
+		throw RuntimeError("Camera is not capturing");
+	
+	bool native = IO_DEFAULT != _stream->mode();
+	
+	std::uint32_t code, width, height;
+	
+	if (native) {
+		code = _stream->code();
+		width = _stream->width();
+		height = _stream->height();
+	} else {
+		Format fmt = format();
+		
+		code = fmt.code();
+		width = fmt.size().width();
+		height = fmt.size().height();
+	}
+	
+	std::chrono::steady_clock::time_point deadline =
+			std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	
+	unsigned int discarded = 0;
+	unsigned int stable = 0;
+	float previous = -1.0f;
+	
+	LumaStats stats;
+	
+	for (;;) {
+		std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now());
+		
+		//bound the blocking dequeue by the deadline rather than the driver's own timeout
+		if (remaining.count() <= 0 || !waitForFrame(_camera->fd, (int)remaining.count()))
+			return false;
+		
+		Frame raw;
+		std::uint8_t* rawBuffer = NULL;
+		
+		const std::uint8_t* data;
+		std::size_t size;
+		
+		if (native) {
+			Status status = _stream->tryDequeue(raw);
+			
+			if (ETIMEDOUT == status.error())
+				return false;
+			
+			if (!status.ok())
+				throwStatus(status, _camera->device);
+			
+			//the luma plane comes first in every multi-planar YUV format
+			data = raw.plane(0).data;
+			size = raw.plane(0).size;
+		} else {
+			int bufferSize = grabRaw(_camera, &rawBuffer);
+			
+			if (-1 == bufferSize)
+				throwGrabError(_camera);
+			
+			data = rawBuffer;
+			size = (std::size_t)bufferSize;
+		}
+		
+		float level = 0.0f;
+		float margin = 0.0f;
+		bool metered = false;
+		
+		if (size > 0) {
+			std::memset(&stats, 0, sizeof(stats));
+			
+			if (sampleLuma(data, size, code, width, height, stats) && stats.samples > 0) {
+				std::uint64_t sum = 0;
+				
+				for (unsigned int i = 0; i < EXPOSURE_ZONES * EXPOSURE_ZONES; i++)
+					sum += stats.zoneSum[i];
+				
+				level = (float)sum / (float)stats.samples;
+				margin = READY_LUMA_MARGIN;
+				metered = true;
+			} else {
+				level = (float)size;
+				margin = READY_SIZE_MARGIN * level;
+			}
+		}
+		
+		delete [] rawBuffer;
+		
+		//let an attached exposure controller converge while we wait
+		if (metered && _exposure)
+			adjustExposure(_exposure, &stats);
+		
+		//empty payloads are common while a camera is still starting up
+		if (0 == size) {
+			stable = 0;
+			previous = -1.0f;
+			continue;
+		}
+		
+		discarded++;
+		
+		if (frames > 0 && discarded >= frames)
+			return true;
+		
+		if (previous >= 0.0f && level - previous <= margin && previous - level <= margin) {
+			if (++stable >= READY_STABLE_FRAMES)
+				return true;
+		} else {
+			stable = 0;
+		}
+		
+		previous = level;
+	}
 }
 
 std::size_t Vcap::Camera::grab(std::uint8_t** buffer, bool decode, bool bgr) throw (RuntimeError) {
+	std::uint64_t start = monotonicTime();
+	std::size_t size;
+	
+	try {
+		size = grabBuffer(buffer, decode, bgr, start);
+	} catch (RuntimeError&) {
+		_stats->error();
+		throw;
+	}
+	
+	_stats->record(STAGE_TOTAL, monotonicTime() - start);
+	
+	return size;
+}
+
+std::size_t Vcap::Camera::grabBuffer(std::uint8_t** buffer, bool decode, bool bgr, std::uint64_t start) {
+	if (IO_DEFAULT != _stream->mode()) {
+		Frame raw = _stream->dequeue();
+		
+		std::uint64_t dequeued = monotonicTime();
+		
+		_stats->record(STAGE_WAIT, dequeued - start);
+		_stats->frame(packedSize(raw), raw.sequence(), true);
+		
+		if (!decode) {
+			std::size_t rawSize = packedSize(raw);
+			
+			*buffer = new std::uint8_t[rawSize];
+			packPlanes(raw, *buffer);
+			
+			_stats->record(STAGE_COPY, monotonicTime() - dequeued);
+			
+			return rawSize;
+		}
+		
+		std::size_t rgbSize = 3 * _stream->width() * _stream->height();
+		std::uint8_t* rgbBuffer = new std::uint8_t[rgbSize];
+		
+		LumaStats* stats = _exposure ? _exposure->beginFrame() : NULL;
+		
+		Status status = decodeRaw(raw, _stream->code(), _stream->width(), _stream->height(), rgbBuffer, bgr, stats);
+		
+		_stats->record(STAGE_DECODE, monotonicTime() - dequeued);
+		
+		if (!status.ok()) {
+			delete [] rgbBuffer;
+			throwStatus(status, _camera->device);
+		}
+		
+		*buffer = rgbBuffer;
+		
+		adjustExposure(_exposure, stats);
+		
+		return rgbSize;
+	}
+	
 	int bufferSize;
 	
 	if (!decode) {
-		bufferSize = vcap_grab_frame(_camera, buffer);
+		bufferSize = grabRaw(_camera, buffer);
 		
 		if (-1 == bufferSize)
-			throw RuntimeError(std::string(vcap_error()));
+			throwGrabError(_camera);
+		
+		_stats->record(STAGE_WAIT, monotonicTime() - start);
+		_stats->frame((std::size_t)bufferSize, 0, false);
 			
 		return (std::size_t)bufferSize;
 	} else {
-		Format fmt = format();
+		Format fmt(_captureFormat);
 		
 		std::uint8_t* rawBuffer;
 		std::uint8_t* rgbBuffer = new std::uint8_t[3 * fmt.size().width() * fmt.size().height()];
 		
-		bufferSize = vcap_grab_frame(_camera, &rawBuffer); 
+		bufferSize = grabRaw(_camera, &rawBuffer);
 		
-		if (-1 == bufferSize)
-			throw RuntimeError(std::string(vcap_error()));
+		if (-1 == bufferSize) {
+			delete [] rgbBuffer;
+			throwGrabError(_camera);
+		}
+		
+		std::uint64_t grabbed = monotonicTime();
+		
+		_stats->record(STAGE_WAIT, grabbed - start);
+		_stats->frame((std::size_t)bufferSize, 0, false);
+		
+		LumaStats* stats = _exposure ? _exposure->beginFrame() : NULL;
+		
+		Status status = decodeBuffer(rawBuffer, (std::size_t)bufferSize, fmt.code(), fmt.size().width(),
+				fmt.size().height(), rgbBuffer, bgr, stats);
 		
-		if (-1 == vcap_decode(rawBuffer, rgbBuffer, fmt.code(), fmt.size().width(), fmt.size().height(), bgr))
-			throw RuntimeError(std::string(vcap_error()));
+		_stats->record(STAGE_DECODE, monotonicTime() - grabbed);
 			
 		delete [] rawBuffer;
 		
+		if (!status.ok()) {
+			delete [] rgbBuffer;
+			throwStatus(status, _camera->device);
+		}
+		
 		*buffer = rgbBuffer;
 		
+		adjustExposure(_exposure, stats);
+		
 		return (std::size_t)(3 * fmt.size().width() * fmt.size().height());
 	}
 }
+
+Vcap::Frame Vcap::Camera::grab(FramePool& pool, bool decode, bool bgr) throw (RuntimeError) {
+	Frame frame;
+	Status status = tryGrab(pool, frame, decode, bgr);
+	
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+	
+	return frame;
+}
+
+Vcap::Status Vcap::Camera::tryGrab(FramePool& pool, Frame& frame, bool decode, bool bgr) noexcept {
+	std::uint64_t start = monotonicTime();
+	
+	Status status = grabFrame(pool, frame, decode, bgr, start);
+	
+	if (status.ok())
+		_stats->record(STAGE_TOTAL, monotonicTime() - start);
+	else
+		_stats->error();
+	
+	return status;
+}
+
+Vcap::Status Vcap::Camera::grabFrame(FramePool& pool, Frame& frame, bool decode, bool bgr, std::uint64_t start)
+		noexcept {
+	Frame out = pool.acquire();
+	
+	if (!out.valid())
+		return Status(ENOBUFS, "Frame pool exhausted");
+	
+	FrameSlot* slot = out._slot;
+	LumaStats* stats = NULL;
+	
+	//zero-copy path: the driver buffer is decoded or copied straight into the pool buffer
+	if (IO_DEFAULT != _stream->mode()) {
+		Frame raw;
+		Status status = _stream->tryDequeue(raw);
+		
+		if (!status.ok())
+			return status;
+		
+		std::uint64_t dequeued = monotonicTime();
+		
+		_stats->record(STAGE_WAIT, dequeued - start);
+		_stats->frame(packedSize(raw), raw.sequence(), true);
+		
+		slot->timestamp = raw.timestamp();
+		slot->sequence = raw.sequence();
+		
+		if (!decode) {
+			std::size_t rawSize = packedSize(raw);
+			
+			if (rawSize > slot->capacity)
+				return Status(EMSGSIZE, "Frame pool buffers are too small for raw frame");
+			
+			packPlanes(raw, slot->data);
+			slot->size = rawSize;
+			slot->stride = raw.plane(0).stride;
+			
+			_stats->record(STAGE_COPY, monotonicTime() - dequeued);
+		} else {
+			std::size_t rgbSize = 3 * _stream->width() * _stream->height();
+			
+			if (rgbSize > slot->capacity)
+				return Status(EMSGSIZE, "Frame pool buffers are too small for decoded frame");
+			
+			stats = _exposure ? _exposure->beginFrame() : NULL;
+			status = decodeRaw(raw, _stream->code(), _stream->width(), _stream->height(), slot->data, bgr, stats);
+			
+			_stats->record(STAGE_DECODE, monotonicTime() - dequeued);
+			
+			if (!status.ok())
+				return status;
+			
+			slot->size = rgbSize;
+			slot->stride = 3 * _stream->width();
+		}
+		
+		adjustExposure(_exposure, stats);
+		
+		frame = std::move(out);
+		
+		return Status();
+	}
+	
+	const vcap_format_t& fmt = _captureFormat;
+	
+	std::uint8_t* rawBuffer;
+	
+	int bufferSize = grabRaw(_camera, &rawBuffer);
+	
+	if (-1 == bufferSize)
+		return grabStatus(_camera);
+	
+	std::uint64_t grabbed = monotonicTime();
+	
+	_stats->record(STAGE_WAIT, grabbed - start);
+	_stats->frame((std::size_t)bufferSize, 0, false);
+	
+	slot->timestamp = grabbed;
+	slot->sequence = _sequence++;
+	
+	Status status;
+	
+	if (!decode) {
+		if ((std::size_t)bufferSize > slot->capacity) {
+			status = Status(EMSGSIZE, "Frame pool buffers are too small for raw frame");
+		} else {
+			std::memcpy(slot->data, rawBuffer, bufferSize);
+			slot->size = (std::size_t)bufferSize;
+			slot->stride = 0;
+			
+			_stats->record(STAGE_COPY, monotonicTime() - grabbed);
+		}
+	} else {
+		std::size_t rgbSize = 3 * fmt.size.width * fmt.size.height;
+		
+		if (rgbSize > slot->capacity) {
+			status = Status(EMSGSIZE, "Frame pool buffers are too small for decoded frame");
+		} else {
+			stats = _exposure ? _exposure->beginFrame() : NULL;
+			status = decodeBuffer(rawBuffer, (std::size_t)bufferSize, fmt.code, fmt.size.width, fmt.size.height,
+					slot->data, bgr, stats);
+			
+			_stats->record(STAGE_DECODE, monotonicTime() - grabbed);
+			
+			slot->size = rgbSize;
+			slot->stride = 3 * fmt.size.width;
+		}
+	}
+	
+	delete [] rawBuffer;
+	
+	if (!status.ok())
+		return status;
+	
+	adjustExposure(_exposure, stats);
+	
+	frame = std::move(out);
+	
+	return Status();
+}
+
+Vcap::Frame Vcap::Camera::dequeue() throw (RuntimeError) {
+	if (IO_DEFAULT == _stream->mode())
+		throw RuntimeError("dequeue() requires a library-managed I/O mode");
+	
+	Frame frame;
+	Status status = tryDequeue(frame);
+	
+	if (!status.ok())
+		throwStatus(status, _camera->device);
+	
+	return frame;
+}
+
+Vcap::Status Vcap::Camera::tryDequeue(Frame& frame) noexcept {
+	if (IO_DEFAULT == _stream->mode())
+		return Status(EINVAL, "dequeue() requires a library-managed I/O mode");
+	
+	std::uint64_t start = monotonicTime();
+	
+	Status status = _stream->tryDequeue(frame);
+	
+	if (!status.ok()) {
+		_stats->error();
+		return status;
+	}
+	
+	std::uint64_t latency = monotonicTime() - start;
+	
+	_stats->record(STAGE_WAIT, latency);
+	_stats->record(STAGE_TOTAL, latency);
+	_stats->frame(packedSize(frame), frame.sequence(), true);
+	
+	return status;
+}
+
+int Vcap::Camera::exportFrame(const Frame& frame, unsigned int importers) throw (RuntimeError) {
+	return _stream->exportFrame(frame, importers);
+}
+
+void Vcap::Camera::releaseExported(std::uint32_t index) throw (RuntimeError) {
+	_stream->releaseExported(index);
+}